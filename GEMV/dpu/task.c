@@ -24,6 +24,37 @@ static void gemv(T *bufferC, T *bufferA, T *bufferB, int pos) {
 	return;
 }
 
+#if W_BITS < 32
+// GEMV with packed weights: every 32-bit load of A feeds 32 / W_BITS multiply-accumulates of 8-bit operands
+// (native 8x8-bit multiplications, while 32-bit multiplications take several instructions), accumulated in INT32
+static int32_t gemv_packed(uint32_t *bufferA, uint32_t *bufferB, unsigned int words) {
+	int32_t acc = 0;
+	for (unsigned int i = 0; i < words; i++) {
+		uint32_t a = bufferA[i];
+#if W_BITS == 8
+		uint32_t b = bufferB[i];
+		acc += (int8_t) a * (int8_t) b;
+		acc += (int8_t) (a >> 8) * (int8_t) (b >> 8);
+		acc += (int8_t) (a >> 16) * (int8_t) (b >> 16);
+		acc += (int8_t) (a >> 24) * (int8_t) (b >> 24);
+#else
+		// Element 2k is the low nibble of byte k, element 2k + 1 the high one (sign-extended by the arithmetic shift)
+		uint32_t b0 = bufferB[i << 1];
+		uint32_t b1 = bufferB[(i << 1) + 1];
+		acc += ((int8_t) (a << 4) >> 4) * (int8_t) b0;
+		acc += ((int8_t) a >> 4) * (int8_t) (b0 >> 8);
+		acc += ((int8_t) (a >> 4) >> 4) * (int8_t) (b0 >> 16);
+		acc += ((int8_t) (a >> 8) >> 4) * (int8_t) (b0 >> 24);
+		acc += ((int8_t) (a >> 12) >> 4) * (int8_t) b1;
+		acc += ((int8_t) (a >> 16) >> 4) * (int8_t) (b1 >> 8);
+		acc += ((int8_t) (a >> 20) >> 4) * (int8_t) (b1 >> 16);
+		acc += ((int8_t) (a >> 24) >> 4) * (int8_t) (b1 >> 24);
+#endif
+	}
+	return acc;
+}
+#endif
+
 // Barrier
 BARRIER_INIT(my_barrier, NR_TASKLETS);
 
@@ -43,6 +74,7 @@ int main() {
 	int32_t n_size_pad = DPU_INPUT_ARGUMENTS.n_size_pad;
 	uint32_t nr_rows = DPU_INPUT_ARGUMENTS.nr_rows;
 	uint32_t max_rows = DPU_INPUT_ARGUMENTS.max_rows;
+	uint32_t batch = DPU_INPUT_ARGUMENTS.batch;
 
 	unsigned int element_per_cacheC = 8/sizeof(T);
 
@@ -73,17 +105,56 @@ int main() {
 	}
 
 	// Address of the current row in MRAM
-	uint32_t mram_base_addr_A = (uint32_t) (DPU_MRAM_HEAP_POINTER + start_row * n_size * sizeof(T));
-	uint32_t mram_base_addr_B = (uint32_t) (DPU_MRAM_HEAP_POINTER + max_rows * n_size_pad * sizeof(T));
-	uint32_t mram_base_addr_C = (uint32_t) (DPU_MRAM_HEAP_POINTER + max_rows * n_size_pad * sizeof(T) + n_size_pad * sizeof(T) + start_row * sizeof(T));
+	uint32_t mram_base_addr_A = (uint32_t) (DPU_MRAM_HEAP_POINTER + start_row * A_BYTES(n_size));
+	uint32_t mram_base_addr_B = (uint32_t) (DPU_MRAM_HEAP_POINTER + max_rows * A_BYTES(n_size_pad));
+	uint32_t mram_base_addr_C = (uint32_t) (DPU_MRAM_HEAP_POINTER + max_rows * A_BYTES(n_size_pad) + batch * B_BYTES(n_size_pad) + start_row * sizeof(T));
+#if W_BITS < 32
+	// Packed rows are padded to 8 bytes (n_size == n_size_pad), so all blocks are aligned
+	uint32_t row_bytes = A_BYTES(n_size_pad);
+	uint32_t *cache_A = (uint32_t *) mem_alloc(A_BLOCK_SIZE);
+	uint32_t *cache_B = (uint32_t *) mem_alloc(BLOCK_SIZE);
+	T *cache_C = (T *) mem_alloc(batch * 8);
+
+	for (unsigned int i = start_row; i < start_row + rows_per_tasklet; i += element_per_cacheC) {
+
+		// clear the cache
+		for(unsigned int c = 0; c < batch * element_per_cacheC; c++){
+			cache_C[c] = 0;
+		}
+
+		for(unsigned int pos = 0; pos < element_per_cacheC && i + pos < nr_rows; pos++){
+			for(uint32_t byte_index = 0; byte_index < row_bytes; byte_index += A_BLOCK_SIZE){
+
+				// Bound checking
+				uint32_t l_size_bytes = (byte_index + A_BLOCK_SIZE >= row_bytes) ? (row_bytes - byte_index) : A_BLOCK_SIZE;
+
+				// Each block of A is read once and multiplied by the block of every input vector (streamed through cache_B)
+				mram_read((__mram_ptr void const*) (mram_base_addr_A + byte_index), cache_A, l_size_bytes);
+				for(unsigned int v = 0; v < batch; v++){
+					mram_read((__mram_ptr void const*) (mram_base_addr_B + v * B_BYTES(n_size_pad) + byte_index * (8 / W_BITS)), cache_B, l_size_bytes * (8 / W_BITS));
+					cache_C[v * element_per_cacheC + pos] += gemv_packed(cache_A, cache_B, l_size_bytes >> 2);
+				}
+			}
+			mram_base_addr_A += row_bytes;
+		}
+
+		// Write cache to current MRAM block, one output vector of max_rows elements per input vector
+		for(unsigned int v = 0; v < batch; v++)
+			mram_write(cache_C + v * element_per_cacheC, (__mram_ptr void *) (mram_base_addr_C + v * max_rows * sizeof(T)), 8);
+		mram_base_addr_C += 8;
+	}
+
+	return 0;
+#else
 	uint32_t mram_temp_addr_A = mram_base_addr_A;
 	uint32_t mram_temp_addr_B = mram_base_addr_B;
 
 	// Inititalize a local cache to store the MRAM block
+	// Each block of A is read once and multiplied by the block of every input vector (streamed through cache_B)
 	T *cache_A = (T *) mem_alloc(BLOCK_SIZE + 8);
 	T *cache_A_aux = (T *) mem_alloc(8);
 	T *cache_B = (T *) mem_alloc(BLOCK_SIZE);
-	T *cache_C = (T *) mem_alloc(8);
+	T *cache_C = (T *) mem_alloc(batch * 8);
 
 	int offset = 0;
 
@@ -103,7 +174,7 @@ int main() {
 		// cache_C[1] = 0;
 
 		// clear the cache
-		for(unsigned int c = 0; c < element_per_cacheC; c++){
+		for(unsigned int c = 0; c < batch * element_per_cacheC; c++){
 			cache_C[c] = 0; 
 		}
 
@@ -121,7 +192,6 @@ int main() {
 			{
 
 				mram_read((__mram_ptr void const*) (mram_temp_addr_A), cache_A, BLOCK_SIZE);
-				mram_read((__mram_ptr void const*) (mram_temp_addr_B), cache_B, BLOCK_SIZE);
 
 				if(offset)
 				{
@@ -137,7 +207,10 @@ int main() {
 				}
 
 				// Compute GEMV
-				gemv(cache_C, cache_A, cache_B, pos);
+				for(unsigned int v = 0; v < batch; v++) {
+					mram_read((__mram_ptr void const*) (mram_temp_addr_B + v * n_size_pad * sizeof(T)), cache_B, BLOCK_SIZE);
+					gemv(cache_C + v * element_per_cacheC, cache_A, cache_B, pos);
+				}
 
 				// Update memory addresses
 				mram_temp_addr_A += BLOCK_SIZE;
@@ -161,15 +234,17 @@ int main() {
 			}
 
 
-			mram_read((__mram_ptr void const*) (mram_temp_addr_B), cache_B, BLOCK_SIZE);
+			for(unsigned int v = 0; v < batch; v++) {
+				mram_read((__mram_ptr void const*) (mram_temp_addr_B + v * n_size_pad * sizeof(T)), cache_B, BLOCK_SIZE);
 
-			for (j = 0; j < (int) (n_size - n); j++) {
-				// Compute GEMV
-				if(j >= (int)(BLOCK_SIZE / sizeof(T))){ 
-					printf("error\n");
-					break;
+				for (j = 0; j < (int) (n_size - n); j++) {
+					// Compute GEMV
+					if(j >= (int)(BLOCK_SIZE / sizeof(T))){ 
+						printf("error\n");
+						break;
+					}
+					cache_C[v * element_per_cacheC + pos] += cache_A[j] * cache_B[j];
 				}
-				cache_C[pos] += cache_A[j] * cache_B[j];
 			}
 
 
@@ -185,8 +260,9 @@ int main() {
 				offset = 0;
 			}
 		}
-		// Write cache to current MRAM block
-		mram_write(cache_C, (__mram_ptr void *) (mram_base_addr_C), 8);
+		// Write cache to current MRAM block, one output vector of max_rows elements per input vector
+		for(unsigned int v = 0; v < batch; v++)
+			mram_write(cache_C + v * element_per_cacheC, (__mram_ptr void *) (mram_base_addr_C + v * max_rows * sizeof(T)), 8);
 
 		// Update memory address
 		// mram_base_addr_C += 2 * sizeof(T);
@@ -195,4 +271,5 @@ int main() {
 	}
 
 	return 0;
+#endif
 }
@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <assert.h>
+#include <math.h>
 
 #if ENERGY
 #include <dpu_probe.h>
@@ -21,47 +22,206 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
 #define DPU_BINARY "./bin/gemv_dpu"
 #endif
 
-static T* A;
-static T* B;
+static TA* A;
+static TB* B;
 static T* C;
 static T* C_dpu;
+#if W_BITS < 32
+#define W_MAX ((1 << (W_BITS - 1)) - 1) // Symmetric range of quantized values
+static float* A_scales; // One per row
+static float* B_scales; // One per input vector
+static float* Y; // Dequantized outputs
+static double* Y_host;
+#endif
+
+// Column groups: block j of a DPU is row j of its slice of A (matrix), or vector j of its slice of B,
+// n_cols_pad elements from the first column of the slice. The slice of the last group is completed with
+// the next elements of the row, multiplied by the zero padding of B
+typedef struct {
+	uint8_t* M;
+	uint64_t rows;
+	uint64_t row_bytes; // Bytes between consecutive rows (vectors) of M
+	uint64_t slice_bytes;
+	uint64_t elem_bits;
+	bool matrix; // Rows of A start at the first row of the DPU
+} slice_blocks_t;
+
+static bool get_slice_block(struct sg_block_info *out, uint32_t dpu_index, uint32_t block_index, void *args) {
+	slice_blocks_t* blocks = (slice_blocks_t*) args;
+	if(block_index >= blocks->rows)
+		return false;
+	uint64_t row = (blocks->matrix ? dpu_info[dpu_index].prev_rows_dpu : 0) + block_index;
+	out->addr = blocks->M + row * blocks->row_bytes + dpu_info[dpu_index].prev_cols_dpu * blocks->elem_bits / 8;
+	out->length = blocks->slice_bytes;
+	return true;
+}
+
+// Weight n of row m of A (rows of row_bytes bytes)
+static inline int32_t get_weight(TA* A, size_t row_bytes, unsigned int m, unsigned int n) {
+#if W_BITS == 32
+	return A[m * (row_bytes / sizeof(T)) + n];
+#elif W_BITS == 8
+	return (int8_t) A[m * row_bytes + n];
+#else
+	// Element 2k is the low nibble of byte k, element 2k + 1 the high one
+	return (int8_t) (A[m * row_bytes + (n >> 1)] << ((n & 1) ? 0 : 4)) >> 4;
+#endif
+}
+
+#if W_BITS < 32
+static inline void set_weight(TA* A, size_t row_bytes, unsigned int m, unsigned int n, int32_t w) {
+#if W_BITS == 8
+	A[m * row_bytes + n] = (uint8_t) w;
+#else
+	uint8_t *byte = &A[m * row_bytes + (n >> 1)];
+	*byte = (n & 1) ? ((*byte & 0x0f) | ((uint8_t) w << 4)) : ((*byte & 0xf0) | ((uint8_t) w & 0x0f));
+#endif
+}
+#endif
 
 // Create input arrays
-static void init_data(T* A, T* B, unsigned int m_size, unsigned int n_size) {
+// Quantized formats: weights in [-W_MAX, W_MAX] with a scale per row, INT8 input vectors with a scale per vector
+static void init_data(TA* A, TB* B, unsigned int m_size, unsigned int n_size, size_t a_row_bytes, unsigned int b_stride, unsigned int batch) {
 	srand(0);
 
-	for (unsigned int i = 0; i < m_size * n_size; i++)
+#if W_BITS == 32
+	(void) a_row_bytes;
+	for (size_t i = 0; i < (size_t) m_size * n_size; i++)
 	{
 		A[i] = (unsigned int) (rand()%50);
 	}
 
-	for (unsigned int i = 0; i < n_size; i++)
+	for (unsigned int v = 0; v < batch; v++)
+	{
+		for (unsigned int i = 0; i < n_size; i++)
+		{
+			B[v * b_stride + i] = (unsigned int) (rand()%50);
+		}
+	}
+#else
+	for (unsigned int m = 0; m < m_size; m++)
+	{
+		A_scales[m] = (float) (rand()%1000 + 1) / 100000;
+		for (unsigned int n = 0; n < n_size; n++)
+		{
+			set_weight(A, a_row_bytes, m, n, rand()%(2 * W_MAX + 1) - W_MAX);
+		}
+	}
+
+	for (unsigned int v = 0; v < batch; v++)
 	{
-		B[i] = (unsigned int) (rand()%50);
+		B_scales[v] = (float) (rand()%1000 + 1) / 100000;
+		for (unsigned int i = 0; i < n_size; i++)
+		{
+			B[v * b_stride + i] = (TB) (rand()%255 - 127);
+		}
 	}
+#endif
 }
 
 // Compute output in the host
-static void gemv_host(T* C, T* A, T* B, unsigned int m_size, unsigned int n_size) {
-	for (unsigned int i = 0; i < m_size; i++)
+// One output vector (m_size elements) per input vector (b_stride elements)
+static void gemv_host(T* C, TA* A, TB* B, unsigned int m_size, unsigned int n_size, size_t a_row_bytes, unsigned int b_stride, unsigned int batch) {
+	for (unsigned int i = 0; i < batch * m_size; i++)
 	{
 		C[i] = 0;
 	}
 
-	for (unsigned int m = 0; m < m_size; m++) {
-		for (unsigned int n = 0; n < n_size; n++)
+	for (unsigned int v = 0; v < batch; v++) {
+		for (unsigned int m = 0; m < m_size; m++) {
+			for (unsigned int n = 0; n < n_size; n++)
+			{
+				C[v * m_size + m] += get_weight(A, a_row_bytes, m, n) * B[v * b_stride + n];
+			}
+		}
+	}
+}
+
+#if W_BITS < 32
+// Dequantize the INT32 outputs of the DPUs (first row_dpus DPUs, after merging the column groups)
+static void dequantize(float* Y, T* C_dpu, unsigned int m_size, uint32_t row_dpus, uint32_t max_rows_per_dpu, unsigned int batch) {
+	for (unsigned int v = 0; v < batch; v++) {
+		for (unsigned int n = 0; n < row_dpus; n++) {
+			for (unsigned int j = 0; j < dpu_info[n].rows_per_dpu; j++) {
+				unsigned int m = dpu_info[n].prev_rows_dpu + j;
+				Y[v * m_size + m] = (int32_t) C_dpu[(n * batch + v) * max_rows_per_dpu + j] * A_scales[m] * B_scales[v];
+			}
+		}
+	}
+}
+
+// Reference with dequantized weights and input vectors
+static void gemv_host_dequantized(double* Y, TA* A, TB* B, unsigned int m_size, unsigned int n_size, size_t a_row_bytes, unsigned int b_stride, unsigned int batch) {
+	for (unsigned int v = 0; v < batch; v++) {
+		for (unsigned int m = 0; m < m_size; m++) {
+			double acc = 0;
+			for (unsigned int n = 0; n < n_size; n++)
+			{
+				acc += (get_weight(A, a_row_bytes, m, n) * (double) A_scales[m]) * (B[v * b_stride + n] * (double) B_scales[v]);
+			}
+			Y[v * m_size + m] = acc;
+		}
+	}
+}
+#endif
+
+// New input vectors for every call (resident matrix)
+static void update_vector(TB* B, unsigned int n_size, unsigned int b_stride, unsigned int batch, unsigned int call) {
+	for (unsigned int v = 0; v < batch; v++)
+	{
+		for (unsigned int i = 0; i < n_size; i++)
 		{
-			C[m] += A[m * n_size + n] * B[n];
+			B[v * b_stride + i] = (TB) ((i + call + v) % 50);
 		}
 	}
 }
 
+// Copy input arguments and matrix (or its column slices) to the DPUs
+static void transfer_matrix(struct dpu_set_t dpu_set, dpu_arguments_t *input_args, uint32_t max_rows_per_dpu, size_t a_row_bytes, uint32_t n_cols_pad, unsigned int col_groups) {
+	struct dpu_set_t dpu;
+	unsigned int i = 0;
+	DPU_FOREACH(dpu_set, dpu, i) {
+		// Copy input arguments to DPU
+		input_args[i].max_rows = max_rows_per_dpu;
+
+		DPU_ASSERT(dpu_prepare_xfer(dpu, input_args + i));
+	}
+
+	DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(dpu_arguments_t), DPU_XFER_DEFAULT));
+
+	// Copy input array
+	if (col_groups > 1) {
+		slice_blocks_t blocks = {(uint8_t*) A, max_rows_per_dpu, a_row_bytes, A_BYTES(n_cols_pad), W_BITS, true};
+		get_block_t get_block_info = {.f = &get_slice_block, .args = &blocks, .args_size = sizeof(blocks)};
+		DPU_ASSERT(dpu_push_sg_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, max_rows_per_dpu * A_BYTES(n_cols_pad), &get_block_info, DPU_SG_XFER_DEFAULT));
+		return;
+	}
+	i = 0;
+	DPU_FOREACH(dpu_set, dpu, i) {
+		DPU_ASSERT(dpu_prepare_xfer(dpu, (uint8_t*) A + dpu_info[i].prev_rows_dpu * a_row_bytes));
+	}
+	DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, max_rows_per_dpu * A_BYTES(n_cols_pad), DPU_XFER_DEFAULT));
+}
+
+// Copy input vectors (or their column slices) to the DPUs
+static void transfer_vectors(struct dpu_set_t dpu_set, uint32_t max_rows_per_dpu, uint32_t n_cols_pad, uint32_t b_stride, unsigned int batch, unsigned int col_groups) {
+	if (col_groups > 1) {
+		slice_blocks_t blocks = {(uint8_t*) B, batch, B_BYTES(b_stride), B_BYTES(n_cols_pad), 8 * sizeof(TB), false};
+		get_block_t get_block_info = {.f = &get_slice_block, .args = &blocks, .args_size = sizeof(blocks)};
+		DPU_ASSERT(dpu_push_sg_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, max_rows_per_dpu * A_BYTES(n_cols_pad), batch * B_BYTES(n_cols_pad), &get_block_info, DPU_SG_XFER_DEFAULT));
+		return;
+	}
+	// The same for all DPUs
+	DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, max_rows_per_dpu * A_BYTES(n_cols_pad), B, batch * B_BYTES(n_cols_pad), DPU_XFER_DEFAULT));
+}
+
 // Main of the Host Application
 int main(int argc, char **argv) {
 
@@ -71,7 +231,7 @@ int main(int argc, char **argv) {
 	uint32_t nr_of_dpus;
 
 	// Allocate DPUs and load binary
-	DPU_ASSERT(dpu_alloc(NR_DPUS, NULL, &dpu_set));
+	DPU_ASSERT(dpu_alloc(NR_DPUS, "sgXferEnable=true", &dpu_set));
 	DPU_ASSERT(dpu_load(dpu_set, DPU_BINARY, NULL));
 	DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus));
 
@@ -83,33 +243,42 @@ int main(int argc, char **argv) {
 	unsigned int i;
 	unsigned int m_size = p.m_size;
 	unsigned int n_size = p.n_size;
+	unsigned int batch = p.batch;
+	unsigned int col_groups = p.col_groups;
 
 	// Initialize help data
 	dpu_info = (struct dpu_info_t *) malloc(nr_of_dpus * sizeof(struct dpu_info_t));
 	dpu_arguments_t *input_args = (dpu_arguments_t *) malloc(nr_of_dpus * sizeof(dpu_arguments_t));
 	uint32_t max_rows_per_dpu = 0;
-	uint32_t n_size_pad = n_size;
-	if(n_size % 2 == 1)
-	{
-		n_size_pad++;
-	}
+	uint32_t n_size_pad = (n_size + PAD_ELEMS - 1) / PAD_ELEMS * PAD_ELEMS; // 8-byte aligned
+
+	// 2D partitioning: rows are split across the DPUs of a group, columns across groups (DPU i is in group i / row_dpus)
+	// Every DPU holds n_cols_pad columns of A and B, the slices of B are padded with zeros up to col_groups * n_cols_pad
+	uint32_t row_dpus = nr_of_dpus / col_groups;
+	uint32_t n_cols_pad = n_size_pad;
+	if (col_groups > 1)
+		n_cols_pad = ((n_size + col_groups - 1) / col_groups + PAD_ELEMS - 1) / PAD_ELEMS * PAD_ELEMS; // 8-byte aligned rows
+	uint32_t b_stride = n_cols_pad * col_groups;
+	// Rows of A on the host: contiguous with INT32 weights, padded to 8 bytes with packed weights (so are they in MRAM)
+	size_t a_row_bytes = (W_BITS == 32) ? (size_t) n_size * sizeof(T) : A_BYTES((size_t) n_size_pad);
 
 	i = 0;
 	DPU_FOREACH(dpu_set, dpu, i) {
+		uint32_t r = i % row_dpus;
 		uint32_t rows_per_dpu;
 		uint32_t prev_rows_dpu = 0;
-		uint32_t chunks = m_size / nr_of_dpus;
+		uint32_t chunks = m_size / row_dpus;
 		rows_per_dpu = chunks;
-		uint32_t rest_rows = m_size % nr_of_dpus;
-		if (i < rest_rows)
+		uint32_t rest_rows = m_size % row_dpus;
+		if (r < rest_rows)
 			rows_per_dpu++;
 		if (rest_rows > 0) {
-			if (i >= rest_rows)
-				prev_rows_dpu = rest_rows * (chunks + 1) + (i - rest_rows) * chunks;
+			if (r >= rest_rows)
+				prev_rows_dpu = rest_rows * (chunks + 1) + (r - rest_rows) * chunks;
 			else
-				prev_rows_dpu = i * (chunks + 1);
+				prev_rows_dpu = r * (chunks + 1);
 		} else {
-			prev_rows_dpu = i * chunks;
+			prev_rows_dpu = r * chunks;
 		}
 
 		// Keep max rows for parallel transfers
@@ -122,54 +291,61 @@ int main(int argc, char **argv) {
 		dpu_info[i].rows_per_dpu = rows_per_dpu;
 		dpu_info[i].rows_per_dpu_pad = rows_per_dpu_pad;
 		dpu_info[i].prev_rows_dpu = prev_rows_dpu;
+		dpu_info[i].prev_cols_dpu = (i / row_dpus) * n_cols_pad;
 
 		// Copy input arguments to DPU
-		input_args[i].n_size = n_size;
-		input_args[i].n_size_pad = n_size_pad;
+		input_args[i].n_size = (col_groups > 1 || W_BITS < 32) ? n_cols_pad : n_size;
+		input_args[i].n_size_pad = n_cols_pad;
 		input_args[i].nr_rows = rows_per_dpu;
+		input_args[i].batch = batch;
 	}
 
-	A = malloc(max_rows_per_dpu * nr_of_dpus * n_size_pad * sizeof(T));
-	B = malloc(n_size_pad * sizeof(T));
-	C = malloc(max_rows_per_dpu * nr_of_dpus * sizeof(T));
+	// Matrix slice, input vectors and output vectors must fit in MRAM
+	assert((uint64_t) max_rows_per_dpu * A_BYTES(n_cols_pad) + (uint64_t) batch * (B_BYTES(n_cols_pad) + max_rows_per_dpu * sizeof(T)) <= DATA_MRAM && "Not enough MRAM, use more column groups (-c)!");
+
+	// The slices of the last column group may read past the last row
+	A = calloc((size_t) max_rows_per_dpu * row_dpus * A_BYTES(n_size_pad) + A_BYTES(b_stride), 1);
+	B = calloc(batch * b_stride, sizeof(TB));
+	C = malloc(batch * m_size * sizeof(T));
+#if W_BITS < 32
+	A_scales = malloc(m_size * sizeof(float));
+	B_scales = malloc(batch * sizeof(float));
+	Y = malloc(batch * m_size * sizeof(float));
+	Y_host = malloc(batch * m_size * sizeof(double));
+#endif
 
 	// Initialize data with arbitrary data
-	init_data(A, B, m_size, n_size);
+	init_data(A, B, m_size, n_size, a_row_bytes, b_stride, batch);
 
 	// Timer
 	Timer timer;
 
 	// Compute output on CPU (performance comparison and verification purposes)
 	start(&timer, 0, 0);
-	gemv_host(C, A, B, m_size, n_size);
+	gemv_host(C, A, B, m_size, n_size, a_row_bytes, b_stride, batch);
 	stop(&timer, 0);
-	for (unsigned int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
 
+	// Resident matrix: input arguments and matrix are transferred once, before all calls
+	if (p.resident) {
+		start(&timer, 4, 0);
+		transfer_matrix(dpu_set, input_args, max_rows_per_dpu, a_row_bytes, n_cols_pad, col_groups);
+		stop(&timer, 4);
+	}
+
+	C_dpu = malloc(batch * max_rows_per_dpu * nr_of_dpus * sizeof(T));
+	for (unsigned int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
 
+		if (p.resident)
+			update_vector(B, n_size, b_stride, batch, rep);
 
 		if (rep >= p.n_warmup)
 			start(&timer, 1, rep - p.n_warmup);
-		// Input arguments
-		i = 0;
-		DPU_FOREACH(dpu_set, dpu, i) {
-			// Copy input arguments to DPU
-			input_args[i].max_rows = max_rows_per_dpu;
+		// Input arguments and array
+		if (!p.resident)
+			transfer_matrix(dpu_set, input_args, max_rows_per_dpu, a_row_bytes, n_cols_pad, col_groups);
 
-			DPU_ASSERT(dpu_prepare_xfer(dpu, input_args + i));
-		}
-
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(dpu_arguments_t), DPU_XFER_DEFAULT));
-
-		// Copy input array and vector
-		i = 0;
-		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, A + dpu_info[i].prev_rows_dpu * n_size));
-		}
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, max_rows_per_dpu * n_size_pad * sizeof(T), DPU_XFER_DEFAULT));
-		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, B));
-		}
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, max_rows_per_dpu * n_size_pad * sizeof(T) , n_size_pad * sizeof(T), DPU_XFER_DEFAULT));
+		// Copy input vectors
+		transfer_vectors(dpu_set, max_rows_per_dpu, n_cols_pad, b_stride, batch, col_groups);
 
 		if (rep >= p.n_warmup)
 			stop(&timer, 1);
@@ -199,15 +375,20 @@ int main(int argc, char **argv) {
 		}
 #endif
 
-		// Retrieve results
-		C_dpu = malloc(max_rows_per_dpu * nr_of_dpus * sizeof(T));
+		// Retrieve results (one output vector of max_rows_per_dpu elements per input vector)
 		if (rep >= p.n_warmup)
 			start(&timer, 3, rep - p.n_warmup);
 		i = 0;
 		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, C_dpu + i * max_rows_per_dpu));
+			DPU_ASSERT(dpu_prepare_xfer(dpu, C_dpu + i * batch * max_rows_per_dpu));
 		}
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, max_rows_per_dpu * n_size_pad * sizeof(T) + n_size_pad * sizeof(T), max_rows_per_dpu * sizeof(T), DPU_XFER_DEFAULT));
+		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, max_rows_per_dpu * A_BYTES(n_cols_pad) + batch * B_BYTES(n_cols_pad), batch * max_rows_per_dpu * sizeof(T), DPU_XFER_DEFAULT));
+		// Add the partial results of the column groups into the first one
+		if (col_groups > 1)
+			merge_partials(C_dpu, C_dpu, col_groups, (size_t) row_dpus * batch * max_rows_per_dpu, (size_t) row_dpus * batch * max_rows_per_dpu);
+#if W_BITS < 32
+		dequantize(Y, C_dpu, m_size, row_dpus, max_rows_per_dpu, batch);
+#endif
 		if(rep >= p.n_warmup)
 			stop(&timer, 3);
 	}
@@ -228,24 +409,40 @@ int main(int argc, char **argv) {
 	print(&timer, 2, p.n_reps);
 	printf("DPU-CPU Time (ms): ");
 	print(&timer, 3, p.n_reps);
+	if (p.resident) {
+		printf("CPU-DPU Matrix (once) Time (ms): ");
+		print(&timer, 4, 1);
+	}
 
 #if ENERGY
 	printf("Energy (J): %f J\t", avg_energy);
 #endif
 
-	// Check output
+	// Check output (of the last call, with a resident matrix)
+	if (p.resident)
+		gemv_host(C, A, B, m_size, n_size, a_row_bytes, b_stride, batch);
+#if W_BITS < 32
+	gemv_host_dequantized(Y_host, A, B, m_size, n_size, a_row_bytes, b_stride, batch);
+#endif
 	bool status = true;
 	unsigned int n,j;
-	i = 0;
-	for (n = 0; n < nr_of_dpus; n++) {
-		for (j = 0; j < dpu_info[n].rows_per_dpu; j++) {
-			if(C[i] != C_dpu[n * max_rows_per_dpu + j]) {
-				status = false;
+	for (unsigned int v = 0; v < batch; v++) {
+		i = 0;
+		for (n = 0; n < row_dpus; n++) {
+			for (j = 0; j < dpu_info[n].rows_per_dpu; j++) {
+				if(C[v * m_size + i] != C_dpu[(n * batch + v) * max_rows_per_dpu + j]) {
+					status = false;
 #if PRINT
-	//			printf("%d: %d -- %d\n", i, C[i], C_dpu[n * max_rows_per_dpu + j]);
+	//				printf("%d: %d -- %d\n", i, C[v * m_size + i], C_dpu[(n * batch + v) * max_rows_per_dpu + j]);
 #endif
+				}
+#if W_BITS < 32
+				// Dequantized outputs, up to float rounding (or a small fraction of the quantization step, for outputs near 0)
+				if(fabs(Y[v * m_size + i] - Y_host[v * m_size + i]) > 1e-5 * fabs(Y_host[v * m_size + i]) + 1e-3 * A_scales[i] * B_scales[v])
+					status = false;
+#endif
+				i++;
 			}
-			i++;
 		}
 	}
 	if (status) {
@@ -259,6 +456,12 @@ int main(int argc, char **argv) {
 	free(B);
 	free(C);
 	free(C_dpu);
+#if W_BITS < 32
+	free(A_scales);
+	free(B_scales);
+	free(Y);
+	free(Y_host);
+#endif
 	DPU_ASSERT(dpu_free(dpu_set));
 
 #if ENERGY
@@ -7,6 +7,7 @@ typedef struct {
     uint32_t n_size_pad;
     uint32_t nr_rows;
     uint32_t max_rows;
+    uint32_t batch;
 } dpu_arguments_t;
 
 // Specific information for each DPU
@@ -14,6 +15,7 @@ struct dpu_info_t {
     uint32_t rows_per_dpu;
     uint32_t rows_per_dpu_pad;
     uint32_t prev_rows_dpu;
+    uint32_t prev_cols_dpu; // First column of the slice of A and B (column groups)
 };
 struct dpu_info_t *dpu_info;
 
@@ -27,8 +29,46 @@ struct dpu_info_t *dpu_info;
 #define BL BLOCK_SIZE_LOG2
 #endif
 
-// Data type
+// Weight format: INT32 (default), or INT8/INT4 packed in 32-bit words with per-row scales (INT8 input vectors)
+#if defined(INT8)
+#define W_BITS 8
+#elif defined(INT4)
+#define W_BITS 4
+#else
+#define W_BITS 32
+#endif
+#define PAD_ELEMS (64 / W_BITS) // Elements of A per 8 bytes
+
+// Bytes of n elements of A and B (quantized formats: n multiple of PAD_ELEMS)
+#if W_BITS == 32
+#define A_BYTES(n) ((n) * sizeof(T))
+#define B_BYTES(n) ((n) * sizeof(T))
+#define A_BLOCK_SIZE BLOCK_SIZE
+#else
+#define A_BYTES(n) ((n) / (8 / W_BITS))
+#define B_BYTES(n) (n)
+#define A_BLOCK_SIZE A_BYTES(BLOCK_SIZE) // Bytes of A per block of BLOCK_SIZE bytes of B
+#endif
+
+// WRAM heap for the caches of all tasklets (what is left after the stacks): one block of A, one block of B
+// (the input vectors are streamed through it) and 8 bytes of C per input vector
+#ifndef GEMV_WRAM
+#define GEMV_WRAM (40 << 10)
+#endif
+#define MAX_BATCH ((GEMV_WRAM / NR_TASKLETS - A_BLOCK_SIZE - BLOCK_SIZE - 16) / 8)
+
+// MRAM for the matrix, input vectors and output vectors of a DPU
+#define DATA_MRAM (63 << 20)
+
+// Data type (of the outputs, and of A and B with INT32 weights)
 #define T uint32_t
+#if W_BITS == 32
+#define TA T
+#define TB T
+#else
+#define TA uint8_t // Packed weights
+#define TB int8_t
+#endif
 
 #ifndef ENERGY
 #define ENERGY 0
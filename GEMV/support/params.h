@@ -8,6 +8,9 @@ typedef struct Params {
     unsigned int  n_size;
     unsigned int  n_warmup;
     unsigned int  n_reps;
+    unsigned int  resident;
+    unsigned int  batch;
+    unsigned int  col_groups;
 }Params;
 
 static void usage() {
@@ -22,6 +25,9 @@ static void usage() {
             "\nBenchmark-specific options:"
             "\n    -m <I>    m_size (default=8192 elements)"
             "\n    -n <I>    n_size (default=8192 elements)"
+            "\n    -b <B>    # of input vectors multiplied by A at once (default=1, bounded by WRAM)"
+            "\n    -c <C>    # of column groups: the DPUs are split in C groups, each one gets a slice of the columns of A and B (default=1)"
+            "\n    -r        resident matrix: A is transferred once, every repetition only broadcasts a new B"
             "\n");
 }
 
@@ -31,9 +37,12 @@ struct Params input_params(int argc, char **argv) {
     p.n_size        = 8192;
     p.n_warmup      = 1;
     p.n_reps        = 3;
+    p.resident      = 0;
+    p.batch         = 1;
+    p.col_groups    = 1;
 
     int opt;
-    while((opt = getopt(argc, argv, "hm:n:w:e:")) >= 0) {
+    while((opt = getopt(argc, argv, "hm:n:w:e:b:c:r")) >= 0) {
         switch(opt) {
             case 'h':
                 usage();
@@ -43,6 +52,9 @@ struct Params input_params(int argc, char **argv) {
             case 'n': p.n_size        = atoi(optarg); break;
             case 'w': p.n_warmup      = atoi(optarg); break;
             case 'e': p.n_reps        = atoi(optarg); break;
+            case 'b': p.batch         = atoi(optarg); break;
+            case 'c': p.col_groups    = atoi(optarg); break;
+            case 'r': p.resident      = 1; break;
             default:
                       fprintf(stderr, "\nUnrecognized option!\n");
                       usage();
@@ -50,6 +62,8 @@ struct Params input_params(int argc, char **argv) {
         }
     }
     assert(NR_DPUS > 0 && "Invalid # of dpus!");
+    assert(p.batch > 0 && p.batch <= MAX_BATCH && "Invalid batch size (WRAM)!");
+    assert(p.col_groups > 0 && NR_DPUS % p.col_groups == 0 && "# of column groups must divide # of dpus!");
 
     return p;
 }
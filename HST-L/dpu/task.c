@@ -9,33 +9,85 @@
 #include <alloc.h>
 #include <perfcounter.h>
 #include <barrier.h>
-#include <atomic_bit.h>
-#include <mutex.h>
+#include <mutex_pool.h>
 
 #include "../support/common.h"
 
 __host dpu_arguments_t DPU_INPUT_ARGUMENTS;
+// Bin boundaries (non-uniform bins)
+__host T DPU_BOUNDS[BOUNDS_MAX];
 
-// Array for communication between adjacent tasklets
-uint32_t* message[NR_TASKLETS];
-// DPU histogram
-uint32_t* histo_dpu;
+// Histograms in WRAM (histo_copies() of them, histo_window() bins each)
+uint32_t* histo_wram;
 
 // Barrier
 BARRIER_INIT(my_barrier, NR_TASKLETS);
-ATOMIC_BIT_INIT(barriers_mutexes)[NR_HISTO];
-barrier_t barriers[NR_HISTO];
 
-// Mutex
-mutex_id_t my_mutex[NR_HISTO];
+// Striped locks for shared histograms
+MUTEX_POOL_INIT(bin_mutexes, NR_LOCKS);
 
-// Histogram in each tasklet
-static void histogram(uint32_t* histo, uint32_t bins, T *input, uint32_t histo_id, unsigned int l_size){
+// Bins of the pixels of a block, in place: one per pixel, or one per pair of pixels for joint histograms
+// Returns the number of bins
+static unsigned int block_bins(T *input, unsigned int l_size, uint32_t bins_axis, uint32_t nr_bounds, uint32_t joint){
+    if(joint) {
+        for(unsigned int j = 0; j < (l_size >> 1); j++) {
+            input[j] = axis_bin(input[j << 1], bins_axis, DPU_BOUNDS, nr_bounds) * bins_axis + axis_bin(input[(j << 1) + 1], bins_axis, DPU_BOUNDS, nr_bounds);
+        }
+        return l_size >> 1;
+    }
+    for(unsigned int j = 0; j < l_size; j++) {
+        input[j] = axis_bin(input[j], bins_axis, DPU_BOUNDS, nr_bounds);
+    }
+    return l_size;
+}
+
+// Histogram in each tasklet, private histogram
+static void histogram_private(uint32_t* histo, T *input, unsigned int l_size){
+    for(unsigned int j = 0; j < l_size; j++) {
+        histo[input[j]] += 1;
+    }
+}
+
+// Histogram in each tasklet, histogram shared by several tasklets. Only bins in [lo, lo + window) are counted
+static void histogram_shared(uint32_t* histo, uint32_t lo, uint32_t window, T *input, unsigned int l_size){
     for(unsigned int j = 0; j < l_size; j++) {
-        T d = (input[j] * bins) >> DEPTH;
-        mutex_lock(my_mutex[histo_id]);
-        histo[d] += 1;
-        mutex_unlock(my_mutex[histo_id]);
+        T d = input[j] - lo;
+        if(d < window) {
+            mutex_pool_lock(&bin_mutexes, d);
+            histo[d] += 1;
+            mutex_pool_unlock(&bin_mutexes, d);
+        }
+    }
+}
+
+// Add a line of the write-back cache (2 bins) to the histogram in MRAM
+static void flush_line(uint32_t mram_histo_addr, uint32_t pair, uint32_t *line){
+    uint32_t mram_line[2] __dma_aligned;
+    mutex_pool_lock(&bin_mutexes, pair);
+    mram_read((const __mram_ptr void*)(mram_histo_addr + (pair << 3)), mram_line, 8);
+    mram_line[0] += line[0];
+    mram_line[1] += line[1];
+    mram_write(mram_line, (__mram_ptr void*)(mram_histo_addr + (pair << 3)), 8);
+    mutex_pool_unlock(&bin_mutexes, pair);
+}
+
+// Histogram in each tasklet, histogram in MRAM. Only bins in [lo, lo + nr) are counted
+// Counts are aggregated in a direct-mapped cache (tags hold the pair of bins + 1, 0 if empty) and added to MRAM on eviction
+static void histogram_mram(uint32_t mram_histo_addr, uint32_t *tags, uint32_t *counts, uint32_t lines, uint32_t lo, uint32_t nr, T *input, unsigned int l_size){
+    for(unsigned int j = 0; j < l_size; j++) {
+        T d = input[j] - lo;
+        if(d < nr) {
+            uint32_t pair = d >> 1;
+            uint32_t line = pair & (lines - 1);
+            if(tags[line] != pair + 1) {
+                if(tags[line] != 0)
+                    flush_line(mram_histo_addr, tags[line] - 1, &counts[line << 1]);
+                tags[line] = pair + 1;
+                counts[line << 1] = 0;
+                counts[(line << 1) + 1] = 0;
+            }
+            counts[(line << 1) + (d & 1)] += 1;
+        }
     }
 }
 
@@ -43,9 +95,9 @@ extern int main_kernel1(void);
 
 int (*kernels[nr_kernels])(void) = {main_kernel1};
 
-int main(void) { 
+int main(void) {
     // Kernel
-    return kernels[DPU_INPUT_ARGUMENTS.kernel](); 
+    return kernels[DPU_INPUT_ARGUMENTS.kernel]();
 }
 
 // main_kernel1
@@ -54,27 +106,26 @@ int main_kernel1() {
 #if PRINT
     printf("tasklet_id = %u\n", tasklet_id);
 #endif
-    unsigned int l_tasklet_id = tasklet_id / NR_HISTO;
-    unsigned int nr_l_tasklet = NR_TASKLETS / NR_HISTO;
-    unsigned int my_histo_id = tasklet_id & (NR_HISTO - 1);
+    uint32_t input_size_dpu_bytes = DPU_INPUT_ARGUMENTS.size;
+    uint32_t input_size_dpu_bytes_transfer = DPU_INPUT_ARGUMENTS.transfer_size; // Transfer input size per DPU in bytes
+    uint32_t bins = DPU_INPUT_ARGUMENTS.bins;
+    uint32_t bins_axis = DPU_INPUT_ARGUMENTS.bins_axis;
+    uint32_t nr_bounds = DPU_INPUT_ARGUMENTS.nr_bounds;
+    uint32_t joint = DPU_INPUT_ARGUMENTS.joint;
+    uint32_t bins_lo = DPU_INPUT_ARGUMENTS.bins_lo;
+    uint32_t bins_nr = DPU_INPUT_ARGUMENTS.bins_nr;
+    enum strategies strategy = DPU_INPUT_ARGUMENTS.strategy;
+    uint32_t copies = histo_copies(bins, strategy);
+    uint32_t window = histo_window(bins, strategy);
 
     if (tasklet_id == 0){ // Initialize once the cycle counter
         mem_reset(); // Reset the heap
-        // Initialize barriers
-        for (unsigned int each_barrier = 0; each_barrier < NR_HISTO; each_barrier++) {
-            barriers[each_barrier].wait_queue = 0xff;
-            barriers[each_barrier].count = nr_l_tasklet;
-            barriers[each_barrier].initial_count = nr_l_tasklet;
-            barriers[each_barrier].lock = (uint8_t) &ATOMIC_BIT_GET(barriers_mutexes)[each_barrier];
-        }
+        if(strategy != mram_histo)
+            histo_wram = (uint32_t *) mem_alloc(copies * window * sizeof(uint32_t));
     }
     // Barrier
     barrier_wait(&my_barrier);
 
-    uint32_t input_size_dpu_bytes = DPU_INPUT_ARGUMENTS.size;
-    uint32_t input_size_dpu_bytes_transfer = DPU_INPUT_ARGUMENTS.transfer_size; // Transfer input size per DPU in bytes
-    uint32_t bins = DPU_INPUT_ARGUMENTS.bins;
-
     // Address of the current processing block in MRAM
     uint32_t base_tasklet = tasklet_id << BLOCK_SIZE_LOG2;
     uint32_t mram_base_addr_A = (uint32_t)DPU_MRAM_HEAP_POINTER;
@@ -82,60 +133,106 @@ int main_kernel1() {
 
     // Initialize a local cache to store the MRAM block
     T *cache_A = (T *) mem_alloc(BLOCK_SIZE);
-	
-    // Local histogram
-    if (tasklet_id < NR_HISTO){ // Allocate DPU histogram
-        uint32_t *histo = (uint32_t *) mem_alloc(bins * sizeof(uint32_t));
-        message[tasklet_id] = histo;
-    }
-    // Barrier
-    barrier_wait(&barriers[my_histo_id]);
 
-    uint32_t *my_histo = message[my_histo_id];
+    if(strategy == mram_histo){
+        // Write-back cache of the MRAM histogram, as many lines of 2 bins as fit in the share of WRAM of this tasklet
+        uint32_t lines = 1;
+        while((lines << 1) * 3 * sizeof(uint32_t) <= HISTO_WRAM / NR_TASKLETS)
+            lines <<= 1;
+        uint32_t *counts = (uint32_t *) mem_alloc(lines * 2 * sizeof(uint32_t));
+        uint32_t *tags = (uint32_t *) mem_alloc(lines * sizeof(uint32_t));
+        for(unsigned int i = 0; i < lines; i++){
+            tags[i] = 0;
+            counts[i << 1] = 0;
+            counts[(i << 1) + 1] = 0;
+        }
 
-    // Initialize local histogram
-    for(unsigned int i = l_tasklet_id; i < bins; i += nr_l_tasklet){
-        my_histo[i] = 0;
-    }
-    // Barrier
-    barrier_wait(&barriers[my_histo_id]);
+        // Initialize MRAM histogram
+        uint32_t zero_bytes = (lines * 2 * sizeof(uint32_t) < 2048) ? lines * 2 * sizeof(uint32_t) : 2048;
+        for(unsigned int offset = tasklet_id * zero_bytes; offset < bins_nr * sizeof(uint32_t); offset += NR_TASKLETS * zero_bytes){
+            uint32_t l_size_bytes = (offset + zero_bytes >= bins_nr * sizeof(uint32_t)) ? (bins_nr * sizeof(uint32_t) - offset) : zero_bytes;
+            mram_write(counts, (__mram_ptr void*)(mram_base_addr_histo + offset), l_size_bytes);
+        }
+        // Barrier
+        barrier_wait(&my_barrier);
 
-    // Compute histogram
-    for(unsigned int byte_index = base_tasklet; byte_index < input_size_dpu_bytes; byte_index += BLOCK_SIZE * NR_TASKLETS){
+        // Compute histogram
+        for(unsigned int byte_index = base_tasklet; byte_index < input_size_dpu_bytes; byte_index += BLOCK_SIZE * NR_TASKLETS){
 
-        // Bound checking
-        uint32_t l_size_bytes = (byte_index + BLOCK_SIZE >= input_size_dpu_bytes) ? (input_size_dpu_bytes - byte_index) : BLOCK_SIZE;
+            // Bound checking
+            uint32_t l_size_bytes = (byte_index + BLOCK_SIZE >= input_size_dpu_bytes) ? (input_size_dpu_bytes - byte_index) : BLOCK_SIZE;
 
-        // Load cache with current MRAM block
-        mram_read((const __mram_ptr void*)(mram_base_addr_A + byte_index), cache_A, l_size_bytes);
+            // Load cache with current MRAM block
+            mram_read((const __mram_ptr void*)(mram_base_addr_A + byte_index), cache_A, l_size_bytes);
 
-        // Histogram in each tasklet
-        histogram(my_histo, bins, cache_A, my_histo_id, l_size_bytes >> DIV);
+            // Histogram in each tasklet
+            unsigned int l_bins = block_bins(cache_A, l_size_bytes >> DIV, bins_axis, nr_bounds, joint);
+            histogram_mram(mram_base_addr_histo, tags, counts, lines, bins_lo, bins_nr, cache_A, l_bins);
+        }
+
+        // Flush the cache
+        for(unsigned int i = 0; i < lines; i++){
+            if(tags[i] != 0)
+                flush_line(mram_base_addr_histo, tags[i] - 1, &counts[i << 1]);
+        }
+
+        return 0;
     }
 
-    // Barrier
-    barrier_wait(&my_barrier);
+    // Histogram of this tasklet
+    uint32_t *my_histo = histo_wram + (tasklet_id % copies) * window;
+
+    // One pass over the input per range of bins (a single one unless histograms are windowed)
+    for(uint32_t lo = bins_lo; lo < bins_lo + bins_nr; lo += window){
+        uint32_t l_window = (lo + window > bins_lo + bins_nr) ? (bins_lo + bins_nr - lo) : window;
 
-    uint32_t *histo_dpu = message[0];
-    for (unsigned int i = tasklet_id; i < bins; i += NR_TASKLETS){
-        uint32_t b = 0;
-        for (unsigned int j = 0; j < NR_HISTO; j++){			
-            b += *(message[j] + i);
+        // Initialize local histograms
+        for(unsigned int i = tasklet_id; i < copies * window; i += NR_TASKLETS){
+            histo_wram[i] = 0;
         }
-        histo_dpu[i] = b;
-    }
+        // Barrier
+        barrier_wait(&my_barrier);
 
-    // Barrier
-    barrier_wait(&my_barrier);
+        // Compute histogram
+        for(unsigned int byte_index = base_tasklet; byte_index < input_size_dpu_bytes; byte_index += BLOCK_SIZE * NR_TASKLETS){
+
+            // Bound checking
+            uint32_t l_size_bytes = (byte_index + BLOCK_SIZE >= input_size_dpu_bytes) ? (input_size_dpu_bytes - byte_index) : BLOCK_SIZE;
+
+            // Load cache with current MRAM block
+            mram_read((const __mram_ptr void*)(mram_base_addr_A + byte_index), cache_A, l_size_bytes);
+
+            // Histogram in each tasklet
+            unsigned int l_bins = block_bins(cache_A, l_size_bytes >> DIV, bins_axis, nr_bounds, joint);
+            if(strategy == private_histo)
+                histogram_private(my_histo, cache_A, l_bins);
+            else
+                histogram_shared(my_histo, lo, l_window, cache_A, l_bins);
+        }
 
-    // Write dpu histogram to current MRAM block
-    if(tasklet_id == 0){
-        if(bins * sizeof(uint32_t) <= 2048)
-            mram_write(histo_dpu, (__mram_ptr void*)(mram_base_addr_histo), bins * sizeof(uint32_t));
-        else 
-            for(unsigned int offset = 0; offset < ((bins * sizeof(uint32_t)) >> 11); offset++){
-    	        mram_write(histo_dpu + (offset << 9), (__mram_ptr void*)(mram_base_addr_histo + (offset << 11)), 2048);
+        // Barrier
+        barrier_wait(&my_barrier);
+
+        // Merge histograms into the first one
+        for (unsigned int i = tasklet_id; i < l_window; i += NR_TASKLETS){
+            uint32_t b = 0;
+            for (unsigned int j = 0; j < copies; j++){
+                b += histo_wram[j * window + i];
             }
+            histo_wram[i] = b;
+        }
+
+        // Barrier
+        barrier_wait(&my_barrier);
+
+        // Write dpu histogram to current MRAM block
+        for(unsigned int offset = tasklet_id << 11; offset < l_window * sizeof(uint32_t); offset += NR_TASKLETS << 11){
+            uint32_t l_size_bytes = (offset + 2048 >= l_window * sizeof(uint32_t)) ? (l_window * sizeof(uint32_t) - offset) : 2048;
+            mram_write(histo_wram + (offset >> 2), (__mram_ptr void*)(mram_base_addr_histo + (lo - bins_lo) * sizeof(uint32_t) + offset), l_size_bytes);
+        }
+
+        // Barrier
+        barrier_wait(&my_barrier);
     }
 
     return 0;
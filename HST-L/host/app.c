@@ -17,6 +17,7 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -31,6 +32,7 @@
 static T* A;
 static unsigned int* histo_host;
 static unsigned int* histo;
+static unsigned int* histo_dpus;
 
 // Create input arrays
 static void read_input(T* A, const Params p) {
@@ -49,6 +51,10 @@ static void read_input(T* A, const Params p) {
                 A[y] = 4095;
         }
         fclose(File);
+        // Deeper pixels: low bits from the next pixel
+        for(unsigned int y = 0; DEPTH > 12 && y < p.input_size; y++) {
+            A[y] = (A[y] << (DEPTH - 12)) | (A[(y + 1) % p.input_size] & ((1 << (DEPTH - 12)) - 1));
+        }
     } else {
         printf("%s does not exist\n", dctFileName);
         exit(1);
@@ -56,19 +62,15 @@ static void read_input(T* A, const Params p) {
 }
 
 // Compute output in the host
-static void histogram_host(unsigned int* histo, T* A, unsigned int bins, unsigned int nr_elements, int exp, unsigned int nr_of_dpus) {
-    if(!exp){
-        for (unsigned int i = 0; i < nr_of_dpus; i++) {
-            for (unsigned int j = 0; j < nr_elements; j++) {
-                T d = A[j];
-                histo[i * bins + ((d * bins) >> DEPTH)] += 1;
-            }
+static void histogram_host(unsigned int* histo, T* A, const Params p, unsigned int nr_elements) {
+    if(p.joint){
+        for (unsigned int j = 0; j < nr_elements; j += 2) {
+            histo[axis_bin(A[j], p.bins_axis, p.bounds, p.nr_bounds) * p.bins_axis + axis_bin(A[j + 1], p.bins_axis, p.bounds, p.nr_bounds)] += 1;
         }
     }
     else{
         for (unsigned int j = 0; j < nr_elements; j++) {
-            T d = A[j];
-            histo[(d * bins) >> DEPTH] += 1;
+            histo[axis_bin(A[j], p.bins_axis, p.bounds, p.nr_bounds)] += 1;
         }
     }
 }
@@ -112,7 +114,13 @@ int main(int argc, char **argv) {
     A = malloc(input_size_dpu_8bytes * nr_of_dpus * sizeof(T));
     T *bufferA = A;
     histo_host = malloc(p.bins * sizeof(unsigned int));
-    histo = malloc(nr_of_dpus * p.bins * sizeof(unsigned int));
+    histo = malloc(bins_8bytes(p.bins) * sizeof(unsigned int));
+    // Bins per launch: as many as fit in MRAM after the input, in whole 2048-byte blocks
+    assert(input_size_dpu_8bytes * sizeof(T) + 2048 <= HISTO_MRAM && "Input does not fit in MRAM!");
+    unsigned int bins_dpu = ((HISTO_MRAM - input_size_dpu_8bytes * sizeof(T)) / sizeof(unsigned int)) & ~511;
+    if(bins_dpu > bins_8bytes(p.bins))
+        bins_dpu = bins_8bytes(p.bins);
+    histo_dpus = malloc(nr_of_dpus * bins_dpu * sizeof(unsigned int));
 
     // Create an input file with arbitrary data
     read_input(A, p);
@@ -128,18 +136,29 @@ int main(int argc, char **argv) {
 
     // Timer declaration
     Timer timer;
+    for(int j = 0; j < 7; j++)
+        init(&timer, j);
 
     printf("NR_TASKLETS\t%d\tBL\t%d\tinput_size\t%u\n", NR_TASKLETS, BL, input_size);
+    if(p.joint)
+        printf("Bins\t%u x %u\t%s\n", p.bins_axis, p.bins_axis, p.nr_bounds ? "non-uniform" : "uniform");
+    else
+        printf("Bins\t%u\t%s\n", p.bins_axis, p.nr_bounds ? "non-uniform" : "uniform");
+    if(p.strategy == mram_histo)
+        printf("Histograms\tMRAM\tbins per launch\t%u\n", bins_dpu);
+    else
+        printf("Histograms\t%s\tcopies\t%u\tbins per pass\t%u\tbins per launch\t%u\n", p.strategy == private_histo ? "private" : p.strategy == shared_histo ? "shared" : "windowed",
+            histo_copies(p.bins, p.strategy), histo_window(p.bins, p.strategy), bins_dpu);
 
     // Loop over main kernel
     for(int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
         memset(histo_host, 0, p.bins * sizeof(unsigned int));
-        memset(histo, 0, nr_of_dpus * p.bins * sizeof(unsigned int));
+        memset(histo, 0, bins_8bytes(p.bins) * sizeof(unsigned int));
 
         // Compute output on CPU (performance comparison and verification purposes)
         if(rep >= p.n_warmup)
             start(&timer, 0, rep - p.n_warmup);
-        histogram_host(histo_host, A, p.bins, p.input_size, 1, nr_of_dpus);
+        histogram_host(histo_host, A, p, p.input_size);
         if(rep >= p.n_warmup)
             stop(&timer, 0);
 
@@ -154,72 +173,90 @@ int main(int argc, char **argv) {
 	        input_arguments[i].size=input_size_dpu_8bytes * sizeof(T); 
 	        input_arguments[i].transfer_size=input_size_dpu_8bytes * sizeof(T); 
 	        input_arguments[i].bins=p.bins;
+	        input_arguments[i].bins_axis=p.bins_axis;
+	        input_arguments[i].nr_bounds=p.nr_bounds;
+	        input_arguments[i].joint=p.joint;
+	        input_arguments[i].strategy=p.strategy;
 	        input_arguments[i].kernel=kernel;
 	    }
 	    input_arguments[nr_of_dpus-1].size=(input_size_8bytes - input_size_dpu_8bytes * (NR_DPUS-1)) * sizeof(T); 
 	    input_arguments[nr_of_dpus-1].transfer_size=input_size_dpu_8bytes * sizeof(T); 
 	    input_arguments[nr_of_dpus-1].bins=p.bins;
+	    input_arguments[nr_of_dpus-1].bins_axis=p.bins_axis;
+	    input_arguments[nr_of_dpus-1].nr_bounds=p.nr_bounds;
+	    input_arguments[nr_of_dpus-1].joint=p.joint;
+	    input_arguments[nr_of_dpus-1].strategy=p.strategy;
 	    input_arguments[nr_of_dpus-1].kernel=kernel;
 
         // Copy input arrays
         i = 0;
-        DPU_FOREACH(dpu_set, dpu, i) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, &input_arguments[i]));
-        }
-        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_arguments[0]), DPU_XFER_DEFAULT));
         DPU_FOREACH(dpu_set, dpu, i) {
             DPU_ASSERT(dpu_prepare_xfer(dpu, bufferA + input_size_dpu_8bytes * i));
         }
         DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, input_size_dpu_8bytes * sizeof(T), DPU_XFER_DEFAULT));
+        if(p.nr_bounds)
+            DPU_ASSERT(dpu_broadcast_to(dpu_set, "DPU_BOUNDS", 0, p.bounds, p.nr_bounds * sizeof(T), DPU_XFER_DEFAULT));
         if(rep >= p.n_warmup)
             stop(&timer, 1);
 
-        printf("Run program on DPU(s) \n");
-        // Run DPU kernel
-        if(rep >= p.n_warmup) {
-            start(&timer, 2, rep - p.n_warmup);
-            #if ENERGY
-            DPU_ASSERT(dpu_probe_start(&probe));
-            #endif
-        }
-        DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
-        if(rep >= p.n_warmup) {
-            stop(&timer, 2);
-            #if ENERGY
-            DPU_ASSERT(dpu_probe_stop(&probe));
-            #endif
-        }
+        // One launch per range of bins that fits in MRAM
+        for(unsigned int bins_lo = 0; bins_lo < bins_8bytes(p.bins); bins_lo += bins_dpu) {
+            unsigned int bins_nr = (bins_lo + bins_dpu > bins_8bytes(p.bins)) ? (bins_8bytes(p.bins) - bins_lo) : bins_dpu;
+
+            if(rep >= p.n_warmup)
+                start(&timer, 1, rep - p.n_warmup);
+            DPU_FOREACH(dpu_set, dpu, i) {
+                input_arguments[i].bins_lo = bins_lo;
+                input_arguments[i].bins_nr = bins_nr;
+                DPU_ASSERT(dpu_prepare_xfer(dpu, &input_arguments[i]));
+            }
+            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_arguments[0]), DPU_XFER_DEFAULT));
+            if(rep >= p.n_warmup)
+                stop(&timer, 1);
+
+            printf("Run program on DPU(s) \n");
+            // Run DPU kernel
+            if(rep >= p.n_warmup) {
+                start(&timer, 2, rep - p.n_warmup);
+                #if ENERGY
+                DPU_ASSERT(dpu_probe_start(&probe));
+                #endif
+            }
+            DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+            if(rep >= p.n_warmup) {
+                stop(&timer, 2);
+                #if ENERGY
+                DPU_ASSERT(dpu_probe_stop(&probe));
+                #endif
+            }
 
 #if PRINT
-        {
-            unsigned int each_dpu = 0;
-            printf("Display DPU Logs\n");
-            DPU_FOREACH (dpu_set, dpu) {
-                printf("DPU#%d:\n", each_dpu);
-                DPU_ASSERT(dpulog_read_for_dpu(dpu.dpu, stdout));
-                each_dpu++;
+            {
+                unsigned int each_dpu = 0;
+                printf("Display DPU Logs\n");
+                DPU_FOREACH (dpu_set, dpu) {
+                    printf("DPU#%d:\n", each_dpu);
+                    DPU_ASSERT(dpulog_read_for_dpu(dpu.dpu, stdout));
+                    each_dpu++;
+                }
             }
-        }
 #endif
 
-        printf("Retrieve results\n");
-        i = 0;
-        if(rep >= p.n_warmup)
-            start(&timer, 3, rep - p.n_warmup);
-        // PARALLEL RETRIEVE TRANSFER
-        DPU_FOREACH(dpu_set, dpu, i) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, histo + p.bins * i));
+            printf("Retrieve results\n");
+            i = 0;
+            if(rep >= p.n_warmup)
+                start(&timer, 3, rep - p.n_warmup);
+            // PARALLEL RETRIEVE TRANSFER
+            DPU_FOREACH(dpu_set, dpu, i) {
+                DPU_ASSERT(dpu_prepare_xfer(dpu, histo_dpus + bins_dpu * i));
+            }
+            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, input_size_dpu_8bytes * sizeof(T), bins_nr * sizeof(unsigned int), DPU_XFER_DEFAULT));
+
+            // Final histogram merging
+            merge_partials(histo + bins_lo, histo_dpus, nr_of_dpus, bins_nr, bins_dpu);
+            if(rep >= p.n_warmup)
+                stop(&timer, 3);
         }
-        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, input_size_dpu_8bytes * sizeof(T), p.bins * sizeof(unsigned int), DPU_XFER_DEFAULT));
-		
-        // Final histogram merging
-        for(i = 1; i < nr_of_dpus; i++){
-            for(unsigned int j = 0; j < p.bins; j++){
-                histo[j] += histo[j + i * p.bins];
-            }			
-        }		
-        if(rep >= p.n_warmup)
-            stop(&timer, 3);
 
     }
 
@@ -279,6 +316,8 @@ int main(int argc, char **argv) {
     free(A);
     free(histo_host);
     free(histo);
+    free(histo_dpus);
+    free(p.bounds);
     DPU_ASSERT(dpu_free(dpu_set));
 	
     return status ? 0 : -1;
@@ -18,6 +18,8 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#define MERGE_T unsigned long long
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -96,7 +98,7 @@ static void histogram_host(unsigned long long* histo, T* A,
     // The bin index is computed as: (d * bins) >> DEPTH.
     for (unsigned long long j = 0; j < nr_elements; j++) {
         T d = A[j];
-        unsigned long long bin_idx = (d * bins) >> DEPTH;
+        unsigned long long bin_idx = bin_index(d, bins);
         temp_histo[bin_idx]++;
     }
 
@@ -123,6 +125,7 @@ static void histogram_host(unsigned long long* histo, T* A,
 int main(int argc, char **argv) {
     setbuf(stdout, NULL);
     struct Params p = input_params(argc, argv);
+    assert(!p.joint && !p.nr_bounds && "Uniform 1D histograms only!");
 
     struct dpu_set_t dpu_set, dpu;
     uint32_t nr_of_dpus;
@@ -222,12 +225,24 @@ int main(int argc, char **argv) {
                 input_arguments[i].size = input_size_dpu_round_chunk * sizeof(T); 
                 input_arguments[i].transfer_size = input_size_dpu_round_chunk * sizeof(T); 
                 input_arguments[i].bins = p.bins;
+                input_arguments[i].bins_axis = p.bins;
+                input_arguments[i].nr_bounds = 0;
+                input_arguments[i].joint = 0;
+                input_arguments[i].bins_lo = 0;
+                input_arguments[i].bins_nr = bins_8bytes(p.bins);
+                input_arguments[i].strategy = p.strategy;
                 input_arguments[i].kernel = kernel;
             }
             unsigned long long last_chunk = chunk_size_8bytes - input_size_dpu_round_chunk * (nr_of_dpus - 1);
             input_arguments[nr_of_dpus - 1].size = last_chunk * sizeof(T);
             input_arguments[nr_of_dpus - 1].transfer_size = input_size_dpu_round_chunk * sizeof(T);
             input_arguments[nr_of_dpus-1].bins=p.bins;
+            input_arguments[nr_of_dpus-1].bins_axis = p.bins;
+            input_arguments[nr_of_dpus-1].nr_bounds = 0;
+            input_arguments[nr_of_dpus-1].joint = 0;
+            input_arguments[nr_of_dpus-1].bins_lo = 0;
+            input_arguments[nr_of_dpus-1].bins_nr = bins_8bytes(p.bins);
+            input_arguments[nr_of_dpus-1].strategy=p.strategy;
             input_arguments[nr_of_dpus-1].kernel=kernel;
 
             // Copy input arrays
@@ -302,11 +317,7 @@ int main(int argc, char **argv) {
             DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, input_size_dpu_round_chunk * sizeof(T), p.bins * sizeof(unsigned long long), DPU_XFER_DEFAULT));
             
             // Final histogram merging
-            for(i = 1; i < nr_of_dpus; i++){
-                for(unsigned long long j = 0; j < p.bins; j++){
-                    histo[j] += histo[j + i * p.bins];
-                }			
-            }		
+            merge_partials(histo, histo, nr_of_dpus, p.bins, p.bins);
             if(rep >= p.n_warmup)
                 stop(&timer, 3);
             offset += chunk_size;
@@ -16,21 +16,99 @@
 #define DIV 2 // Shift right to divide by sizeof(T)
 #define REGS (BLOCK_SIZE >> 2) // 32 bits
 
-// Pixel depth
+// Pixel depth (the input image is 12-bit, deeper pixels take their low bits from the next pixel)
+#ifndef DEPTH
 #define DEPTH 12
+#endif
 #define ByteSwap16(n) (((((unsigned int)n) << 8) & 0xFF00) | ((((unsigned int)n) >> 8) & 0x00FF))
 
+// Bin boundaries of non-uniform bins (power of two, the last one is always UINT32_MAX)
+#define BOUNDS_MAX 512
+
+// WRAM left for histograms: 64 KB minus the stacks (1 KB per tasklet), the input blocks, the bin boundaries and the globals
+#ifndef HISTO_WRAM
+#define HISTO_WRAM ((64 << 10) - NR_TASKLETS * (1024 + BLOCK_SIZE) - BOUNDS_MAX * sizeof(T) - (4 << 10))
+#endif
+#define NR_LOCKS 8 // Mutexes protecting the bins of shared histograms (striped)
+#define MRAM_PASSES 4 // Passes over the input beyond which the histogram is kept in MRAM
+// MRAM left for the input and the histogram (1 MB kept for the program and the MRAM globals)
+#define HISTO_MRAM (63 << 20)
+
 // Structures used by both the host and the dpu to communicate information 
 typedef struct {
     uint32_t size;
     uint32_t transfer_size;
-    uint32_t bins;
+    uint32_t bins; // Total number of bins
+    uint32_t bins_axis; // Bins per pixel (along each axis of joint histograms)
+    uint32_t nr_bounds; // Bin boundaries in DPU_BOUNDS, 0 for uniform bins
+    uint32_t joint; // 2D histogram of pairs of consecutive pixels
+    uint32_t bins_lo; // First bin counted in this launch
+    uint32_t bins_nr; // Bins counted in this launch, 8-byte aligned
+	enum strategies {
+	    private_histo = 0, // One histogram per tasklet, no locks
+	    shared_histo = 1, // Fewer histograms than tasklets, striped locks
+	    windowed_histo = 2, // One shared histogram per range of bins, one pass over the input per range
+	    mram_histo = 3, // Histogram in MRAM, updated through a write-back cache in each tasklet
+	    nr_strategies = 4,
+	} strategy;
 	enum kernels {
 	    kernel1 = 0,
 	    nr_kernels = 1,
 	} kernel;
 } dpu_arguments_t;
 
+// Histogram bins rounded up to 8 bytes (MRAM transfers)
+static inline uint32_t bins_8bytes(uint32_t bins) {
+    return (bins + 1) & ~1;
+}
+
+// Bin of a pixel, in 64 bits when the product overflows
+static inline uint32_t bin_index(T d, uint32_t bins) {
+    if (bins <= (1u << (32 - DEPTH)))
+        return (d * bins) >> DEPTH;
+    return ((uint64_t)d * bins) >> DEPTH;
+}
+
+// Bin of a pixel along one axis: uniform bins over the pixel range, or the number of boundaries <= the pixel
+// (branchless binary search, nr_bounds is a power of two)
+static inline uint32_t axis_bin(T d, uint32_t bins, const T *bounds, uint32_t nr_bounds) {
+    if (nr_bounds == 0)
+        return bin_index(d, bins);
+    uint32_t bin = 0;
+    for (uint32_t step = nr_bounds >> 1; step > 0; step >>= 1)
+        bin += (bounds[bin + step - 1] <= d) ? step : 0;
+    return bin;
+}
+
+// Bins of each histogram in WRAM: all of them, or a range of whole 2048-byte MRAM blocks
+static inline uint32_t histo_window(uint32_t bins, enum strategies strategy) {
+    if (strategy < windowed_histo)
+        return bins_8bytes(bins);
+    return (HISTO_WRAM / sizeof(uint32_t)) & ~511;
+}
+
+// Fastest strategy whose histograms fit in WRAM, or MRAM when too many passes over the input are needed
+static inline enum strategies histo_strategy(uint32_t bins) {
+    if (NR_TASKLETS * bins_8bytes(bins) * sizeof(uint32_t) <= HISTO_WRAM)
+        return private_histo;
+    else if (bins_8bytes(bins) * sizeof(uint32_t) <= HISTO_WRAM)
+        return shared_histo;
+    else if (bins_8bytes(bins) <= MRAM_PASSES * histo_window(bins, windowed_histo))
+        return windowed_histo;
+    else
+        return mram_histo;
+}
+
+// Number of histograms in WRAM
+static inline uint32_t histo_copies(uint32_t bins, enum strategies strategy) {
+    if (strategy == private_histo)
+        return NR_TASKLETS;
+    else if (strategy >= windowed_histo)
+        return 1;
+    uint32_t copies = HISTO_WRAM / (bins_8bytes(bins) * sizeof(uint32_t));
+    return (copies == 0) ? 1 : (copies > NR_TASKLETS) ? NR_TASKLETS : copies;
+}
+
 #ifndef ENERGY
 #define ENERGY 0
 #endif
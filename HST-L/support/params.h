@@ -6,13 +6,44 @@
 typedef struct Params {
     unsigned int   input_size;
     unsigned int   bins;
+    unsigned int   bins_axis;
+    const char *bounds_file;
+    T    *bounds;
+    unsigned int   nr_bounds;
+    int  joint;
     int   n_warmup;
     int   n_reps;
     const char *file_name;
     int  exp;
     int  dpu_s;
+    int  strategy;
 }Params;
 
+// Read sorted bin boundaries (one per line), padded to a power of two with UINT32_MAX
+static T *read_bounds(const char *file_name, unsigned int *nr_bounds, unsigned int *bins) {
+    FILE *File = fopen(file_name, "r");
+    if(File == NULL) {
+        printf("%s does not exist\n", file_name);
+        exit(1);
+    }
+    T *bounds = malloc(BOUNDS_MAX * sizeof(T));
+    unsigned int nr_cuts = 0;
+    unsigned long b;
+    while(fscanf(File, "%lu", &b) == 1) {
+        assert(nr_cuts < BOUNDS_MAX - 1 && "Too many bin boundaries!");
+        assert((nr_cuts == 0 || b > bounds[nr_cuts - 1]) && "Bin boundaries must be increasing!");
+        bounds[nr_cuts++] = b;
+    }
+    fclose(File);
+    *bins = nr_cuts + 1;
+    *nr_bounds = 2;
+    while(*nr_bounds < *bins)
+        *nr_bounds <<= 1;
+    for(unsigned int i = nr_cuts; i < *nr_bounds; i++)
+        bounds[i] = UINT32_MAX;
+    return bounds;
+}
+
 static void usage() {
     fprintf(stderr,
         "\nUsage:  ./program [options]"
@@ -26,7 +57,10 @@ static void usage() {
         "\nBenchmark-specific options:"
         "\n    -i <I>    input size (default=1536*1024 elements)"
         "\n    -b <B>    histogram size (default=256 bins)"
+        "\n    -c <C>    file of sorted bin boundaries, one per line (default=uniform bins)"
+        "\n    -j        joint histogram of pairs of consecutive pixels (-b or -c bins along each axis)"
         "\n    -f <F>    input image file (default=../input/image_VanHateren.iml)"
+        "\n    -s <S>    private (0), shared (1), windowed (2) or MRAM (3) histograms (default=chosen from the WRAM they need)"
         "\n");
 }
 
@@ -34,14 +68,19 @@ struct Params input_params(int argc, char **argv) {
     struct Params p;
     p.input_size    = 1536 * 1024;
     p.bins          = 256;
+    p.bounds_file   = NULL;
+    p.bounds        = NULL;
+    p.nr_bounds     = 0;
+    p.joint         = 0;
     p.n_warmup      = 1;
     p.n_reps        = 3;
     p.exp           = 0;
     p.file_name     = "./input/image_VanHateren.iml";
     p.dpu_s         = 64;
+    p.strategy      = -1;
 
     int opt;
-    while((opt = getopt(argc, argv, "hi:b:w:e:f:x:z:")) >= 0) {
+    while((opt = getopt(argc, argv, "hi:b:c:jw:e:f:x:z:s:")) >= 0) {
         switch(opt) {
         case 'h':
         usage();
@@ -49,11 +88,14 @@ struct Params input_params(int argc, char **argv) {
         break;
         case 'i': p.input_size    = atoi(optarg); break;
         case 'b': p.bins          = atoi(optarg); break;
+        case 'c': p.bounds_file   = optarg; break;
+        case 'j': p.joint         = 1; break;
         case 'w': p.n_warmup      = atoi(optarg); break;
         case 'e': p.n_reps        = atoi(optarg); break;
         case 'f': p.file_name     = optarg; break;
         case 'x': p.exp           = atoi(optarg); break;
         case 'z': p.dpu_s         = atoi(optarg); break;
+        case 's': p.strategy      = atoi(optarg); break;
         default:
             fprintf(stderr, "\nUnrecognized option!\n");
             usage();
@@ -61,6 +103,19 @@ struct Params input_params(int argc, char **argv) {
         }
     }
     assert(NR_DPUS > 0 && "Invalid # of dpus!");
+    assert(HISTO_WRAM >= 2048 && "Not enough WRAM for histograms!");
+    assert(DEPTH >= 12 && DEPTH <= 24 && "Invalid pixel depth!");
+    if(p.bounds_file) p.bounds = read_bounds(p.bounds_file, &p.nr_bounds, &p.bins);
+    p.bins_axis = p.bins;
+    if(p.joint) {
+        assert(p.input_size % 2 == 0 && "Joint histograms need pairs of pixels!");
+        assert(p.bins_axis < 65536 && "Too many bins!");
+        p.bins = p.bins_axis * p.bins_axis;
+    }
+    if(p.strategy < 0)
+        p.strategy = histo_strategy(p.bins);
+    assert(p.strategy < nr_strategies && "Invalid histogram strategy!");
+    assert(histo_copies(p.bins, p.strategy) * histo_window(p.bins, p.strategy) * sizeof(uint32_t) <= HISTO_WRAM && "Histograms do not fit in WRAM!");
 
     return p;
 }
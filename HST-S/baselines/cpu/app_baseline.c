@@ -66,21 +66,21 @@ static void read_input(T* A, const Params p) {
 /**
 * @brief compute output in the host
 */
-static void histogram_host(unsigned int* histo, T* A, unsigned int bins, unsigned int nr_elements, int exp, unsigned int nr_of_dpus, int t) {
-
-    omp_set_num_threads(t);
+static void histogram_host(unsigned int* histo, T* A, unsigned int bins, unsigned int nr_elements, int exp, int t) {
 
     if(!exp){
-        #pragma omp parallel for
-        for (unsigned int i = 0; i < nr_of_dpus; i++) {
+        // Weak scaling: every thread computes the histogram of the whole input into histo + tid * bins
+        #pragma omp parallel num_threads(t)
+        {
+            size_t tid = omp_get_thread_num();
             for (unsigned int j = 0; j < nr_elements; j++) {
                 T d = A[j];
-                histo[i * bins + ((d * bins) >> DEPTH)] += 1;
+                histo[tid * bins + ((d * bins) >> DEPTH)] += 1;
             }
         }
     }
     else{
-        #pragma omp parallel for
+        #pragma omp parallel for num_threads(t)
         for (unsigned int j = 0; j < nr_elements; j++) {
             T d = A[j];
             #pragma omp atomic update
@@ -150,8 +150,6 @@ int main(int argc, char **argv) {
 
     struct Params p = input_params(argc, argv);
 
-    uint32_t nr_of_dpus;
-    
     const unsigned int input_size = p.input_size; // Size of input image
     if(!p.exp)
         assert(input_size % p.n_threads == 0 && "Input size!");
@@ -162,7 +160,7 @@ int main(int argc, char **argv) {
     A = malloc(input_size * sizeof(T));
     T *bufferA = A;
     if(!p.exp)
-        histo_host = malloc(nr_of_dpus * p.bins * sizeof(unsigned int));
+        histo_host = malloc(p.n_threads * p.bins * sizeof(unsigned int)); // One histogram per thread
     else
         histo_host = malloc(p.bins * sizeof(unsigned int));
 
@@ -173,11 +171,11 @@ int main(int argc, char **argv) {
     start(&timer, 0, 0);
 
 	if(!p.exp)
-            memset(histo_host, 0, nr_of_dpus * p.bins * sizeof(unsigned int));
+            memset(histo_host, 0, p.n_threads * p.bins * sizeof(unsigned int));
     else
             memset(histo_host, 0, p.bins * sizeof(unsigned int));
 
-    histogram_host(histo_host, A, p.bins, input_size, p.exp, nr_of_dpus, p.n_threads);
+    histogram_host(histo_host, A, p.bins, input_size, p.exp, p.n_threads);
 
     stop(&timer, 0);
     printf("Kernel ");
@@ -0,0 +1,249 @@
+/**
+* @file app_baseline_simd.c
+* @brief Histogram CPU baseline with private, cache-line-padded histograms per thread.
+*
+* Each thread counts into SUB_HISTOS interleaved sub-histograms (consecutive pixels go to
+* different sub-histograms, so runs of equal pixels do not stall on the same counter), and
+* computes the bins of BATCH pixels at a time in a vectorized loop. Histograms are merged
+* in parallel over bins.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include <omp.h>
+
+#include "../../support/common.h"
+#include "../../support/timer.h"
+
+#define CACHE_LINE 64
+#define SUB_HISTOS 4 // Interleaved sub-histograms per thread
+#define BATCH 64 // Pixels whose bins are computed at once
+
+// Pointer declaration
+static T* A;
+static unsigned int* histo_host;
+
+typedef struct Params {
+    unsigned int   input_size;
+    unsigned int   bins;
+    int   n_warmup;
+    int   n_reps;
+    const char *file_name;
+    int  exp;
+    int  n_threads;
+}Params;
+
+/**
+* @brief creates input arrays
+* @param nr_elements how many elements in input arrays
+*/
+static void read_input(T* A, const Params p) {
+
+    char  dctFileName[100];
+    FILE *File = NULL;
+
+    // Open input file
+    unsigned short temp;
+    sprintf(dctFileName, "%s", p.file_name);
+    if((File = fopen(dctFileName, "rb")) != NULL) {
+        for(unsigned int y = 0; y < p.input_size; y++) {
+            if(fread(&temp, sizeof(unsigned short), 1, File) != 1)
+                temp = 0;
+            A[y] = (unsigned int)ByteSwap16(temp);
+            if(A[y] >= 4096)
+                A[y] = 4095;
+        }
+        fclose(File);
+    } else {
+        printf("%s does not exist\n", dctFileName);
+        exit(1);
+    }
+}
+
+/**
+* @brief histogram of A[first, last) into sub-histograms (bin * SUB_HISTOS + sub-histogram)
+*/
+static void histogram_banked(unsigned int* banks, T* A, unsigned int bins, unsigned int first, unsigned int last) {
+    unsigned int idx[BATCH];
+    unsigned int j = first;
+    for (; j + BATCH <= last; j += BATCH) {
+        #pragma omp simd
+        for (unsigned int k = 0; k < BATCH; k++)
+            idx[k] = ((A[j + k] * bins) >> DEPTH) * SUB_HISTOS + (k & (SUB_HISTOS - 1));
+        for (unsigned int k = 0; k < BATCH; k++)
+            banks[idx[k]]++;
+    }
+    for (; j < last; j++)
+        banks[((A[j] * bins) >> DEPTH) * SUB_HISTOS + (j & (SUB_HISTOS - 1))]++;
+}
+
+/**
+* @brief compute output in the host, returns the number of histograms written to histo
+* Strong scaling (exp=1): the threads split the input and their histograms are merged into histo.
+* Weak scaling (exp=0): every thread computes the histogram of the whole input into histo + tid * bins,
+* as every DPU does with its own copy of the input. The team may have fewer than t threads
+*/
+static unsigned int histogram_host(unsigned int* histo, T* A, unsigned int bins, unsigned int nr_elements, int exp, int t) {
+
+    // Private histograms, padded to whole cache lines so that no two threads share one
+    const size_t bank_size = ((size_t)bins * SUB_HISTOS * sizeof(unsigned int) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    unsigned int* banks[t];
+    int nr_threads = 1;
+
+    #pragma omp parallel num_threads(t)
+    {
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        #pragma omp single nowait
+        nr_threads = nt;
+        banks[tid] = aligned_alloc(CACHE_LINE, bank_size);
+        memset(banks[tid], 0, bank_size);
+
+        if(!exp) {
+            histogram_banked(banks[tid], A, bins, 0, nr_elements);
+            for (unsigned int b = 0; b < bins; b++) {
+                unsigned int sum = 0;
+                for (unsigned int s = 0; s < SUB_HISTOS; s++)
+                    sum += banks[tid][b * SUB_HISTOS + s];
+                histo[(size_t)tid * bins + b] = sum;
+            }
+        }
+        else {
+            unsigned int chunk = (nr_elements + nt - 1) / nt;
+            unsigned int first = (tid * chunk < nr_elements) ? tid * chunk : nr_elements;
+            unsigned int last = (first + chunk < nr_elements) ? first + chunk : nr_elements;
+            histogram_banked(banks[tid], A, bins, first, last);
+
+            #pragma omp barrier
+            #pragma omp for schedule(static)
+            for (unsigned int b = 0; b < bins; b++) {
+                unsigned int sum = 0;
+                for (int i = 0; i < nt; i++)
+                    for (unsigned int s = 0; s < SUB_HISTOS; s++)
+                        sum += banks[i][b * SUB_HISTOS + s];
+                histo[b] = sum;
+            }
+        }
+    }
+
+    for (int i = 0; i < nr_threads; i++)
+        free(banks[i]);
+    return exp ? 1 : nr_threads;
+}
+
+// Params ---------------------------------------------------------------------
+void usage() {
+    fprintf(stderr,
+        "\nUsage:  ./program [options]"
+        "\n"
+        "\nGeneral options:"
+        "\n    -h        help"
+        "\n    -w <W>    # of untimed warmup iterations (default=1)"
+        "\n    -e <E>    # of timed repetition iterations (default=3)"
+        "\n    -t <T>    # of threads (default=8)"
+        "\n    -x <X>    Weak (0) or strong (1) scaling (default=1)"
+        "\n"
+        "\nBenchmark-specific options:"
+        "\n    -i <I>    input size (default=1536*1024 elements)"
+        "\n    -b <B>    histogram size (default=256 bins)"
+        "\n    -f <F>    input image file (default=../input/image_VanHateren.iml)"
+        "\n");
+}
+
+struct Params input_params(int argc, char **argv) {
+    struct Params p;
+    p.input_size    = 1536 * 1024;
+    p.bins          = 256;
+    p.n_warmup      = 1;
+    p.n_reps        = 3;
+    p.n_threads     = 8;
+    p.exp           = 1;
+    p.file_name     = "../../input/image_VanHateren.iml";
+
+    int opt;
+    while((opt = getopt(argc, argv, "hi:b:w:e:f:x:t:")) >= 0) {
+        switch(opt) {
+        case 'h':
+        usage();
+        exit(0);
+        break;
+        case 'i': p.input_size    = atoi(optarg); break;
+        case 'b': p.bins          = atoi(optarg); break;
+        case 'w': p.n_warmup      = atoi(optarg); break;
+        case 'e': p.n_reps        = atoi(optarg); break;
+        case 'f': p.file_name     = optarg; break;
+        case 'x': p.exp           = atoi(optarg); break;
+        case 't': p.n_threads     = atoi(optarg); break;
+        default:
+            fprintf(stderr, "\nUnrecognized option!\n");
+            usage();
+            exit(0);
+        }
+    }
+    assert(p.n_threads > 0 && "Invalid # of threads!");
+
+    return p;
+}
+
+/**
+* @brief Main of the Host Application.
+*/
+int main(int argc, char **argv) {
+
+    struct Params p = input_params(argc, argv);
+
+    // One histogram per thread in weak scaling (at most n_threads)
+    const unsigned int max_histos = p.exp ? 1 : p.n_threads;
+    unsigned int nr_histos = max_histos;
+    const unsigned int input_size = p.input_size; // Size of input image
+
+    // Input/output allocation
+    A = malloc(input_size * sizeof(T));
+    histo_host = malloc((size_t)max_histos * p.bins * sizeof(unsigned int));
+    unsigned int* histo_ref = calloc(p.bins, sizeof(unsigned int));
+
+    // Create an input file with arbitrary data.
+    read_input(A, p);
+
+    Timer timer;
+    init(&timer, 0);
+
+    for(int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
+        memset(histo_host, 0, (size_t)max_histos * p.bins * sizeof(unsigned int));
+        if(rep >= p.n_warmup)
+            start(&timer, 0, rep - p.n_warmup);
+        nr_histos = histogram_host(histo_host, A, p.bins, input_size, p.exp, p.n_threads);
+        if(rep >= p.n_warmup)
+            stop(&timer, 0);
+    }
+
+    printf("Kernel ");
+    print(&timer, 0, p.n_reps);
+    printf("\n");
+
+    // Check output against a sequential histogram
+    for (unsigned int j = 0; j < input_size; j++)
+        histo_ref[(A[j] * p.bins) >> DEPTH] += 1;
+    bool status = true;
+    for (unsigned int i = 0; i < nr_histos; i++)
+        for (unsigned int j = 0; j < p.bins; j++)
+            if(histo_host[(size_t)i * p.bins + j] != histo_ref[j])
+                status = false;
+    if (status) {
+        printf("[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] Outputs are equal\n");
+    } else {
+        printf("[" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] Outputs differ!\n");
+    }
+
+    free(A);
+    free(histo_host);
+    free(histo_ref);
+
+    return status ? 0 : -1;
+}
@@ -17,6 +17,7 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -214,11 +215,7 @@ int main(int argc, char **argv) {
         DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, input_size_dpu_8bytes * sizeof(T), p.bins * sizeof(unsigned int), DPU_XFER_DEFAULT));
 
         // Final histogram merging
-        for(i = 1; i < nr_of_dpus; i++){
-            for(unsigned int j = 0; j < p.bins; j++){
-                histo[j] += histo[j + i * p.bins];
-            }			
-        }
+        merge_partials(histo, histo, nr_of_dpus, p.bins, p.bins);
         if(rep >= p.n_warmup)
             stop(&timer, 3);
 
@@ -0,0 +1,419 @@
+// Needleman-Wunsch CPU baseline vectorized along anti-diagonals
+//
+// The matrix is split in BLOCK_SIZE x BLOCK_SIZE blocks. Inside a block, the cells of an
+// anti-diagonal do not depend on each other, so every anti-diagonal is computed with AVX-512
+// (16 lanes), AVX2 (8 lanes) or scalar code from the two previous ones, kept in contiguous
+// buffers. Each block is kept in anti-diagonal-major order in a per-thread L1 buffer: its
+// reference is skewed into that order when the block is loaded, so every anti-diagonal is
+// read with contiguous vector loads, and its scores are converted back to row-major order
+// once, when the block is written to the matrix (both with VL x VL register transposes).
+// Blocks are scheduled with a work queue: a block is queued as soon as its upper and left
+// neighbours are done, so there is no barrier between block diagonals.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sched.h>
+#include <omp.h>
+#include <atomic>
+// GCC 12 reports the undefined pass-through operand of its AVX-512 intrinsics as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE 64
+#endif
+
+#if defined(__AVX512F__)
+#define VL 16
+typedef __m512i vec_t;
+static inline vec_t vload(const int *p) { return _mm512_loadu_si512((const void *) p); }
+static inline void vstore(int *p, vec_t v) { _mm512_storeu_si512((void *) p, v); }
+static inline vec_t vadd(vec_t a, vec_t b) { return _mm512_add_epi32(a, b); }
+static inline vec_t vsub(vec_t a, vec_t b) { return _mm512_sub_epi32(a, b); }
+static inline vec_t vmax(vec_t a, vec_t b) { return _mm512_max_epi32(a, b); }
+static inline vec_t vset1(int x) { return _mm512_set1_epi32(x); }
+// Transpose VL x VL elements held in VL vectors
+static inline void vtranspose(vec_t *r) {
+    vec_t t[16], u[16];
+    for (int g = 0; g < 16; g += 4) {
+        t[g] = _mm512_unpacklo_epi32(r[g], r[g + 1]);
+        t[g + 1] = _mm512_unpackhi_epi32(r[g], r[g + 1]);
+        t[g + 2] = _mm512_unpacklo_epi32(r[g + 2], r[g + 3]);
+        t[g + 3] = _mm512_unpackhi_epi32(r[g + 2], r[g + 3]);
+        u[g] = _mm512_unpacklo_epi64(t[g], t[g + 2]);
+        u[g + 1] = _mm512_unpackhi_epi64(t[g], t[g + 2]);
+        u[g + 2] = _mm512_unpacklo_epi64(t[g + 1], t[g + 3]);
+        u[g + 3] = _mm512_unpackhi_epi64(t[g + 1], t[g + 3]);
+    }
+    // Lane l of u[g + c] now holds column 4 * l + c of rows g to g + 3
+    for (int c = 0; c < 4; c++) {
+        vec_t v0 = _mm512_shuffle_i32x4(u[c], u[4 + c], 0x88);
+        vec_t v1 = _mm512_shuffle_i32x4(u[c], u[4 + c], 0xDD);
+        vec_t w0 = _mm512_shuffle_i32x4(u[8 + c], u[12 + c], 0x88);
+        vec_t w1 = _mm512_shuffle_i32x4(u[8 + c], u[12 + c], 0xDD);
+        r[c] = _mm512_shuffle_i32x4(v0, w0, 0x88);
+        r[4 + c] = _mm512_shuffle_i32x4(v1, w1, 0x88);
+        r[8 + c] = _mm512_shuffle_i32x4(v0, w0, 0xDD);
+        r[12 + c] = _mm512_shuffle_i32x4(v1, w1, 0xDD);
+    }
+}
+#elif defined(__AVX2__)
+#define VL 8
+typedef __m256i vec_t;
+static inline vec_t vload(const int *p) { return _mm256_loadu_si256((const __m256i *) p); }
+static inline void vstore(int *p, vec_t v) { _mm256_storeu_si256((__m256i *) p, v); }
+static inline vec_t vadd(vec_t a, vec_t b) { return _mm256_add_epi32(a, b); }
+static inline vec_t vsub(vec_t a, vec_t b) { return _mm256_sub_epi32(a, b); }
+static inline vec_t vmax(vec_t a, vec_t b) { return _mm256_max_epi32(a, b); }
+static inline vec_t vset1(int x) { return _mm256_set1_epi32(x); }
+static inline void vtranspose(vec_t *r) {
+    vec_t t[8], u[8];
+    for (int g = 0; g < 8; g += 4) {
+        t[g] = _mm256_unpacklo_epi32(r[g], r[g + 1]);
+        t[g + 1] = _mm256_unpackhi_epi32(r[g], r[g + 1]);
+        t[g + 2] = _mm256_unpacklo_epi32(r[g + 2], r[g + 3]);
+        t[g + 3] = _mm256_unpackhi_epi32(r[g + 2], r[g + 3]);
+        u[g] = _mm256_unpacklo_epi64(t[g], t[g + 2]);
+        u[g + 1] = _mm256_unpackhi_epi64(t[g], t[g + 2]);
+        u[g + 2] = _mm256_unpacklo_epi64(t[g + 1], t[g + 3]);
+        u[g + 3] = _mm256_unpackhi_epi64(t[g + 1], t[g + 3]);
+    }
+    // Lane l of u[g + c] now holds column 4 * l + c of rows g to g + 3
+    for (int c = 0; c < 4; c++) {
+        r[c] = _mm256_permute2x128_si256(u[c], u[4 + c], 0x20);
+        r[4 + c] = _mm256_permute2x128_si256(u[c], u[4 + c], 0x31);
+    }
+}
+#else
+#define VL 1
+typedef int vec_t;
+static inline vec_t vload(const int *p) { return *p; }
+static inline void vstore(int *p, vec_t v) { *p = v; }
+static inline vec_t vadd(vec_t a, vec_t b) { return a + b; }
+static inline vec_t vsub(vec_t a, vec_t b) { return a - b; }
+static inline vec_t vmax(vec_t a, vec_t b) { return a > b ? a : b; }
+static inline vec_t vset1(int x) { return x; }
+static inline void vtranspose(vec_t *) { }
+#endif
+
+// Element k * DIAG_LD + i of the anti-diagonal-major buffer holds cell (i, k - i) of the block (row 0 and
+// column 0 are the boundaries). Rows and columns are padded so that the last vector and tile may overrun
+#define DIAG_LD (BLOCK_SIZE + VL)
+#define DIAG_ROWS (2 * BLOCK_SIZE + VL)
+// Element (i - 1) * TILE_LD + VL + j of the row-major tile holds cell (i, j), with margins for the skewed tiles
+#define TILE_LD (BLOCK_SIZE + 3 * VL)
+
+int blosum62[24][24] = {
+    { 4, -1, -2, -2,  0, -1, -1,  0, -2, -1, -1, -1, -1, -2, -1,  1,  0, -3, -2,  0, -2, -1,  0, -4},
+    {-1,  5,  0, -2, -3,  1,  0, -2,  0, -3, -2,  2, -1, -3, -2, -1, -1, -3, -2, -3, -1,  0, -1, -4},
+    {-2,  0,  6,  1, -3,  0,  0,  0,  1, -3, -3,  0, -2, -3, -2,  1,  0, -4, -2, -3,  3,  0, -1, -4},
+    {-2, -2,  1,  6, -3,  0,  2, -1, -1, -3, -4, -1, -3, -3, -1,  0, -1, -4, -3, -3,  4,  1, -1, -4},
+    { 0, -3, -3, -3,  9, -3, -4, -3, -3, -1, -1, -3, -1, -2, -3, -1, -1, -2, -2, -1, -3, -3, -2, -4},
+    {-1,  1,  0,  0, -3,  5,  2, -2,  0, -3, -2,  1,  0, -3, -1,  0, -1, -2, -1, -2,  0,  3, -1, -4},
+    {-1,  0,  0,  2, -4,  2,  5, -2,  0, -3, -3,  1, -2, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},
+    { 0, -2,  0, -1, -3, -2, -2,  6, -2, -4, -4, -2, -3, -3, -2,  0, -2, -2, -3, -3, -1, -2, -1, -4},
+    {-2,  0,  1, -1, -3,  0,  0, -2,  8, -3, -3, -1, -2, -1, -2, -1, -2, -2,  2, -3,  0,  0, -1, -4},
+    {-1, -3, -3, -3, -1, -3, -3, -4, -3,  4,  2, -3,  1,  0, -3, -2, -1, -3, -1,  3, -3, -3, -1, -4},
+    {-1, -2, -3, -4, -1, -2, -3, -4, -3,  2,  4, -2,  2,  0, -3, -2, -1, -2, -1,  1, -4, -3, -1, -4},
+    {-1,  2,  0, -1, -3,  1,  1, -2, -1, -3, -2,  5, -1, -3, -1,  0, -1, -3, -2, -2,  0,  1, -1, -4},
+    {-1, -1, -2, -3, -1,  0, -2, -3, -2,  1,  2, -1,  5,  0, -2, -1, -1, -1, -1,  1, -3, -1, -1, -4},
+    {-2, -3, -3, -3, -2, -3, -3, -3, -1,  0,  0, -3,  0,  6, -4, -2, -2,  1,  3, -1, -3, -3, -1, -4},
+    {-1, -2, -2, -1, -3, -1, -1, -2, -2, -3, -3, -1, -2, -4,  7, -1, -1, -4, -3, -2, -2, -1, -2, -4},
+    { 1, -1,  1,  0, -1,  0,  0,  0, -1, -2, -2,  0, -1, -2, -1,  4,  1, -3, -2, -2,  0,  0,  0, -4},
+    { 0, -1,  0, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -2, -1,  1,  5, -2, -2,  0, -1, -1,  0, -4},
+    {-3, -3, -4, -4, -2, -2, -3, -2, -2, -3, -2, -3, -1,  1, -4, -3, -2, 11,  2, -3, -4, -3, -2, -4},
+    {-2, -2, -2, -3, -2, -1, -2, -3,  2, -1, -1, -2, -1,  3, -3, -2, -2,  2,  7, -1, -3, -2, -1, -4},
+    { 0, -3, -3, -3, -1, -2, -2, -3, -3,  3,  1, -2,  1, -1, -2, -2,  0, -3, -1,  4, -3, -2, -1, -4},
+    {-2, -1,  3,  4, -3,  0,  1, -1,  0, -3, -4,  0, -3, -3, -2,  0, -1, -4, -3, -3,  4,  1, -1, -4},
+    {-1,  0,  0,  1, -3,  3,  4, -2,  0, -3, -3,  1, -1, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},
+    { 0, -1, -1, -1, -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -2,  0,  0, -2, -1, -1, -1, -1, -1, -4},
+    {-4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1}
+};
+
+// Returns the current system time in microseconds
+long long get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+void usage(char **argv)
+{
+    fprintf(stderr, "Usage: %s <max_rows/max_cols> <penalty> <num_threads>\n", argv[0]);
+    fprintf(stderr, "\t<dimension>      - x and y dimensions (multiple of %d)\n", BLOCK_SIZE);
+    fprintf(stderr, "\t<penalty>        - penalty(positive integer)\n");
+    fprintf(stderr, "\t<num_threads>    - no. of threads\n");
+    exit(1);
+}
+
+// Per-thread buffers of a block: the anti-diagonal-major buffer, where anti-diagonal k first holds the reference
+// of its cells and is overwritten by their scores, and a row-major tile to convert from and to the matrices
+struct block_buffers {
+    int diag[DIAG_ROWS * DIAG_LD];
+    int tile[BLOCK_SIZE * TILE_LD];
+};
+
+// Skew (to_diag) or unskew the rows of the tile to or from anti-diagonal-major order: VL x VL tiles of the
+// skewed rows (row i shifted right by i) are transposed in registers, so all accesses are whole vectors.
+// Cells outside the block land in the padding of both buffers
+static inline void skew_tile(int *d, int *tile, bool to_diag)
+{
+    vec_t r[VL];
+    for ( int i0 = 1; i0 <= BLOCK_SIZE; i0 += VL )
+        for ( int k0 = i0 + 1; k0 < i0 + VL + BLOCK_SIZE; k0 += VL )
+        {
+            int *row = tile + (i0 - 1) * TILE_LD + VL + k0 - i0;
+            int *diag = d + k0 * DIAG_LD + i0;
+            for ( int c = 0; c < VL; ++c )
+                r[c] = vload(to_diag ? row + c * (TILE_LD - 1) : diag + c * DIAG_LD);
+            vtranspose(r);
+            for ( int c = 0; c < VL; ++c )
+                if (to_diag)
+                    vstore(diag + c * DIAG_LD, r[c]);
+                else
+                    vstore(row + c * (TILE_LD - 1), r[c]);
+        }
+}
+
+// Compute block (b_index_y, b_index_x)
+static void nw_block(int *input_itemsets, const int *referrence, int max_cols, int penalty,
+        int b_index_y, int b_index_x, block_buffers *buf)
+{
+    size_t row0 = (size_t) b_index_y * BLOCK_SIZE;
+    size_t col0 = (size_t) b_index_x * BLOCK_SIZE;
+    int *origin = input_itemsets + row0 * max_cols + col0;
+    int *d = buf->diag;
+    const vec_t pen = vset1(penalty);
+
+    // Reference of the block in anti-diagonal-major order, then the boundaries (row 0 and column 0)
+    for ( int i = 1; i <= BLOCK_SIZE; ++i )
+        memcpy(buf->tile + (i - 1) * TILE_LD + VL + 1, referrence + (row0 + i) * max_cols + col0 + 1, BLOCK_SIZE * sizeof(int));
+    skew_tile(d, buf->tile, true);
+    d[0] = origin[0];
+    for ( int k = 1; k <= BLOCK_SIZE; ++k )
+    {
+        d[k * DIAG_LD] = origin[k];
+        d[k * DIAG_LD + k] = origin[(size_t) k * max_cols];
+    }
+
+    // Every anti-diagonal is a contiguous run of cells, computed from the two previous ones
+    for ( int k = 2; k < 2 * BLOCK_SIZE + 1; ++k )
+    {
+        int lo = (k - BLOCK_SIZE > 1) ? k - BLOCK_SIZE : 1;
+        int hi = (k - 1 < BLOCK_SIZE) ? k - 1 : BLOCK_SIZE;
+        int *curr = d + k * DIAG_LD;
+        const int *d1 = curr - DIAG_LD;
+        const int *d2 = curr - 2 * DIAG_LD;
+        for ( int i = lo; i <= hi; i += VL )
+        {
+            vec_t diag = vadd(vload(d2 + i - 1), vload(curr + i));
+            vec_t up = vsub(vload(d1 + i - 1), pen);
+            vec_t left = vsub(vload(d1 + i), pen);
+            vstore(curr + i, vmax(diag, vmax(up, left)));
+        }
+        // The last vector may have overrun the boundary of column 0
+        if (k <= BLOCK_SIZE)
+        {
+            curr[k] = origin[(size_t) k * max_cols];
+            // Fetch row k of the block for writing while the scores are computed
+            int *out_row = origin + (size_t) k * max_cols + 1;
+            for ( int j = 0; j < BLOCK_SIZE + 16; j += 16 )
+                __builtin_prefetch(out_row + j, 1);
+        }
+    }
+
+    // Back to row-major order, once per block
+    skew_tile(d, buf->tile, false);
+    for ( int i = 1; i <= BLOCK_SIZE; ++i )
+        memcpy(origin + (size_t) i * max_cols + 1, buf->tile + (i - 1) * TILE_LD + VL + 1, BLOCK_SIZE * sizeof(int));
+}
+
+// Work queue of ready blocks: slots are filled in order, and each worker claims the next slot
+// and waits for it to be filled. A block is pushed when its last dependency completes, unless
+// the worker that completes it continues with it; nr_blocks marks the end of the work
+struct work_queue {
+    int nr_blocks;
+    std::atomic<int> *deps;
+    std::atomic<int> *slots;
+    std::atomic<int> head;
+    std::atomic<int> tail;
+};
+
+static void push(work_queue *q, int block)
+{
+    int t = q->tail.fetch_add(1);
+    q->slots[t].store(block, std::memory_order_release);
+}
+
+void nw_simd(int *input_itemsets, int *referrence, int max_cols, int penalty, int num_threads)
+{
+    int nb = (max_cols - 1) / BLOCK_SIZE;
+    work_queue q;
+    q.nr_blocks = nb * nb;
+    q.deps = new std::atomic<int>[nb * nb];
+    // One slot per block at most, plus the stop marks
+    q.slots = new std::atomic<int>[nb * nb + num_threads];
+    for ( int b = 0; b < nb * nb; ++b )
+        q.deps[b].store((b / nb > 0) + (b % nb > 0));
+    for ( int s = 0; s < nb * nb + num_threads; ++s )
+        q.slots[s].store(-1);
+    q.head.store(0);
+    q.tail.store(0);
+    push(&q, 0);
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        block_buffers *buf = (block_buffers *) malloc(sizeof(block_buffers));
+
+        for (;;)
+        {
+            int slot = q.head.fetch_add(1);
+            int b;
+            // Spin briefly, then yield (threads may outnumber cores)
+            for ( int spins = 0; (b = q.slots[slot].load(std::memory_order_acquire)) < 0; ++spins )
+            {
+                if (spins < 64)
+                    _mm_pause();
+                else
+                    sched_yield();
+            }
+            if (b == q.nr_blocks)
+                break;
+
+            // Walk along the row of blocks while the right neighbour is ready, so that consecutive
+            // blocks share their rows of the matrices, and queue the lower neighbours
+            for (;;)
+            {
+                int b_index_y = b / nb;
+                int b_index_x = b % nb;
+                nw_block(input_itemsets, referrence, max_cols, penalty, b_index_y, b_index_x, buf);
+
+                if (b_index_y + 1 < nb && q.deps[b + nb].fetch_sub(1) == 1)
+                    push(&q, b + nb);
+                if (b == q.nr_blocks - 1)
+                {
+                    // Last block: stop all workers
+                    for ( int t = 0; t < num_threads; ++t )
+                        push(&q, q.nr_blocks);
+                    break;
+                }
+                if (b_index_x + 1 < nb && q.deps[b + 1].fetch_sub(1) == 1)
+                    ++b;
+                else
+                    break;
+            }
+        }
+
+        free(buf);
+    }
+
+    delete[] q.deps;
+    delete[] q.slots;
+}
+
+#ifdef CHECK
+// Scalar row-by-row reference
+static void nw_serial(int *itemsets, const int *referrence, int max_rows, int max_cols, int penalty)
+{
+    for ( int i = 1; i < max_rows; ++i )
+        for ( int j = 1; j < max_cols; ++j )
+        {
+            int v = itemsets[(size_t) (i - 1) * max_cols + j - 1] + referrence[(size_t) i * max_cols + j];
+            int up = itemsets[(size_t) (i - 1) * max_cols + j] - penalty;
+            int left = itemsets[(size_t) i * max_cols + j - 1] - penalty;
+            v = v > up ? v : up;
+            itemsets[(size_t) i * max_cols + j] = v > left ? v : left;
+        }
+}
+#endif
+
+int main( int argc, char** argv)
+{
+    int max_rows, max_cols, penalty;
+    int *input_itemsets, *referrence;
+    int omp_num_threads;
+
+    // The lengths of the two sequences should be divisible by BLOCK_SIZE,
+    // and max_rows needs to equal max_cols
+    if (argc == 4)
+    {
+        max_rows = atoi(argv[1]);
+        max_cols = atoi(argv[1]);
+        penalty = atoi(argv[2]);
+        omp_num_threads = atoi(argv[3]);
+    }
+    else{
+        usage(argv);
+    }
+    if (max_rows % BLOCK_SIZE != 0)
+        usage(argv);
+
+    max_rows = max_rows + 1;
+    max_cols = max_cols + 1;
+    referrence = (int *)malloc( (size_t) max_rows * max_cols * sizeof(int) );
+    input_itemsets = (int *)malloc( (size_t) max_rows * max_cols * sizeof(int) );
+
+    if (!input_itemsets || !referrence) {
+        fprintf(stderr, "error: can not allocate memory");
+        exit(1);
+    }
+
+    srand ( 7 );
+
+    for (size_t i = 0 ; i < (size_t) max_rows * max_cols; i++)
+        input_itemsets[i] = 0;
+
+    printf("Start Needleman-Wunsch (anti-diagonal SIMD, %d x int32 lanes, %dx%d blocks)\n", VL, BLOCK_SIZE, BLOCK_SIZE);
+
+    for( int i=1; i< max_rows ; i++){    //please define your own sequence.
+        input_itemsets[(size_t) i*max_cols] = rand() % 10 + 1;
+    }
+    for( int j=1; j< max_cols ; j++){    //please define your own sequence.
+        input_itemsets[j] = rand() % 10 + 1;
+    }
+
+    for (int i = 1 ; i < max_rows; i++){
+        for (int j = 1 ; j < max_cols; j++){
+            referrence[(size_t) i*max_cols+j] = blosum62[input_itemsets[(size_t) i*max_cols]][input_itemsets[j]];
+        }
+    }
+
+    for( int i = 1; i< max_rows ; i++)
+        input_itemsets[(size_t) i*max_cols] = -i * penalty;
+    for( int j = 1; j< max_cols ; j++)
+        input_itemsets[j] = -j * penalty;
+
+    printf("Num of threads: %d\n", omp_num_threads);
+
+    long long start_time = get_time();
+
+    nw_simd(input_itemsets, referrence, max_cols, penalty, omp_num_threads);
+
+    long long end_time = get_time();
+
+    printf("Total time: %.3f seconds\n", ((float) (end_time - start_time)) / (1000*1000));
+    printf("GCUPS: %.3f\n", (double) (max_rows - 1) * (max_cols - 1) / ((end_time - start_time) * 1e3));
+
+#ifdef CHECK
+    int *expected = (int *)malloc( (size_t) max_rows * max_cols * sizeof(int) );
+    memcpy(expected, input_itemsets, (size_t) max_cols * sizeof(int));
+    for( int i = 1; i< max_rows ; i++)
+        expected[(size_t) i*max_cols] = -i * penalty;
+    nw_serial(expected, referrence, max_rows, max_cols, penalty);
+    if (memcmp(expected, input_itemsets, (size_t) max_rows * max_cols * sizeof(int)) == 0)
+        printf("Outputs are equal\n");
+    else
+        printf("Outputs differ!\n");
+    free(expected);
+#endif
+
+    free(referrence);
+    free(input_itemsets);
+
+    return EXIT_SUCCESS;
+}
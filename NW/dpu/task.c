@@ -8,17 +8,117 @@
 #include <mram.h>
 #include <alloc.h>
 #include <perfcounter.h>
+#include <mutex.h>
 #include <barrier.h>
 
 #include "../support/common.h"
 
 __host dpu_arguments_t DPU_INPUT_ARGUMENTS;
+__host dpu_results_t DPU_RESULTS[NR_TASKLETS];
+
+uint32_t curr_pair = 0; // protected by MUTEX
+uint32_t get_pair();
 
 // Barrier
 BARRIER_INIT(my_barrier, NR_TASKLETS);
 
-// main
-int main() {
+// Mutex
+MUTEX_INIT(pair_mutex);
+
+extern int main_kernel1(void);
+extern int main_kernel2(void);
+
+int (*kernels[nr_kernels])(void) = {main_kernel1, main_kernel2};
+
+int main(void) { 
+    // Kernel
+    return kernels[DPU_INPUT_ARGUMENTS.kernel](); 
+}
+
+// Move the input of a subblock (top row and left column of each matrix, and the reference) from MRAM to WRAM
+static void read_subblock(uint32_t mram_base_addr_input_itemsets, uint32_t mram_base_addr_ref, int t_index_x, int t_index_y, int32_t *cache_input, int32_t *cache_ref) {
+    for (uint32_t m = 0; m < NR_MATRICES; m++) {
+        uint32_t addr_input = mram_base_addr_input_itemsets + m * (BL+1) * (BL+2) * sizeof(int32_t) + (t_index_x * (BL+2) * BL_IN * sizeof(int32_t)) + (t_index_y * BL_IN * sizeof(int32_t));
+        int32_t *cache_matrix = cache_input + m * (BL_IN+1) * (BL_IN+2);
+        uint32_t cache_input_offset = (BL_IN+2);
+        mram_read((__mram_ptr void const *) addr_input, (void *) cache_matrix, (BL_IN+2) * sizeof(int32_t)); 
+        addr_input += ((BL+2) * sizeof(int32_t));
+        for (int i = 1; i < BL_IN + 1; i++) {
+            mram_read((__mram_ptr void const *) addr_input, (void *) (cache_matrix + cache_input_offset), (2) * sizeof(int32_t)); 
+            cache_input_offset += (BL_IN+2); 
+            addr_input += ((BL+2) * sizeof(int32_t));
+        }
+    }
+
+    uint32_t addr_ref = mram_base_addr_ref + (t_index_x * BL * BL_IN * sizeof(int32_t)) +  (t_index_y * BL_IN * sizeof(int32_t));
+    uint32_t cache_input_offset = 0;
+    for (int i = 0; i < BL_IN; i++) {
+        mram_read((__mram_ptr void const *) addr_ref, (void *) (cache_ref + cache_input_offset), (BL_IN) * sizeof(int32_t)); 
+        cache_input_offset += BL_IN; 
+        addr_ref += (BL * sizeof(int32_t));
+    }
+}
+
+// Move the output of a subblock (all rows but the first one of each matrix) from WRAM to MRAM
+static void write_subblock(uint32_t mram_base_addr_input_itemsets, int t_index_x, int t_index_y, int32_t *cache_input) {
+    for (uint32_t m = 0; m < NR_MATRICES; m++) {
+        uint32_t addr_input = mram_base_addr_input_itemsets + m * (BL+1) * (BL+2) * sizeof(int32_t) + (t_index_x * (BL+2) * BL_IN * sizeof(int32_t)) + (t_index_y * BL_IN * sizeof(int32_t));
+        int32_t *cache_matrix = cache_input + m * (BL_IN+1) * (BL_IN+2);
+        uint32_t cache_input_offset = (BL_IN+2);
+        addr_input += ((BL+2) * sizeof(int32_t));
+        for (int i = 1; i < BL_IN + 1; i++) {
+            mram_write((cache_matrix + cache_input_offset), (__mram_ptr void *)  addr_input, (BL_IN+2) * sizeof(int32_t)); 
+            cache_input_offset += (BL_IN+2); 
+            addr_input += ((BL+2) * sizeof(int32_t));
+        }
+    }
+}
+
+// Computation of a subblock
+static void compute_subblock(int32_t *cache_input, int32_t *cache_ref, int32_t penalty, int32_t gap_open, uint32_t row, uint32_t col, dpu_results_t *result) {
+#ifdef AFFINE
+    int32_t *cache_e = cache_input + (BL_IN+1) * (BL_IN+2);
+    int32_t *cache_f = cache_e + (BL_IN+1) * (BL_IN+2);
+#endif
+    for (uint32_t i = 1; i < BL_IN + 1; i++) {
+        for (uint32_t j = 1; j < BL_IN + 1; j++) {
+#ifdef AFFINE
+            cache_e[i*(BL_IN+2) + j] = maximum(cache_e[(i-1)*(BL_IN+2) + j] - penalty,
+                                    cache_input[(i-1)*(BL_IN+2) + j] - gap_open - penalty, MINUS_INF);
+            cache_f[i*(BL_IN+2) + j] = maximum(cache_f[i*(BL_IN+2) + j - 1] - penalty,
+                                    cache_input[i*(BL_IN+2) + j - 1] - gap_open - penalty, MINUS_INF);
+            cache_input[i*(BL_IN+2) + j] = maximum(cache_input[(i-1)*(BL_IN+2) + j - 1] + cache_ref[(i-1)*BL_IN + j-1],
+                                    cache_e[i*(BL_IN+2) + j],
+                                    cache_f[i*(BL_IN+2) + j]);
+#else
+            cache_input[i*(BL_IN+2) + j] = maximum(cache_input[(i-1)*(BL_IN+2) + j - 1] + cache_ref[(i-1)*BL_IN + j-1],
+                                    cache_input[i*(BL_IN+2) + j - 1] - penalty,
+                                    cache_input[(i-1)*(BL_IN+2) + j] - penalty);
+#endif
+#ifdef LOCAL
+            // Zero clamping and max. tracking
+            if (cache_input[i*(BL_IN+2) + j] < 0)
+                cache_input[i*(BL_IN+2) + j] = 0;
+            if (BETTER_CELL(cache_input[i*(BL_IN+2) + j], row + i, col + j, result->max, result->row, result->col)) {
+                result->max = cache_input[i*(BL_IN+2) + j];
+                result->row = row + i;
+                result->col = col + j;
+            }
+#endif
+        }
+    }
+#ifndef AFFINE
+    (void)gap_open;
+#endif
+#ifndef LOCAL
+    (void)row;
+    (void)col;
+    (void)result;
+#endif
+}
+
+// Wavefront: blocks of the current diagonal of one alignment
+int main_kernel1() {
     unsigned int tasklet_id = me();
     if (tasklet_id == 0){ // Initialize once the cycle counter
         mem_reset(); // Reset the heap
@@ -28,24 +128,31 @@ int main() {
     uint32_t nblocks = DPU_INPUT_ARGUMENTS.nblocks;
     uint32_t active_blocks = DPU_INPUT_ARGUMENTS.active_blocks;
     uint32_t penalty = DPU_INPUT_ARGUMENTS.penalty;
+    uint32_t gap_open = DPU_INPUT_ARGUMENTS.gap_open;
+    // Position (in blocks) of the first block of this DPU, to report the best cell of a local alignment
+    uint32_t block_row = DPU_INPUT_ARGUMENTS.block_row;
+    uint32_t block_col = DPU_INPUT_ARGUMENTS.block_col;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->max = 0;
+    result->row = 0;
+    result->col = 0;
 #if PRINT
     printf("tasklet_id = %d, nblocks = %d \n", tasklet_id, nblocks);
 #endif
 	
+    // Each block holds NR_MATRICES matrices of (BL+1) x (BL+2) elements, followed by the references of all blocks
+    uint32_t block_bytes = NR_MATRICES * (BL+1) * (BL+2) * sizeof(int32_t);
     uint32_t mram_base_addr_input_itemsets = (uint32_t) (DPU_MRAM_HEAP_POINTER);
-    uint32_t mram_base_addr_ref = (uint32_t) (DPU_MRAM_HEAP_POINTER + nblocks * (BL+1) * (BL+2) * sizeof(int32_t));
+    uint32_t mram_base_addr_ref = (uint32_t) (DPU_MRAM_HEAP_POINTER + nblocks * block_bytes);
     if (nblocks != active_blocks)
-        mram_base_addr_ref = (uint32_t) (DPU_MRAM_HEAP_POINTER + active_blocks * (BL+1) * (BL+2) * sizeof(int32_t));
+        mram_base_addr_ref = (uint32_t) (DPU_MRAM_HEAP_POINTER + active_blocks * block_bytes);
 
-    int32_t *cache_input = mem_alloc((BL_IN+1) * (BL_IN+2) * sizeof(int32_t));
+    int32_t *cache_input = mem_alloc(NR_MATRICES * (BL_IN+1) * (BL_IN+2) * sizeof(int32_t));
     int32_t *cache_ref = mem_alloc(BL_IN * BL_IN * sizeof(int32_t));
     uint32_t REP = BL/BL_IN;
     uint32_t chunks;
     uint32_t mod;
     uint32_t start;
-    uint32_t addr_input;
-    uint32_t addr_ref;
-    uint32_t cache_input_offset;
 
     for (uint32_t bl = 0; bl < nblocks; bl++) {
 
@@ -71,42 +178,13 @@ int main() {
                 int t_index_y = blk - 1 - t_index_x; 
                 
                 // Move input from MRAM to WRAM
-                addr_input =  mram_base_addr_input_itemsets + (t_index_x * (BL+2) * BL_IN * sizeof(int32_t)) + (t_index_y * BL_IN * sizeof(int32_t));
-                cache_input_offset = (BL_IN+2);
-                mram_read((__mram_ptr void const *) addr_input, (void *) cache_input, (BL_IN+2) * sizeof(int32_t)); 
-                addr_input += ((BL+2) * sizeof(int32_t));
-                for (int i = 1; i < BL_IN + 1; i++) {
-                    mram_read((__mram_ptr void const *) addr_input, (void *) (cache_input + cache_input_offset), (2) * sizeof(int32_t)); 
-                    cache_input_offset += (BL_IN+2); 
-                    addr_input += ((BL+2) * sizeof(int32_t));
-                }
-
-                addr_ref = mram_base_addr_ref + (t_index_x * BL * BL_IN * sizeof(int32_t)) +  (t_index_y * BL_IN * sizeof(int32_t));
-                cache_input_offset = 0;
-                for (int i = 0; i < BL_IN; i++) {
-                    mram_read((__mram_ptr void const *) addr_ref, (void *) (cache_ref + cache_input_offset), (BL_IN) * sizeof(int32_t)); 
-                    cache_input_offset += BL_IN; 
-                    addr_ref += (BL * sizeof(int32_t));
-                }
+                read_subblock(mram_base_addr_input_itemsets, mram_base_addr_ref, t_index_x, t_index_y, cache_input, cache_ref);
 
                 // Computation
-                for (uint32_t i = 1; i < BL_IN + 1; i++) {
-                    for (uint32_t j = 1; j < BL_IN + 1; j++) {
-                        cache_input[i*(BL_IN+2) + j] = maximum(cache_input[(i-1)*(BL_IN+2) + j - 1] + cache_ref[(i-1)*BL_IN + j-1],
-                                                cache_input[i*(BL_IN+2) + j - 1] - penalty,
-                                                cache_input[(i-1)*(BL_IN+2) + j] - penalty);
-                    }
-                }
+                compute_subblock(cache_input, cache_ref, penalty, gap_open, (block_row - bl) * BL + t_index_x * BL_IN, (block_col + bl) * BL + t_index_y * BL_IN, result);
 
                 // Move output from WRAM to MRAM
-                addr_input =  mram_base_addr_input_itemsets + (t_index_x * (BL+2) * BL_IN * sizeof(int32_t)) + (t_index_y * BL_IN * sizeof(int32_t));
-                cache_input_offset = (BL_IN+2);
-                addr_input += ((BL+2) * sizeof(int32_t));
-                for (int i = 1; i < BL_IN + 1; i++) {
-                    mram_write((cache_input + cache_input_offset), (__mram_ptr void *)  addr_input, (BL_IN+2) * sizeof(int32_t)); 
-                    cache_input_offset += (BL_IN+2); 
-                    addr_input += ((BL+2) * sizeof(int32_t));
-                }
+                write_subblock(mram_base_addr_input_itemsets, t_index_x, t_index_y, cache_input);
 
             }
             
@@ -134,43 +212,13 @@ int main() {
                 int t_index_y = REP + blk - 2 - t_index_x; 
 
                 // Move input from MRAM to WRAM
-                addr_input =  mram_base_addr_input_itemsets + (t_index_x * (BL+2) * BL_IN * sizeof(int32_t)) + (t_index_y * BL_IN * sizeof(int32_t));
-                cache_input_offset = (BL_IN+2);
-                mram_read((__mram_ptr void const *) addr_input, (void *) cache_input, (BL_IN+2) * sizeof(int32_t)); 
-                addr_input += ((BL+2) * sizeof(int32_t));
-                for (int i = 1; i < BL_IN + 1; i++) {
-                    mram_read((__mram_ptr void const *) addr_input, (void *) (cache_input + cache_input_offset), (2) * sizeof(int32_t)); 
-                    cache_input_offset += (BL_IN+2); 
-                    addr_input += ((BL+2) * sizeof(int32_t));
-                }
-
-                addr_ref = mram_base_addr_ref + (t_index_x * BL * BL_IN * sizeof(int32_t)) +  (t_index_y * BL_IN * sizeof(int32_t));
-                cache_input_offset = 0;
-                for (int i = 0; i < BL_IN; i++) {
-                    mram_read((__mram_ptr void const *) addr_ref, (void *) (cache_ref + cache_input_offset), (BL_IN) * sizeof(int32_t)); 
-                    cache_input_offset += BL_IN; 
-                    addr_ref += (BL * sizeof(int32_t));
-                }
-
+                read_subblock(mram_base_addr_input_itemsets, mram_base_addr_ref, t_index_x, t_index_y, cache_input, cache_ref);
 
                 // Computation
-                for (int i = 1; i < BL_IN + 1; i++) {
-                    for (int j = 1; j < BL_IN + 1; j++) {
-                        cache_input[i*(BL_IN+2) + j] = maximum(cache_input[(i-1)*(BL_IN+2) + j - 1] + cache_ref[(i-1)*BL_IN + j-1],
-                                                cache_input[i*(BL_IN+2) + j - 1] - penalty,
-                                                cache_input[(i-1)*(BL_IN+2) + j] - penalty);
-                    }
-                }
+                compute_subblock(cache_input, cache_ref, penalty, gap_open, (block_row - bl) * BL + t_index_x * BL_IN, (block_col + bl) * BL + t_index_y * BL_IN, result);
 
                 // Move output from WRAM to MRAM
-                addr_input =  mram_base_addr_input_itemsets + (t_index_x * (BL+2) * BL_IN * sizeof(int32_t)) + (t_index_y * BL_IN * sizeof(int32_t));
-                cache_input_offset = (BL_IN+2);
-                addr_input += ((BL+2) * sizeof(int32_t));
-                for (int i = 1; i < BL_IN + 1; i++) {
-                    mram_write(cache_input + cache_input_offset, (__mram_ptr void *)  addr_input, (BL_IN+2) * sizeof(int32_t)); 
-                    cache_input_offset += (BL_IN+2); 
-                    addr_input += ((BL+2) * sizeof(int32_t));
-                }
+                write_subblock(mram_base_addr_input_itemsets, t_index_x, t_index_y, cache_input);
 
             }
             
@@ -178,8 +226,156 @@ int main() {
 
         }
 		
-        mram_base_addr_input_itemsets += ((BL+1) * (BL+2) * sizeof(int32_t));
+        mram_base_addr_input_itemsets += block_bytes;
         mram_base_addr_ref += (BL * BL * sizeof(int32_t)); 
     }
     return 0;
 }
+
+// Batch: each tasklet aligns whole sequence pairs on its own
+int main_kernel2() {
+    unsigned int tasklet_id = me();
+    if (tasklet_id == 0){ // Initialize once the cycle counter
+        mem_reset(); // Reset the heap
+        curr_pair = 0;
+    }
+    // Barrier
+    barrier_wait(&my_barrier);
+    uint32_t nr_pairs = DPU_INPUT_ARGUMENTS.nr_pairs;
+    uint32_t max_pairs = DPU_INPUT_ARGUMENTS.max_pairs;
+    uint32_t stride = DPU_INPUT_ARGUMENTS.stride;
+    int32_t penalty = DPU_INPUT_ARGUMENTS.penalty;
+    uint32_t traceback = DPU_INPUT_ARGUMENTS.traceback;
+
+    // MRAM layout: lengths, sequences, results, paths and per-tasklet scratch
+    uint32_t mram_base_addr_lens = (uint32_t) DPU_MRAM_HEAP_POINTER;
+    uint32_t mram_base_addr_seqs = mram_base_addr_lens + max_pairs * 2 * sizeof(uint32_t);
+    uint32_t mram_base_addr_results = mram_base_addr_seqs + max_pairs * 2 * stride;
+    uint32_t mram_base_addr_paths = mram_base_addr_results + max_pairs * sizeof(pair_result_t);
+    uint32_t mram_base_addr_scratch = mram_base_addr_paths + (traceback ? max_pairs * 2 * stride : 0);
+    uint32_t scratch_bytes = BATCH_COL_BYTES(stride) + (traceback ? BATCH_DIR_BYTES(stride) : 0);
+    uint32_t mram_col = mram_base_addr_scratch + tasklet_id * scratch_bytes;
+    uint32_t mram_dir = mram_col + BATCH_COL_BYTES(stride);
+
+    uint8_t *cache_a = mem_alloc(BATCH_CHUNK);
+    uint8_t *cache_b = mem_alloc(STRIP);
+    int32_t *cache_row = mem_alloc((STRIP + 2) * sizeof(int32_t));
+    int32_t *cache_col = mem_alloc(BATCH_CHUNK * sizeof(int32_t));
+    uint8_t *cache_dir = mem_alloc(STRIP);
+    uint8_t *cache_window = mem_alloc(BATCH_CHUNK);
+    uint8_t *cache_path = mem_alloc(BATCH_CHUNK);
+    uint32_t *cache_lens = mem_alloc(2 * sizeof(uint32_t));
+    pair_result_t *cache_result = mem_alloc(sizeof(pair_result_t));
+
+    for (uint32_t pair = get_pair(); pair < nr_pairs; pair = get_pair()) {
+        mram_read((__mram_ptr void const *) (mram_base_addr_lens + pair * 2 * sizeof(uint32_t)), cache_lens, 2 * sizeof(uint32_t));
+        uint32_t len_a = cache_lens[0];
+        uint32_t len_b = cache_lens[1];
+        uint32_t addr_a = mram_base_addr_seqs + pair * 2 * stride;
+        uint32_t addr_b = addr_a + stride;
+        int32_t score = -(int32_t)len_a * penalty;
+
+        // Vertical strips of STRIP columns: the boundary column between strips is kept in MRAM
+        for (uint32_t j0 = 0; j0 < len_b; j0 += STRIP) {
+            uint32_t width = (len_b - j0 < STRIP) ? len_b - j0 : STRIP;
+            mram_read((__mram_ptr void const *) (addr_b + j0), cache_b, roundup8(width));
+            for (uint32_t k = 0; k <= width; k++)
+                cache_row[k] = -(int32_t)(j0 + k) * penalty;
+
+            for (uint32_t i = 1; i <= len_a; i++) {
+                uint32_t idx = (i - 1) % BATCH_CHUNK;
+                uint32_t rows = (len_a - (i - 1 - idx) < BATCH_CHUNK) ? len_a - (i - 1 - idx) : BATCH_CHUNK; // Rows of the current chunk
+                if (idx == 0) {
+                    mram_read((__mram_ptr void const *) (addr_a + i - 1), cache_a, roundup8(rows));
+                    if (j0 != 0)
+                        mram_read((__mram_ptr void const *) (mram_col + (i - 1) * sizeof(int32_t)), cache_col, roundup8(rows * sizeof(int32_t)));
+                }
+
+                int32_t *sub = blosum62[cache_a[idx]];
+                int32_t diag = cache_row[0];
+                cache_row[0] = (j0 == 0) ? -(int32_t)i * penalty : cache_col[idx];
+                for (uint32_t k = 1; k <= width; k++) {
+                    int32_t up = cache_row[k];
+                    int32_t h = diag + sub[cache_b[k - 1]];
+                    uint8_t dir = DIR_DIAG;
+                    if (up - penalty > h) {
+                        h = up - penalty;
+                        dir = DIR_UP;
+                    }
+                    if (cache_row[k - 1] - penalty > h) {
+                        h = cache_row[k - 1] - penalty;
+                        dir = DIR_LEFT;
+                    }
+                    cache_dir[k - 1] = dir;
+                    diag = up;
+                    cache_row[k] = h;
+                }
+                cache_col[idx] = cache_row[width];
+
+                if (traceback)
+                    mram_write(cache_dir, (__mram_ptr void *) (mram_dir + (i - 1) * stride + j0), roundup8(width));
+                if (idx == BATCH_CHUNK - 1 || i == len_a)
+                    mram_write(cache_col, (__mram_ptr void *) (mram_col + (i - idx - 1) * sizeof(int32_t)), roundup8(rows * sizeof(int32_t)));
+            }
+            score = cache_row[width];
+        }
+
+        // Traceback from the bottom-right corner (the path is stored from end to start)
+        uint32_t path_len = 0;
+        if (traceback) {
+            uint32_t addr_path = mram_base_addr_paths + pair * 2 * stride;
+            uint32_t win_start = 0xFFFFFFFF;
+            uint32_t i = len_a;
+            uint32_t j = len_b;
+            while (i > 0 || j > 0) {
+                uint8_t dir;
+                if (i == 0) {
+                    dir = DIR_LEFT;
+                } else if (j == 0) {
+                    dir = DIR_UP;
+                } else {
+                    uint32_t addr = mram_dir + (i - 1) * stride + (j - 1);
+                    if (addr < win_start || addr >= win_start + BATCH_CHUNK) {
+                        uint32_t row_start = mram_dir + (i - 1) * stride;
+                        win_start = (addr & ~7) + 8 - BATCH_CHUNK;
+                        if (win_start < row_start)
+                            win_start = row_start;
+                        mram_read((__mram_ptr void const *) win_start, cache_window, BATCH_CHUNK);
+                    }
+                    dir = cache_window[addr - win_start];
+                }
+
+                if (dir == DIR_DIAG) {
+                    cache_path[path_len % BATCH_CHUNK] = OP_MATCH;
+                    i--;
+                    j--;
+                } else if (dir == DIR_UP) {
+                    cache_path[path_len % BATCH_CHUNK] = OP_DEL;
+                    i--;
+                } else {
+                    cache_path[path_len % BATCH_CHUNK] = OP_INS;
+                    j--;
+                }
+                path_len++;
+                if (path_len % BATCH_CHUNK == 0)
+                    mram_write(cache_path, (__mram_ptr void *) (addr_path + path_len - BATCH_CHUNK), BATCH_CHUNK);
+            }
+            if (path_len % BATCH_CHUNK != 0)
+                mram_write(cache_path, (__mram_ptr void *) (addr_path + path_len - path_len % BATCH_CHUNK), roundup8(path_len % BATCH_CHUNK));
+        }
+
+        cache_result->score = score;
+        cache_result->path_len = path_len;
+        mram_write(cache_result, (__mram_ptr void *) (mram_base_addr_results + pair * sizeof(pair_result_t)), sizeof(pair_result_t));
+    }
+    return 0;
+}
+
+// Auxiliary functions
+uint32_t get_pair(){
+    mutex_lock(pair_mutex);
+    uint32_t value = curr_pair;
+    curr_pair++;
+    mutex_unlock(pair_mutex);
+    return value;
+}
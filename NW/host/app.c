@@ -3,10 +3,12 @@
 * NW Host Application Source File 
 *
 */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
 #include <dpu.h>
 #include <dpu_log.h>
 #include <unistd.h>
@@ -27,6 +29,7 @@
 #endif
 
 // Traceback in the host
+#if !defined(AFFINE) && !defined(LOCAL)
 #if PRINT_FILE
 static void traceback(int* traceback_output, char *file, int32_t *input_itemsets, int32_t *reference, unsigned int max_rows, unsigned int max_cols, unsigned int penalty) {
     FILE *fpo = fopen(file, "w"); // Use to print to an output file
@@ -93,11 +96,384 @@ static void traceback(int* traceback_output, int32_t *input_itemsets, int32_t *r
 
     return;
 }
+#endif
+
+#if defined(AFFINE) || defined(LOCAL)
+// Traceback of the affine-gap or local alignment from cell (row, col) of matrices with ld columns
+// (reference has ld_ref columns). Returns the length of the path
+static unsigned int traceback_scheme(int32_t *traceback_output, FILE *fpo, int32_t **matrices, int32_t *reference, uint64_t ld, uint64_t ld_ref, uint64_t row, uint64_t col, int32_t penalty, int32_t gap_open) {
+    int32_t *h = matrices[0];
+    uint64_t i = row, j = col;
+    unsigned int k = 0;
+    traceback_output[k++] = h[i * ld + j];
+#ifdef AFFINE
+    int32_t *e = matrices[1];
+    int32_t *f = matrices[2];
+    int state = 0; // 0: H, 1: E (vertical gap), 2: F (horizontal gap)
+    while (i > 0 || j > 0) {
+        if (i == 0) {
+            j--;
+        } else if (j == 0) {
+            i--;
+        } else if (state == 0 && h[i * ld + j] == h[(i - 1) * ld + j - 1] + reference[(i - 1) * ld_ref + j - 1]) {
+            i--;
+            j--;
+        } else {
+            if (state == 0)
+                state = (h[i * ld + j] == e[i * ld + j]) ? 1 : 2;
+            if (state == 1) {
+                state = (e[i * ld + j] == h[(i - 1) * ld + j] - gap_open - penalty) ? 0 : 1;
+                i--;
+            } else {
+                state = (f[i * ld + j] == h[i * ld + j - 1] - gap_open - penalty) ? 0 : 2;
+                j--;
+            }
+        }
+        traceback_output[k++] = h[i * ld + j];
+    }
+#else
+    (void)gap_open;
+    while (h[i * ld + j] > 0) {
+        if (h[i * ld + j] == h[(i - 1) * ld + j - 1] + reference[(i - 1) * ld_ref + j - 1]) {
+            i--;
+            j--;
+        } else if (h[i * ld + j] == h[(i - 1) * ld + j] - penalty) {
+            i--;
+        } else {
+            j--;
+        }
+        traceback_output[k++] = h[i * ld + j];
+    }
+#endif
+    if (fpo != NULL) {
+        for (unsigned int s = 0; s < k; s++)
+            fprintf(fpo, "%d ", traceback_output[s]);
+    }
+    return k;
+}
+#endif
+
+// Layout of a DP matrix (and of the reference) in host memory. Full matrices keep ld (ld_ref)
+// elements per row. Banded ones (band >= 0 blocks) only keep, for each row, the columns of
+// the band of its block row plus one block of MINUS_INF cells on each side
+typedef struct {
+    uint64_t ld;
+    uint64_t ld_ref;
+    int64_t band;
+} layout_t;
+
+static inline uint64_t cell_offset(const layout_t *layout, uint64_t row, uint64_t col) {
+    if (layout->band < 0)
+        return row * layout->ld + col;
+    int64_t block_row = (row == 0) ? 0 : (row - 1) / BL;
+    return row * layout->ld + col - (block_row - layout->band - 1) * BL;
+}
+
+static inline uint64_t ref_offset(const layout_t *layout, uint64_t row, uint64_t col) {
+    if (layout->band < 0)
+        return row * layout->ld_ref + col;
+    int64_t block_row = row / BL;
+    return row * layout->ld_ref + col - (block_row - layout->band) * BL;
+}
+
+static inline bool block_in_band(int64_t band, int64_t b_index_y, int64_t b_index_x) {
+    return band < 0 || (b_index_x - b_index_y <= band && b_index_y - b_index_x <= band);
+}
+
+// Columns [lo, hi] of a row (of a matrix with n + 1 columns) that belong to the band
+static void band_range(int64_t band, uint64_t row, uint64_t n, uint64_t *lo, uint64_t *hi) {
+    if (band < 0) {
+        *lo = 0;
+        *hi = n;
+        return;
+    }
+    int64_t block_row = (row == 0) ? 0 : (row - 1) / BL;
+    *lo = (block_row - band <= 0) ? 0 : (block_row - band) * BL + 1;
+    *hi = ((block_row + band + 1) * BL < (int64_t) n) ? (uint64_t) (block_row + band + 1) * BL : n;
+}
+
+// Blocks of diagonal diag (b_index_x + b_index_y = diag) with b_index_x in [x_min, x_max] that
+// belong to the band: returns their number and the b_index_x of the first one
+static unsigned int diagonal_blocks(int64_t band, int64_t diag, int64_t x_min, int64_t x_max, unsigned int *first) {
+    if (band >= 0) {
+        if (diag - band > 0 && (diag - band + 1) / 2 > x_min)
+            x_min = (diag - band + 1) / 2;
+        if ((diag + band) / 2 < x_max)
+            x_max = (diag + band) / 2;
+    }
+    *first = x_min;
+    return (x_max >= x_min) ? x_max - x_min + 1 : 0;
+}
+
+// Reset the first column of the right neighbor of the last block of a diagonal, if outside the band
+static void band_edge(int32_t *input_itemsets, const layout_t *layout, int64_t diag, int64_t last) {
+    int64_t b_index_x = last;
+    int64_t b_index_y = diag - last;
+    if (b_index_x - b_index_y < layout->band)
+        return;
+    for (uint64_t i = 1; i <= BL; i++)
+        input_itemsets[cell_offset(layout, b_index_y * BL + i, (b_index_x + 1) * BL + 1)] = MINUS_INF;
+}
+
+// Initialize banded matrices: random sequences, the band of the reference, MINUS_INF cells
+// around the band, and the gap penalties of the first row and column
+static void init_banded(int32_t *input_itemsets_host, int32_t *input_itemsets, int32_t *reference, const layout_t *layout, uint64_t rows, uint64_t n, unsigned int penalty) {
+    uint8_t *seq_a = (uint8_t *) malloc(n + 1);
+    uint8_t *seq_b = (uint8_t *) malloc(n + 1);
+    srand(7);
+    for (uint64_t i = 1; i <= n; i++)
+        seq_a[i] = rand() % 10 + 1;
+    for (uint64_t j = 1; j <= n; j++)
+        seq_b[j] = rand() % 10 + 1;
+
+    for (uint64_t i = 0; i < rows * layout->ld; i++) {
+        input_itemsets_host[i] = MINUS_INF;
+        input_itemsets[i] = MINUS_INF;
+    }
+
+    for (uint64_t i = 1; i <= n; i++) {
+        uint64_t lo, hi;
+        band_range(layout->band, i, n, &lo, &hi);
+        for (uint64_t j = (lo > 1 ? lo : 1); j <= hi; j++)
+            reference[ref_offset(layout, i - 1, j - 1)] = blosum62[seq_a[i]][seq_b[j]];
+        if (lo == 0) {
+            input_itemsets_host[cell_offset(layout, i, 0)] = -i * penalty;
+            input_itemsets[cell_offset(layout, i, 0)] = -i * penalty;
+        }
+    }
+
+    uint64_t lo, hi;
+    band_range(layout->band, 0, n, &lo, &hi);
+    for (uint64_t j = 0; j <= hi; j++) {
+        input_itemsets_host[cell_offset(layout, 0, j)] = -j * penalty;
+        input_itemsets[cell_offset(layout, 0, j)] = -j * penalty;
+    }
+
+    free(seq_a);
+    free(seq_b);
+}
+
+// Linear-memory traceback (Hirschberg): the optimal path between two cells is split at the
+// middle row, in the column where the forward and the backward scores add up to the optimum.
+// Only the reference is read, never the score matrix
+typedef struct {
+    int32_t *reference;
+    const layout_t *layout;
+    uint64_t n;        // Last row (and column) of the matrix
+    int32_t penalty;
+    int32_t *rows[4];  // Forward and backward rows of scores (n + 1 elements each)
+    char *ops;         // Path from (0, 0) to (n, n): OP_MATCH, OP_DEL or OP_INS
+    uint64_t nr_ops;
+} hirschberg_t;
+
+static inline int32_t hb_score(const hirschberg_t *h, uint64_t i, uint64_t j) {
+    return h->reference[ref_offset(h->layout, i - 1, j - 1)];
+}
+
+// Band of row i restricted to columns [j0, j1]
+static void hb_range(const hirschberg_t *h, uint64_t i, uint64_t j0, uint64_t j1, uint64_t *lo, uint64_t *hi) {
+    band_range(h->layout->band, i, h->n, lo, hi);
+    if (*lo < j0)
+        *lo = j0;
+    if (*hi > j1)
+        *hi = j1;
+}
+
+// Best scores from (i0, j0) to (mid, j), for j in [j0, j1] (element j - j0)
+// Bands only move right from one row to the next, so each row only resets the cell on its left
+static int32_t *hb_forward(hirschberg_t *h, uint64_t i0, uint64_t j0, uint64_t mid, uint64_t j1) {
+    int32_t *prev = h->rows[0];
+    int32_t *curr = h->rows[1];
+    uint64_t lo, hi;
+    for (uint64_t j = j0; j <= j1; j++)
+        prev[j - j0] = curr[j - j0] = MINUS_INF;
+
+    hb_range(h, i0, j0, j1, &lo, &hi);
+    prev[0] = 0;
+    for (uint64_t j = j0 + 1; j <= hi; j++)
+        prev[j - j0] = prev[j - j0 - 1] - h->penalty;
+
+    for (uint64_t i = i0 + 1; i <= mid; i++) {
+        hb_range(h, i, j0, j1, &lo, &hi);
+        if (lo > j0)
+            curr[lo - 1 - j0] = MINUS_INF;
+        for (uint64_t j = lo; j <= hi; j++) {
+            int32_t v = prev[j - j0] - h->penalty;
+            if (j > j0)
+                v = maximum(v, prev[j - j0 - 1] + hb_score(h, i, j), curr[j - j0 - 1] - h->penalty);
+            curr[j - j0] = v;
+        }
+        int32_t *tmp = prev;
+        prev = curr;
+        curr = tmp;
+    }
+    return prev;
+}
+
+// Best scores from (mid, j) to (i1, j1), for j in [j0, j1] (element j - j0)
+static int32_t *hb_backward(hirschberg_t *h, uint64_t mid, uint64_t j0, uint64_t i1, uint64_t j1) {
+    int32_t *prev = h->rows[2];
+    int32_t *curr = h->rows[3];
+    uint64_t lo, hi;
+    for (uint64_t j = j0; j <= j1; j++)
+        prev[j - j0] = curr[j - j0] = MINUS_INF;
+
+    hb_range(h, i1, j0, j1, &lo, &hi);
+    prev[j1 - j0] = 0;
+    for (uint64_t j = j1; j-- > lo;)
+        prev[j - j0] = prev[j - j0 + 1] - h->penalty;
+
+    for (uint64_t i = i1; i-- > mid;) {
+        hb_range(h, i, j0, j1, &lo, &hi);
+        if (hi < j1)
+            curr[hi + 1 - j0] = MINUS_INF;
+        for (uint64_t j = hi + 1; j-- > lo;) {
+            int32_t v = prev[j - j0] - h->penalty;
+            if (j < j1)
+                v = maximum(v, prev[j - j0 + 1] + hb_score(h, i + 1, j + 1), curr[j - j0 + 1] - h->penalty);
+            curr[j - j0] = v;
+        }
+        int32_t *tmp = prev;
+        prev = curr;
+        curr = tmp;
+    }
+    return prev;
+}
+
+static void hb_append(hirschberg_t *h, char op, uint64_t count) {
+    for (uint64_t k = 0; k < count; k++)
+        h->ops[h->nr_ops++] = op;
+}
+
+// Optimal path from (i0, j0) to (i1, j1)
+static void hb_path(hirschberg_t *h, uint64_t i0, uint64_t j0, uint64_t i1, uint64_t j1) {
+    uint64_t lo, hi;
+    if (i1 == i0) {
+        hb_append(h, OP_INS, j1 - j0);
+        return;
+    }
+
+    if (i1 == i0 + 1) {
+        // One row down: diagonal move into column k, or gap in column k
+        uint64_t lo1, hi1;
+        hb_range(h, i0, j0, j1, &lo, &hi);
+        hb_range(h, i1, j0, j1, &lo1, &hi1);
+        int32_t best = MINUS_INF;
+        uint64_t best_k = j0;
+        char best_op = OP_DEL;
+        for (uint64_t k = j0 + 1; k <= j1; k++) {
+            int32_t v = hb_score(h, i1, k) - (int32_t) (j1 - j0 - 1) * h->penalty;
+            if (k - 1 <= hi && k >= lo1 && v > best) {
+                best = v;
+                best_k = k;
+                best_op = OP_MATCH;
+            }
+        }
+        for (uint64_t k = j0; k <= j1; k++) {
+            int32_t v = -(int32_t) (j1 - j0 + 1) * h->penalty;
+            if (k <= hi && k >= lo1 && v > best) {
+                best = v;
+                best_k = k;
+                best_op = OP_DEL;
+            }
+        }
+        if (best_op == OP_MATCH) {
+            hb_append(h, OP_INS, best_k - 1 - j0);
+            hb_append(h, OP_MATCH, 1);
+        } else {
+            hb_append(h, OP_INS, best_k - j0);
+            hb_append(h, OP_DEL, 1);
+        }
+        hb_append(h, OP_INS, j1 - best_k);
+        return;
+    }
+
+    uint64_t mid = (i0 + i1) / 2;
+    int32_t *fwd = hb_forward(h, i0, j0, mid, j1);
+    int32_t *bwd = hb_backward(h, mid, j0, i1, j1);
+    hb_range(h, mid, j0, j1, &lo, &hi);
+    uint64_t best_j = lo;
+    for (uint64_t j = lo; j <= hi; j++) {
+        if (fwd[j - j0] + bwd[j - j0] > fwd[best_j - j0] + bwd[best_j - j0])
+            best_j = j;
+    }
+    hb_path(h, i0, j0, mid, best_j);
+    hb_path(h, mid, best_j, i1, j1);
+}
+
+// Traceback with Hirschberg's algorithm: scores along the path, from the last cell back to (0, 0) as traceback()
+static void hirschberg(hirschberg_t *h, int32_t *traceback_output) {
+    h->nr_ops = 0;
+    hb_path(h, 0, 0, h->n, h->n);
+
+    uint64_t i = 0, j = 0;
+    int32_t score = 0;
+    traceback_output[h->nr_ops] = 0;
+    for (uint64_t k = 0; k < h->nr_ops; k++) {
+        if (h->ops[k] == OP_MATCH) {
+            i++;
+            j++;
+            score += hb_score(h, i, j);
+        } else {
+            if (h->ops[k] == OP_DEL)
+                i++;
+            else
+                j++;
+            score -= h->penalty;
+        }
+        traceback_output[h->nr_ops - 1 - k] = score;
+    }
+}
+
+// Every cell of an optimal path holds the score of the path up to it
+static bool hirschberg_check(const hirschberg_t *h, const int32_t *traceback_output, const int32_t *matrix, const layout_t *layout) {
+    uint64_t i = 0, j = 0;
+    for (uint64_t k = 0; k < h->nr_ops; k++) {
+        if (h->ops[k] != OP_INS)
+            i++;
+        if (h->ops[k] != OP_DEL)
+            j++;
+        if (matrix[cell_offset(layout, i, j)] != traceback_output[h->nr_ops - 1 - k])
+            return false;
+    }
+    return i == h->n && j == h->n;
+}
+
+// Computation of a block in the host
+static void nw_block_host(int32_t *input_itemsets_l, int32_t *reference_l, int32_t penalty, int32_t gap_open) {
+#ifdef AFFINE
+    int32_t *e_l = input_itemsets_l + (BL + 1) * (BL + 1);
+    int32_t *f_l = e_l + (BL + 1) * (BL + 1);
+#else
+    (void)gap_open;
+#endif
+    for (uint64_t i = 1; i < BL + 1; i++) {
+        for (uint64_t j = 1; j < BL + 1; j++) {
+#ifdef AFFINE
+            e_l[i*(BL + 1) + j] = maximum(e_l[(i-1)*(BL+1) + j] - penalty,
+                    input_itemsets_l[(i-1)*(BL+1) + j] - gap_open - penalty, MINUS_INF);
+            f_l[i*(BL + 1) + j] = maximum(f_l[i*(BL+1) + j - 1] - penalty,
+                    input_itemsets_l[i*(BL+1) + j - 1] - gap_open - penalty, MINUS_INF);
+            input_itemsets_l[i*(BL + 1) + j] = maximum(input_itemsets_l[(i-1)*(BL+1) + j - 1] + reference_l[(i-1)*BL + j - 1],
+                    e_l[i*(BL + 1) + j],
+                    f_l[i*(BL + 1) + j]);
+#else
+            input_itemsets_l[i*(BL + 1) + j] = maximum(input_itemsets_l[(i-1)*(BL+1) + j - 1] + reference_l[(i-1)*BL + j - 1],
+                    input_itemsets_l[i*(BL+1) + j - 1] - penalty,
+                    input_itemsets_l[(i-1)*(BL+1) + j] - penalty);
+#endif
+#ifdef LOCAL
+            if (input_itemsets_l[i*(BL + 1) + j] < 0)
+                input_itemsets_l[i*(BL + 1) + j] = 0;
+#endif
+        }
+    }
+}
 
 // Compute output in the host
-static void nw_host(int32_t *input_itemsets, int32_t *reference, uint64_t max_cols, unsigned int penalty) {
+static void nw_host(int32_t **matrices, int32_t *reference, const layout_t *layout, uint64_t max_cols, unsigned int penalty, unsigned int gap_open) {
 
-    int32_t *input_itemsets_l = (int32_t *) malloc((BL + 1) * (BL + 1) * sizeof(int32_t));
+    int32_t *input_itemsets_l = (int32_t *) malloc(NR_MATRICES * (BL + 1) * (BL + 1) * sizeof(int32_t));
     int32_t *reference_l = (int32_t *) malloc((BL * BL) * sizeof(int32_t));
 
 
@@ -105,31 +481,31 @@ static void nw_host(int32_t *input_itemsets, int32_t *reference, uint64_t max_co
     for (uint64_t blk = 1; blk <= (max_cols-1)/BL; blk++) {
         for (uint64_t b_index_x = 0; b_index_x < blk; b_index_x++) {
             uint64_t b_index_y = blk - 1 - b_index_x;
+            if (!block_in_band(layout->band, b_index_y, b_index_x))
+                continue;
 
             for (uint64_t i = 0; i < BL; i++){
                 for (uint64_t j = 0; j < BL; j++) {
-                    reference_l[i*BL + j] = reference[(max_cols-1) * (b_index_y*BL + i) + b_index_x*BL + j];
+                    reference_l[i*BL + j] = reference[ref_offset(layout, b_index_y*BL + i, b_index_x*BL) + j];
                 }
             }
 
-            for (uint64_t i = 0; i < BL + 1; i++){
-                for (uint64_t j = 0; j < BL + 1; j++) {
-                    input_itemsets_l[i*(BL + 1) + j] = input_itemsets[max_cols*(b_index_y*BL + i) + b_index_x*BL + j];
+            for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                for (uint64_t i = 0; i < BL + 1; i++){
+                    for (uint64_t j = 0; j < BL + 1; j++) {
+                        input_itemsets_l[m*(BL + 1)*(BL + 1) + i*(BL + 1) + j] = matrices[m][cell_offset(layout, b_index_y*BL + i, b_index_x*BL) + j];
+                    }
                 }
             }
 
             // Computation
-            for (uint64_t i = 1; i < BL + 1; i++) {
-                for (uint64_t j = 1; j < BL + 1; j++) {
-                    input_itemsets_l[i*(BL + 1) + j] = maximum(input_itemsets_l[(i-1)*(BL+1) + j - 1] + reference_l[(i-1)*BL + j - 1],
-                            input_itemsets_l[i*(BL+1) + j - 1] - penalty,
-                            input_itemsets_l[(i-1)*(BL+1) + j] - penalty);
-                }
-            }
+            nw_block_host(input_itemsets_l, reference_l, penalty, gap_open);
 
-            for (uint64_t i = 0; i < BL; i++) {
-                for (uint64_t j = 0; j < BL; j++) {
-                    input_itemsets[max_cols*(b_index_y*BL + i + 1) + b_index_x*BL + j + 1] = input_itemsets_l[(i+1)*(BL+1) + j + 1];
+            for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                for (uint64_t i = 0; i < BL; i++) {
+                    for (uint64_t j = 0; j < BL; j++) {
+                        matrices[m][cell_offset(layout, b_index_y*BL + i + 1, b_index_x*BL) + j + 1] = input_itemsets_l[m*(BL + 1)*(BL + 1) + (i+1)*(BL+1) + j + 1];
+                    }
                 }
             }
 
@@ -141,31 +517,31 @@ static void nw_host(int32_t *input_itemsets, int32_t *reference, uint64_t max_co
     for (uint64_t blk = 2; blk <= (max_cols-1)/BL; blk++) {
         for (uint64_t b_index_x = blk - 1; b_index_x < (max_cols-1)/BL; b_index_x++) {
             uint64_t b_index_y = (max_cols-1)/BL + blk - 2 - b_index_x;
+            if (!block_in_band(layout->band, b_index_y, b_index_x))
+                continue;
 
             for (uint64_t i = 0; i < BL; i++){
                 for (uint64_t j = 0; j < BL; j++) {
-                    reference_l[i*BL + j] = reference[(max_cols-1)*(b_index_y*BL + i) + b_index_x*BL + j];
+                    reference_l[i*BL + j] = reference[ref_offset(layout, b_index_y*BL + i, b_index_x*BL) + j];
                 }
             }
 
-            for (uint64_t i = 0; i < BL + 1; i++){
-                for (uint64_t j = 0; j < BL + 1; j++) {
-                    input_itemsets_l[i*(BL + 1) + j] = input_itemsets[max_cols*(b_index_y*BL + i) + b_index_x*BL + j];
+            for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                for (uint64_t i = 0; i < BL + 1; i++){
+                    for (uint64_t j = 0; j < BL + 1; j++) {
+                        input_itemsets_l[m*(BL + 1)*(BL + 1) + i*(BL + 1) + j] = matrices[m][cell_offset(layout, b_index_y*BL + i, b_index_x*BL) + j];
+                    }
                 }
             }
 
             // Computation
-            for (uint64_t i = 1; i < BL + 1; i++) {
-                for (uint64_t j = 1; j < BL + 1; j++) {
-                    input_itemsets_l[i*(BL + 1) + j] = maximum(input_itemsets_l[(i-1)*(BL+1) + j - 1] + reference_l[(i-1)*BL + j - 1],
-                            input_itemsets_l[i*(BL+1) + j - 1] - penalty,
-                            input_itemsets_l[(i-1)*(BL+1) + j] - penalty);
-                }
-            }
+            nw_block_host(input_itemsets_l, reference_l, penalty, gap_open);
 
-            for (uint64_t i = 0; i < BL; i++) {
-                for (uint64_t j = 0; j < BL; j++) {
-                    input_itemsets[max_cols*(b_index_y*BL + i + 1) + b_index_x*BL + j + 1] = input_itemsets_l[(i+1)*(BL+1) + j + 1];
+            for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                for (uint64_t i = 0; i < BL; i++) {
+                    for (uint64_t j = 0; j < BL; j++) {
+                        matrices[m][cell_offset(layout, b_index_y*BL + i + 1, b_index_x*BL) + j + 1] = input_itemsets_l[m*(BL + 1)*(BL + 1) + (i+1)*(BL+1) + j + 1];
+                    }
                 }
             }
 
@@ -179,6 +555,353 @@ static void nw_host(int32_t *input_itemsets, int32_t *reference, uint64_t max_co
     return;
 }
 
+// Batch mode: alphabet of the BLOSUM62 rows/columns
+static const char *alphabet = "ARNDCQEGHILKMFPSTWYVBZX*";
+
+// Batch mode: source of sequence pairs (input file or random generator)
+typedef struct {
+    FILE *file;
+    unsigned int nr_pairs;
+    unsigned int next_pair;
+    unsigned int max_len;
+    char *line;
+    size_t line_size;
+} pair_source_t;
+
+static void rewind_pairs(pair_source_t *src) {
+    if (src->file)
+        rewind(src->file);
+    src->next_pair = 0;
+    srand(7);
+}
+
+// Read (or generate) the next pair, encoded as BLOSUM62 indices. Return false at the end of the input
+static bool next_pair(pair_source_t *src, uint8_t *seq_a, uint32_t *len_a, uint8_t *seq_b, uint32_t *len_b) {
+    if (src->file) {
+        uint8_t *seq[2] = {seq_a, seq_b};
+        uint32_t *len[2] = {len_a, len_b};
+        char *save;
+        char *token;
+        do {
+            if (getline(&src->line, &src->line_size, src->file) < 0)
+                return false;
+        } while ((token = strtok_r(src->line, " \t\r\n", &save)) == NULL); // Skip empty lines
+        for (int s = 0; s < 2; s++) {
+            if (token == NULL) {
+                fprintf(stderr, "Pair %u: expected two sequences per line\n", src->next_pair);
+                exit(EXIT_FAILURE);
+            }
+            uint32_t l = strlen(token);
+            if (l > src->max_len) {
+                fprintf(stderr, "Pair %u: sequence of length %u is longer than N = %u (use -n)\n", src->next_pair, l, src->max_len);
+                exit(EXIT_FAILURE);
+            }
+            for (uint32_t k = 0; k < l; k++) {
+                const char *c = strchr(alphabet, toupper((unsigned char)token[k]));
+                seq[s][k] = (c != NULL && *c != '\0') ? c - alphabet : 22; // Unknown residues map to X
+            }
+            *len[s] = l;
+            token = strtok_r(NULL, " \t\r\n", &save);
+        }
+    } else {
+        if (src->next_pair == src->nr_pairs)
+            return false;
+        // Sequence b is a mutated copy of sequence a
+        *len_a = src->max_len - rand() % (src->max_len / 4 + 1);
+        *len_b = src->max_len - rand() % (src->max_len / 4 + 1);
+        for (uint32_t k = 0; k < *len_a; k++)
+            seq_a[k] = rand() % 10 + 1;
+        for (uint32_t k = 0; k < *len_b; k++)
+            seq_b[k] = (k < *len_a && rand() % 10 != 0) ? seq_a[k] : rand() % 10 + 1;
+    }
+    src->next_pair++;
+    return true;
+}
+
+// Compute the score and traceback of one pair in the host (same tie-breaking as the DPU kernel)
+static int32_t nw_pair_host(uint8_t *seq_a, uint32_t len_a, uint8_t *seq_b, uint32_t len_b, int32_t penalty,
+        int32_t *row, uint8_t *dir, char *path, uint32_t *path_len) {
+
+    for (uint32_t j = 0; j <= len_b; j++)
+        row[j] = -(int32_t)j * penalty;
+    for (uint32_t i = 1; i <= len_a; i++) {
+        int32_t diag = row[0];
+        row[0] = -(int32_t)i * penalty;
+        for (uint32_t j = 1; j <= len_b; j++) {
+            int32_t up = row[j];
+            int32_t h = diag + blosum62[seq_a[i - 1]][seq_b[j - 1]];
+            uint8_t d = DIR_DIAG;
+            if (up - penalty > h) {
+                h = up - penalty;
+                d = DIR_UP;
+            }
+            if (row[j - 1] - penalty > h) {
+                h = row[j - 1] - penalty;
+                d = DIR_LEFT;
+            }
+            dir[(i - 1) * len_b + j - 1] = d;
+            diag = up;
+            row[j] = h;
+        }
+    }
+
+    // Path from start to end
+    if (path != NULL) {
+        uint32_t k = len_a + len_b;
+        for (uint32_t i = len_a, j = len_b; i > 0 || j > 0;) {
+            uint8_t d = (i == 0) ? DIR_LEFT : (j == 0) ? DIR_UP : dir[(i - 1) * len_b + j - 1];
+            if (d == DIR_DIAG) {
+                path[--k] = OP_MATCH;
+                i--;
+                j--;
+            } else if (d == DIR_UP) {
+                path[--k] = OP_DEL;
+                i--;
+            } else {
+                path[--k] = OP_INS;
+                j--;
+            }
+        }
+        *path_len = len_a + len_b - k;
+        memmove(path, path + k, *path_len);
+    }
+    return row[len_b];
+}
+
+// Batch mode: host buffers of one batch (two of them are used for double buffering)
+typedef struct {
+    unsigned int nr_pairs;
+    unsigned int first_pair;
+    uint32_t *lens;
+    uint8_t *seqs;
+    pair_result_t *results;
+    char *paths;
+    dpu_arguments_t *args;
+} batch_t;
+
+// Fill a batch with the next pairs. Pair q of the batch goes to DPU q % nr_of_dpus
+static void prepare_batch(batch_t *b, pair_source_t *src, unsigned int nr_of_dpus, unsigned int pairs_per_dpu, uint32_t stride, unsigned int penalty, unsigned int traceback) {
+    b->first_pair = src->next_pair;
+    b->nr_pairs = 0;
+    for (unsigned int q = 0; q < nr_of_dpus * pairs_per_dpu; q++) {
+        uint64_t slot = (uint64_t)(q % nr_of_dpus) * pairs_per_dpu + q / nr_of_dpus;
+        if (!next_pair(src, b->seqs + slot * 2 * stride, &b->lens[slot * 2], b->seqs + slot * 2 * stride + stride, &b->lens[slot * 2 + 1]))
+            break;
+        b->nr_pairs++;
+    }
+    for (unsigned int i = 0; i < nr_of_dpus; i++) {
+        b->args[i].nblocks = 0;
+        b->args[i].active_blocks = 0;
+        b->args[i].penalty = penalty;
+        b->args[i].kernel = kernel2;
+        b->args[i].nr_pairs = b->nr_pairs / nr_of_dpus + (i < b->nr_pairs % nr_of_dpus ? 1 : 0);
+        b->args[i].max_pairs = pairs_per_dpu;
+        b->args[i].stride = stride;
+        b->args[i].traceback = traceback;
+    }
+}
+
+// Copy a batch to the DPUs, launch the kernel and queue the retrieval of results (all asynchronous)
+static void launch_batch(struct dpu_set_t dpu_set, batch_t *b, unsigned int pairs_per_dpu, uint32_t stride, unsigned int traceback) {
+    struct dpu_set_t dpu;
+    unsigned int i = 0;
+    uint32_t mram_offset_seqs = pairs_per_dpu * 2 * sizeof(uint32_t);
+    uint32_t mram_offset_results = mram_offset_seqs + pairs_per_dpu * 2 * stride;
+    uint32_t mram_offset_paths = mram_offset_results + pairs_per_dpu * sizeof(pair_result_t);
+
+    DPU_FOREACH(dpu_set, dpu, i) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, b->args + i));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(dpu_arguments_t), DPU_XFER_ASYNC));
+    DPU_FOREACH(dpu_set, dpu, i) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, b->lens + (uint64_t)i * pairs_per_dpu * 2));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, pairs_per_dpu * 2 * sizeof(uint32_t), DPU_XFER_ASYNC));
+    DPU_FOREACH(dpu_set, dpu, i) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, b->seqs + (uint64_t)i * pairs_per_dpu * 2 * stride));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset_seqs, pairs_per_dpu * 2 * stride, DPU_XFER_ASYNC));
+
+    DPU_ASSERT(dpu_launch(dpu_set, DPU_ASYNCHRONOUS));
+
+    DPU_FOREACH(dpu_set, dpu, i) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, b->results + (uint64_t)i * pairs_per_dpu));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset_results, pairs_per_dpu * sizeof(pair_result_t), DPU_XFER_ASYNC));
+    if (traceback) {
+        DPU_FOREACH(dpu_set, dpu, i) {
+            DPU_ASSERT(dpu_prepare_xfer(dpu, b->paths + (uint64_t)i * pairs_per_dpu * 2 * stride));
+        }
+        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset_paths, pairs_per_dpu * 2 * stride, DPU_XFER_ASYNC));
+    }
+}
+
+// Consume the results of a batch: put paths in start-to-end order and, if requested, compare with the host
+static bool check_batch(batch_t *b, unsigned int nr_of_dpus, unsigned int pairs_per_dpu, uint32_t stride, unsigned int penalty, unsigned int traceback,
+        bool check, int32_t *row, uint8_t *dir, char *path, Timer *timer, FILE *fpo) {
+    bool status = true;
+    for (unsigned int q = 0; q < b->nr_pairs; q++) {
+        uint64_t slot = (uint64_t)(q % nr_of_dpus) * pairs_per_dpu + q / nr_of_dpus;
+        pair_result_t *result = &b->results[slot];
+        char *dpu_path = b->paths + slot * 2 * stride;
+        if (traceback) {
+            for (uint32_t k = 0; k < result->path_len / 2; k++) {
+                char c = dpu_path[k];
+                dpu_path[k] = dpu_path[result->path_len - 1 - k];
+                dpu_path[result->path_len - 1 - k] = c;
+            }
+        }
+        if (!check)
+            continue;
+
+        uint32_t path_len = 0;
+        start(timer, 0, 1);
+        int32_t score = nw_pair_host(b->seqs + slot * 2 * stride, b->lens[slot * 2], b->seqs + slot * 2 * stride + stride, b->lens[slot * 2 + 1],
+                penalty, row, dir, traceback ? path : NULL, &path_len);
+        stop(timer, 0);
+        if (score != result->score || (traceback && (path_len != result->path_len || memcmp(path, dpu_path, path_len) != 0))) {
+            status = false;
+#if PRINT
+            printf("Pair %u: host score %d, DPU score %d\n", b->first_pair + q, score, result->score);
+#endif
+        }
+#if PRINT_FILE
+        fprintf(fpo, "%d", result->score);
+        if (traceback)
+            fprintf(fpo, " %.*s", result->path_len, dpu_path);
+        fprintf(fpo, "\n");
+#else
+        (void)fpo;
+#endif
+    }
+    return status;
+}
+
+// Run all batches of the input. The DPUs work on batch k while the host prepares batch k+1 and consumes batch k-1
+static bool run_batches(struct dpu_set_t dpu_set, batch_t *batches, pair_source_t *src, unsigned int nr_of_dpus, unsigned int pairs_per_dpu, uint32_t stride,
+        unsigned int penalty, unsigned int traceback, bool check, int32_t *row, uint8_t *dir, char *path, Timer *timer, uint64_t *cells) {
+    bool status = true;
+    FILE *fpo = NULL;
+#if PRINT_FILE
+    if (check)
+        fpo = fopen("./bin/dpu_batch_output.txt", "w");
+#endif
+    rewind_pairs(src);
+    *cells = 0;
+    prepare_batch(&batches[0], src, nr_of_dpus, pairs_per_dpu, stride, penalty, traceback);
+    for (unsigned int k = 0; batches[k & 1].nr_pairs > 0; k++) {
+        batch_t *curr = &batches[k & 1];
+        batch_t *other = &batches[(k + 1) & 1];
+        for (unsigned int q = 0; q < curr->nr_pairs; q++) {
+            uint64_t slot = (uint64_t)(q % nr_of_dpus) * pairs_per_dpu + q / nr_of_dpus;
+            *cells += (uint64_t)curr->lens[slot * 2] * curr->lens[slot * 2 + 1];
+        }
+
+        launch_batch(dpu_set, curr, pairs_per_dpu, stride, traceback);
+
+        // Overlap with the DPUs: consume the previous batch, then reuse its buffers for the next one
+        if (k > 0)
+            status &= check_batch(other, nr_of_dpus, pairs_per_dpu, stride, penalty, traceback, check, row, dir, path, timer, fpo);
+        prepare_batch(other, src, nr_of_dpus, pairs_per_dpu, stride, penalty, traceback);
+
+        DPU_ASSERT(dpu_sync(dpu_set));
+        if (other->nr_pairs == 0)
+            status &= check_batch(curr, nr_of_dpus, pairs_per_dpu, stride, penalty, traceback, check, row, dir, path, timer, fpo);
+    }
+#if PRINT_FILE
+    if (fpo)
+        fclose(fpo);
+#endif
+    return status;
+}
+
+// Main of the batch mode
+static int batch_main(struct Params p, struct dpu_set_t dpu_set, uint32_t nr_of_dpus) {
+
+    uint32_t stride = roundup8(p.max_rows);
+    unsigned int penalty = p.penalty;
+    unsigned int traceback = p.traceback;
+    pair_source_t src = {NULL, p.nr_pairs, 0, p.max_rows, NULL, 0};
+    if (p.file_name) {
+        src.file = fopen(p.file_name, "r");
+        if (src.file == NULL) {
+            fprintf(stderr, "Cannot open input file %s\n", p.file_name);
+            return -1;
+        }
+    }
+
+    // Fit the batch (and the per-tasklet scratch) in MRAM
+    uint64_t scratch_bytes = (uint64_t) NR_TASKLETS * (BATCH_COL_BYTES(stride) + (traceback ? BATCH_DIR_BYTES(stride) : 0));
+    uint64_t pair_bytes = 2 * sizeof(uint32_t) + 2 * stride + sizeof(pair_result_t) + (traceback ? 2 * stride : 0);
+    if (scratch_bytes + pair_bytes > DPU_CAPACITY) {
+        fprintf(stderr, "Sequences of length %u do not fit in MRAM\n", p.max_rows);
+        return -1;
+    }
+    unsigned int pairs_per_dpu = p.batch_pairs;
+    if (scratch_bytes + pairs_per_dpu * pair_bytes > DPU_CAPACITY) {
+        pairs_per_dpu = (DPU_CAPACITY - scratch_bytes) / pair_bytes;
+        printf("Batch reduced to %u pairs per DPU to fit in MRAM\n", pairs_per_dpu);
+    }
+    printf("Batch mode: max. length %u, %u pairs per DPU per batch, traceback %s\n", p.max_rows, pairs_per_dpu, traceback ? "on" : "off");
+
+    batch_t batches[2];
+    for (int k = 0; k < 2; k++) {
+        batches[k].nr_pairs = 0;
+        batches[k].lens = (uint32_t *) malloc((uint64_t)nr_of_dpus * pairs_per_dpu * 2 * sizeof(uint32_t));
+        batches[k].seqs = (uint8_t *) calloc((uint64_t)nr_of_dpus * pairs_per_dpu * 2 * stride, sizeof(uint8_t));
+        batches[k].results = (pair_result_t *) malloc((uint64_t)nr_of_dpus * pairs_per_dpu * sizeof(pair_result_t));
+        batches[k].paths = traceback ? (char *) malloc((uint64_t)nr_of_dpus * pairs_per_dpu * 2 * stride) : NULL;
+        batches[k].args = (dpu_arguments_t *) malloc(nr_of_dpus * sizeof(dpu_arguments_t));
+    }
+    int32_t *row = (int32_t *) malloc((stride + 1) * sizeof(int32_t));
+    uint8_t *dir = (uint8_t *) malloc((uint64_t)stride * stride);
+    char *path = (char *) malloc(2 * stride);
+    uint64_t cells = 0;
+
+    // Timer
+    Timer timer;
+    for (unsigned int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
+        if (rep >= p.n_warmup)
+            start(&timer, 1, rep - p.n_warmup);
+        run_batches(dpu_set, batches, &src, nr_of_dpus, pairs_per_dpu, stride, penalty, traceback, false, row, dir, path, &timer, &cells);
+        if (rep >= p.n_warmup)
+            stop(&timer, 1);
+    }
+
+    // Check output (untimed pass that compares every pair with the host)
+    timer.time[0] = 0.0;
+    bool status = run_batches(dpu_set, batches, &src, nr_of_dpus, pairs_per_dpu, stride, penalty, traceback, true, row, dir, path, &timer, &cells);
+
+    // Print timing results
+    printf("Pairs %u\t", src.next_pair);
+    printf("CPU version ");
+    print(&timer, 0, 1);
+    printf("DPU batches (CPU-DPU + DPU Kernel + DPU-CPU, overlapped) ");
+    print(&timer, 1, p.n_reps);
+    printf("GCUPS: %f\n", (double)cells * p.n_reps / (timer.time[1] * 1000.0));
+
+    if (status) {
+        printf("[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] Outputs are equal\n");
+    } else {
+        printf("[" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] Outputs differ!\n");
+    }
+
+    for (int k = 0; k < 2; k++) {
+        free(batches[k].lens);
+        free(batches[k].seqs);
+        free(batches[k].results);
+        free(batches[k].paths);
+        free(batches[k].args);
+    }
+    free(row);
+    free(dir);
+    free(path);
+    free(src.line);
+    if (src.file)
+        fclose(src.file);
+    return status ? 0 : -1;
+}
+
 // Main of the Host Application
 int main(int argc, char **argv) {
 
@@ -197,6 +920,14 @@ int main(int argc, char **argv) {
     DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus));
     printf("Allocated %d DPU(s)\n", nr_of_dpus);
     printf("Allocated %d TASKLET(s) per DPU\n", NR_TASKLETS);
+
+    // Batch mode: independent alignments of many sequence pairs
+    if (p.file_name != NULL || p.nr_pairs > 0) {
+        int ret = batch_main(p, dpu_set, nr_of_dpus);
+        DPU_ASSERT(dpu_free(dpu_set));
+        return ret;
+    }
+
 #if DYNAMIC
     max_dpus = nr_of_dpus;
 #endif
@@ -204,9 +935,44 @@ int main(int argc, char **argv) {
     uint64_t max_rows = p.max_rows + 1;
     uint64_t max_cols = p.max_rows + 1;
     unsigned int penalty = p.penalty;
-    int32_t *reference = (int32_t *) malloc(max_rows * max_cols * sizeof(int32_t));
-    int32_t *input_itemsets_host = (int32_t *) malloc(max_rows * max_cols * sizeof(int32_t));
-    int32_t *input_itemsets = (int32_t *) malloc((max_rows+1) * (max_cols+1) * sizeof(int32_t));
+
+    // Banded mode: only the blocks within band blocks of the main diagonal are computed,
+    // transferred and stored (band rounded up to whole blocks)
+    int64_t band = (p.band > 0) ? (int64_t) ((p.band + BL - 1) / BL) : -1;
+    layout_t host_layout = {max_cols, max_cols - 1, band};
+    layout_t dpu_layout = {max_cols + 1, max_cols - 1, band};
+    uint64_t host_elems = max_rows * max_cols;
+    uint64_t dpu_elems = (max_rows+1) * (max_cols+1);
+    uint64_t ref_elems = max_rows * max_cols;
+    if (band >= 0) {
+        host_layout.ld = dpu_layout.ld = (2 * band + 4) * BL;
+        host_layout.ld_ref = dpu_layout.ld_ref = (2 * band + 1) * BL;
+        host_elems = dpu_elems = (max_rows+1) * host_layout.ld;
+        ref_elems = (max_rows-1) * host_layout.ld_ref;
+        printf("Banded mode: %ld blocks (%ld cells) around the main diagonal, %lu MB per matrix\n", band, band * BL, dpu_elems * sizeof(int32_t) >> 20);
+    }
+
+    int32_t *reference = (int32_t *) malloc(ref_elems * sizeof(int32_t));
+    int32_t *input_itemsets_host = (int32_t *) malloc(host_elems * sizeof(int32_t));
+    int32_t *input_itemsets = (int32_t *) malloc(dpu_elems * sizeof(int32_t));
+#ifdef AFFINE
+    // Gap matrices of the affine-gap scheme
+    int32_t *input_e_host = (int32_t *) malloc(host_elems * sizeof(int32_t));
+    int32_t *input_f_host = (int32_t *) malloc(host_elems * sizeof(int32_t));
+    int32_t *input_e = (int32_t *) malloc(dpu_elems * sizeof(int32_t));
+    int32_t *input_f = (int32_t *) malloc(dpu_elems * sizeof(int32_t));
+    int32_t *matrices_host[NR_MATRICES] = {input_itemsets_host, input_e_host, input_f_host};
+    int32_t *matrices[NR_MATRICES] = {input_itemsets, input_e, input_f};
+#else
+    int32_t *matrices_host[NR_MATRICES] = {input_itemsets_host};
+    int32_t *matrices[NR_MATRICES] = {input_itemsets};
+#endif
+    unsigned int gap_open = p.gap_open;
+#ifdef LOCAL
+    // Best cell of the local alignment: per-tasklet results of the DPUs and reductions
+    dpu_results_t *results = (dpu_results_t *) malloc(nr_of_dpus * NR_TASKLETS * sizeof(dpu_results_t));
+    dpu_results_t best = {0, 0, 0, 0}, best_host = {0, 0, 0, 0};
+#endif
     dpu_arguments_t *input_args = (dpu_arguments_t *) malloc(nr_of_dpus * sizeof(dpu_arguments_t));
     printf("Max size %d\n", p.max_rows);
 
@@ -216,6 +982,15 @@ int main(int argc, char **argv) {
     memset(traceback_output, 0, (max_rows + max_cols) * sizeof(int32_t));
     memset(traceback_output_host, 0, (max_rows + max_cols) * sizeof(int32_t));
 
+    // Linear-memory (Hirschberg) traceback of the banded mode
+    bool linear_traceback = (band >= 0);
+    hirschberg_t hb = {reference, &dpu_layout, max_rows - 1, (int32_t) penalty, {NULL, NULL, NULL, NULL}, NULL, 0};
+    if (linear_traceback) {
+        for (int k = 0; k < 4; k++)
+            hb.rows[k] = (int32_t *) malloc(max_cols * sizeof(int32_t));
+        hb.ops = (char *) malloc(max_rows + max_cols);
+    }
+
     // This array is used for dummy/stale CPU-DPU transfers
     int32_t *dummy = (int32_t *) malloc(nr_of_dpus * (BL+2) * sizeof(int32_t));
     unsigned int blocks_per_dpu;
@@ -232,55 +1007,112 @@ int main(int argc, char **argv) {
     for (unsigned int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
 
         // Initializing inputs are needed at each iteration
-        // Initialize input itemsets
-        for(unsigned int i = 0; i < max_rows; i++) {
-            for (unsigned int j = 0; j < max_cols; j++) {
-                input_itemsets_host[i * max_cols + j] = 0; 
+        if (band >= 0) {
+            init_banded(input_itemsets_host, input_itemsets, reference, &dpu_layout, max_rows + 1, max_rows - 1, penalty);
+        } else {
+            // Initialize input itemsets
+            for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                for(unsigned int i = 0; i < max_rows; i++) {
+                    for (unsigned int j = 0; j < max_cols; j++) {
+                        matrices_host[m][i * max_cols + j] = 0; 
+                    }
+                }
+
+                for(unsigned int i = 0; i <= max_rows; i++) {
+                    for (unsigned int j = 0; j <= max_cols; j++) {
+                        matrices[m][i * (max_cols+1) + j] = 0; 
+                    }
+                }
             }
-        }
 
-        for(unsigned int i = 0; i <= max_rows; i++) {
-            for (unsigned int j = 0; j <= max_cols; j++) {
-                input_itemsets[i * (max_cols+1) + j] = 0; 
+            // Define random sequences
+            srand(7);
+            for (unsigned int i = 1; i < max_rows; i++) {
+                input_itemsets_host[i * max_cols] = rand() % 10 + 1;
             }
-        }
 
-        // Define random sequences
-        srand(7);
-        for (unsigned int i = 1; i < max_rows; i++) {
-            input_itemsets_host[i * max_cols] = rand() % 10 + 1;
-        }
+            for (unsigned int j = 1; j < max_cols; j++) {
+                input_itemsets_host[j] = rand() % 10 + 1;
+            }   
+
+            for (unsigned int i = 0; i < max_rows-1; i++) {
+                for (unsigned int j = 0; j < max_cols-1; j++) {
+                    reference[i * (max_cols-1) + j] = blosum62[input_itemsets_host[(i+1) * max_cols]][input_itemsets_host[j+1]];
+                }
+            }
 
-        for (unsigned int j = 1; j < max_cols; j++) {
-            input_itemsets_host[j] = rand() % 10 + 1;
-        }   
+#if defined(LOCAL)
+            // Local alignment: zero boundaries
+            for (unsigned int i = 1; i < max_rows; i++) {
+                input_itemsets_host[i * max_cols] = 0;
+            }
 
-        for (unsigned int i = 0; i < max_rows-1; i++) {
-            for (unsigned int j = 0; j < max_cols-1; j++) {
-                reference[i * (max_cols-1) + j] = blosum62[input_itemsets[(i+1) * max_cols]][input_itemsets[j+1]];
+            for (unsigned int j = 1; j < max_cols; j++) {
+                input_itemsets_host[j] = 0;
+            }
+#elif defined(AFFINE)
+            // A leading gap of length n costs gap_open + n * penalty
+            for (unsigned int i = 1; i < max_rows; i++) {
+                input_itemsets_host[i * max_cols] = input_e_host[i * max_cols] = -(gap_open + i * penalty);
+                input_itemsets[i * (max_cols+1)] = input_e[i * (max_cols+1)] = -(gap_open + i * penalty);
+                input_f_host[i * max_cols] = input_f[i * (max_cols+1)] = MINUS_INF;
             }
-        }
 
-        for (unsigned int i = 1; i < max_rows; i++) {
-            input_itemsets_host[i * max_cols] = -i * penalty;
-            input_itemsets[i * (max_cols+1)] = -i * penalty;
-        }
+            for (unsigned int j = 1; j < max_cols; j++) {
+                input_itemsets_host[j] = input_f_host[j] = -(gap_open + j * penalty);
+                input_itemsets[j] = input_f[j] = -(gap_open + j * penalty);
+                input_e_host[j] = input_e[j] = MINUS_INF;
+            }
+            input_e_host[0] = input_e[0] = input_f_host[0] = input_f[0] = MINUS_INF;
+#else
+            for (unsigned int i = 1; i < max_rows; i++) {
+                input_itemsets_host[i * max_cols] = -i * penalty;
+                input_itemsets[i * (max_cols+1)] = -i * penalty;
+            }
 
-        for (unsigned int j = 1; j < max_cols; j++) {
-            input_itemsets_host[j] = -j * penalty;
-            input_itemsets[j] = -j * penalty;
+            for (unsigned int j = 1; j < max_cols; j++) {
+                input_itemsets_host[j] = -j * penalty;
+                input_itemsets[j] = -j * penalty;
+            }
+#endif
+#ifdef LOCAL
+            best.max = best_host.max = 0;
+            best.row = best_host.row = 0;
+            best.col = best_host.col = 0;
+#endif
         }
 
         if (rep >= p.n_warmup)
             start(&timer, 0, rep - p.n_warmup);
         // Computation on host CPU
-        nw_host(input_itemsets_host, reference, max_cols, penalty);
+        nw_host(matrices_host, reference, &host_layout, max_cols, penalty, gap_open);
+#ifdef LOCAL
+        for (uint64_t i = 1; i < max_rows; i++) {
+            for (uint64_t j = 1; j < max_cols; j++) {
+                if (BETTER_CELL(input_itemsets_host[i * max_cols + j], i, j, best_host.max, best_host.row, best_host.col)) {
+                    best_host.max = input_itemsets_host[i * max_cols + j];
+                    best_host.row = i;
+                    best_host.col = j;
+                }
+            }
+        }
+#endif
 
         // Print host output
 #if PRINT_FILE
         if (rep >= p.n_warmup) {
             char *host_file = "./bin/host_output.txt";
+#if defined(AFFINE) || defined(LOCAL)
+            FILE *fpo = fopen(host_file, "w");
+#ifdef LOCAL
+            traceback_scheme(traceback_output_host, fpo, matrices_host, reference, max_cols, max_cols - 1, best_host.row, best_host.col, penalty, gap_open);
+#else
+            traceback_scheme(traceback_output_host, fpo, matrices_host, reference, max_cols, max_cols - 1, max_rows - 1, max_cols - 1, penalty, gap_open);
+#endif
+            fclose(fpo);
+#else
             traceback(traceback_output_host, host_file, input_itemsets_host, reference, max_rows, max_cols, penalty);
+#endif
         }
 #endif
         if (rep >= p.n_warmup)
@@ -288,10 +1120,16 @@ int main(int argc, char **argv) {
 
         // Top-left computation on DPUs
         for (unsigned int blk = 1; blk <= (max_cols-1)/BL; blk++) {
+            // Blocks of this diagonal (within the band in banded mode)
+            unsigned int diag_first;
+            unsigned int diag = blk - 1;
+            unsigned int diag_blocks = diagonal_blocks(band, diag, 0, blk - 1, &diag_first);
+            if (diag_blocks == 0)
+                continue;
 #if DYNAMIC 
             // If nr_of_blocks are lower than max_dpus,
             // set nr_of_dpus to be equal with nr_of_blocks
-            unsigned nr_of_blocks = blk;
+            unsigned nr_of_blocks = diag_blocks;
             if (nr_of_blocks < max_dpus) {
                 DPU_ASSERT(dpu_free(dpu_set));
                 DPU_ASSERT(dpu_alloc(nr_of_blocks, NULL, &dpu_set));
@@ -313,26 +1151,33 @@ int main(int argc, char **argv) {
             // Copy data to DPUs
             unsigned int i=0;
             DPU_FOREACH(dpu_set, dpu, i) {
-                unsigned int blocks_per_dpu = blk / nr_of_dpus;
-                unsigned int active_blocks_per_dpu = blk / nr_of_dpus;
-                unsigned int rest_blocks = blk % nr_of_dpus;
+                unsigned int blocks_per_dpu = diag_blocks / nr_of_dpus;
+                unsigned int active_blocks_per_dpu = diag_blocks / nr_of_dpus;
+                unsigned int rest_blocks = diag_blocks % nr_of_dpus;
                 if(i < rest_blocks)
                     blocks_per_dpu++;
 
                 if(rest_blocks != 0)
                     active_blocks_per_dpu++;
 
+                // First block of this DPU
+                unsigned int first_block = (i < rest_blocks) ? i * (diag_blocks / nr_of_dpus + 1) : rest_blocks * (diag_blocks / nr_of_dpus + 1) + (i - rest_blocks) * (diag_blocks / nr_of_dpus);
+
                 // Copy input arguments to dpu
                 input_args[i].nblocks = blocks_per_dpu;
                 input_args[i].active_blocks = active_blocks_per_dpu;
                 input_args[i].penalty = penalty;
+                input_args[i].gap_open = gap_open;
+                input_args[i].block_col = diag_first + first_block;
+                input_args[i].block_row = blk - 1 - (diag_first + first_block);
+                input_args[i].kernel = kernel1;
                 DPU_ASSERT(dpu_prepare_xfer(dpu, input_args + i));
             } 
             DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(dpu_arguments_t), DPU_XFER_DEFAULT));
 
             // Copy itemsets to DPUs
-            blocks_per_dpu = blk / nr_of_dpus;
-            if (blk % nr_of_dpus != 0)
+            blocks_per_dpu = diag_blocks / nr_of_dpus;
+            if (diag_blocks % nr_of_dpus != 0)
                 blocks_per_dpu++;
             mram_offset = 0;
 
@@ -354,48 +1199,50 @@ int main(int argc, char **argv) {
 
 #if PRINT
             uint64_t total_dpu_memory = 0;
-            total_dpu_memory = (uint64_t) blocks_per_dpu * (BL+1) * (BL+2) * sizeof(int32_t) + (uint64_t) blocks_per_dpu * BL * BL * sizeof(int32_t);
+            total_dpu_memory = (uint64_t) blocks_per_dpu * NR_MATRICES * (BL+1) * (BL+2) * sizeof(int32_t) + (uint64_t) blocks_per_dpu * BL * BL * sizeof(int32_t);
             printf("Total memory allocated in each DPU %u bytes\n", total_dpu_memory);
 #endif
             for (unsigned int bl_indx = 0; bl_indx < blocks_per_dpu; bl_indx++) {
-                for (unsigned int bl = 0; bl < BL + 1; bl++) {
+                for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                    for (unsigned int bl = 0; bl < BL + 1; bl++) {
+
+                        i = 0;
+                        DPU_FOREACH(dpu_set, dpu, i) {
+                            unsigned int chunks = diag_blocks / nr_of_dpus;
+                            unsigned int prev_block_index = 0;
+                            unsigned int rest_blocks = diag_blocks % nr_of_dpus;
+                            if (rest_blocks > 0) {
+                                if (i >= rest_blocks) {
+                                    prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                                } else {
+                                    prev_block_index = i * (chunks + 1);
+                                }
+                            } else {
+                                prev_block_index = i * blocks_per_dpu; 
+                            }
 
-                    i = 0;
-                    DPU_FOREACH(dpu_set, dpu, i) {
-                        unsigned int chunks = blk / nr_of_dpus;
-                        unsigned int prev_block_index = 0;
-                        unsigned int rest_blocks = blk % nr_of_dpus;
-                        if (rest_blocks > 0) {
-                            if (i >= rest_blocks) {
-                                prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                            uint64_t input_itemsets_offset = 0;  
+                            int32_t *dpu_pointer;  
+                            if (i + bl_indx * nr_of_dpus >= diag_blocks) {
+                                dpu_pointer = dummy;
+                                input_itemsets_offset = 0;  
                             } else {
-                                prev_block_index = i * (chunks + 1);
+                                uint64_t b_index_x = diag_first + prev_block_index + bl_indx;
+                                uint64_t b_index_y = blk - 1 - b_index_x;
+                                dpu_pointer = matrices[m];
+                                input_itemsets_offset = cell_offset(&dpu_layout, b_index_y * BL + bl, b_index_x * BL);  
                             }
-                        } else {
-                            prev_block_index = i * blocks_per_dpu; 
-                        }
 
-                        uint64_t input_itemsets_offset = 0;  
-                        int32_t *dpu_pointer;  
-                        if (i + bl_indx * nr_of_dpus >= blk) {
-                            dpu_pointer = dummy;
-                            input_itemsets_offset = 0;  
-                        } else {
-                            uint64_t b_index_x =  prev_block_index + bl_indx;
-                            uint64_t b_index_y = blk - 1 - b_index_x;
-                            dpu_pointer = input_itemsets;
-                            input_itemsets_offset = b_index_y * (max_cols+1) * BL + b_index_x * BL + bl * (max_cols + 1);  
+                            DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
                         }
 
-                        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
-                    }
-
-                    if (bl == 0) 
-                        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
-                    else
-                        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, 2 * sizeof(int32_t), DPU_XFER_DEFAULT));
-                    mram_offset += ((BL+2) * sizeof(int32_t));
+                        if (bl == 0) 
+                            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
+                        else
+                            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, 2 * sizeof(int32_t), DPU_XFER_DEFAULT));
+                        mram_offset += ((BL+2) * sizeof(int32_t));
 
+                    }
                 }
             }
             if (rep >= p.n_warmup) {
@@ -421,15 +1268,15 @@ int main(int argc, char **argv) {
                 }
             }
             // Copy reference to DPUs
-            mram_offset = blocks_per_dpu * (BL+1) * (BL+2) * sizeof(int32_t); 
+            mram_offset = blocks_per_dpu * NR_MATRICES * (BL+1) * (BL+2) * sizeof(int32_t); 
             for (unsigned int bl_indx = 0; bl_indx < blocks_per_dpu; bl_indx++) {
                 for (unsigned int bl = 0; bl < BL; bl++) {
 
                     i = 0;
                     DPU_FOREACH(dpu_set, dpu, i) {
-                        unsigned int chunks = blk / nr_of_dpus;
+                        unsigned int chunks = diag_blocks / nr_of_dpus;
                         unsigned int prev_block_index = 0;
-                        unsigned int rest_blocks = blk % nr_of_dpus;
+                        unsigned int rest_blocks = diag_blocks % nr_of_dpus;
                         if (rest_blocks > 0) {
                             if (i >= rest_blocks) {
                                 prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
@@ -442,14 +1289,14 @@ int main(int argc, char **argv) {
 
                         uint64_t reference_offset = 0;  
                         int32_t *dpu_pointer;  
-                        if (i + bl_indx * nr_of_dpus >= blk) {
+                        if (i + bl_indx * nr_of_dpus >= diag_blocks) {
                             dpu_pointer = dummy;
                             reference_offset = 0;  
                         } else {
-                            uint64_t b_index_x =  prev_block_index + bl_indx;
+                            uint64_t b_index_x = diag_first + prev_block_index + bl_indx;
                             uint64_t b_index_y = blk - 1 - b_index_x;
                             dpu_pointer = reference;
-                            reference_offset = b_index_y * (max_cols - 1) * BL + b_index_x * BL + bl * (max_cols - 1);  
+                            reference_offset = ref_offset(&dpu_layout, b_index_y * BL + bl, b_index_x * BL);  
                         }
 
                         DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + reference_offset));
@@ -520,49 +1367,67 @@ int main(int argc, char **argv) {
             // Copy output result to Host CPU
             mram_offset = 0;
             for (unsigned int bl_indx = 0; bl_indx < blocks_per_dpu; bl_indx++) {
-                for (unsigned int bl = 0; bl < BL + 1; bl++) {
+                for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                    for (unsigned int bl = 0; bl < BL + 1; bl++) {
+
+                        i = 0;
+                        DPU_FOREACH(dpu_set, dpu, i) {
+                            unsigned int chunks = diag_blocks / nr_of_dpus;
+                            unsigned int prev_block_index = 0;
+                            unsigned int rest_blocks = diag_blocks % nr_of_dpus;
+                            if (rest_blocks > 0) {
+                                if (i >= rest_blocks) {
+                                    prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                                } else {
+                                    prev_block_index = i * (chunks + 1);
+                                }
+                            } else {
+                                prev_block_index = i * blocks_per_dpu; 
+                            }
 
-                    i = 0;
-                    DPU_FOREACH(dpu_set, dpu, i) {
-                        unsigned int chunks = blk / nr_of_dpus;
-                        unsigned int prev_block_index = 0;
-                        unsigned int rest_blocks = blk % nr_of_dpus;
-                        if (rest_blocks > 0) {
-                            if (i >= rest_blocks) {
-                                prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                            uint64_t input_itemsets_offset = 0;  
+                            int32_t *dpu_pointer;  
+                            if (i + bl_indx * nr_of_dpus >= diag_blocks) {
+                                dpu_pointer = dummy;
+                                input_itemsets_offset = 0;  
                             } else {
-                                prev_block_index = i * (chunks + 1);
+                                uint64_t b_index_x = diag_first + prev_block_index + bl_indx;
+                                uint64_t b_index_y = blk - 1 - b_index_x;
+                                dpu_pointer = matrices[m];
+                                input_itemsets_offset = cell_offset(&dpu_layout, b_index_y * BL + bl, b_index_x * BL);  
                             }
-                        } else {
-                            prev_block_index = i * blocks_per_dpu; 
-                        }
 
-                        uint64_t input_itemsets_offset = 0;  
-                        int32_t *dpu_pointer;  
-                        if (i + bl_indx * nr_of_dpus >= blk) {
-                            dpu_pointer = dummy;
-                            input_itemsets_offset = 0;  
-                        } else {
-                            uint64_t b_index_x =  prev_block_index + bl_indx;
-                            uint64_t b_index_y = blk - 1 - b_index_x;
-                            dpu_pointer = input_itemsets;
-                            input_itemsets_offset = b_index_y * (max_cols+1) * BL + b_index_x * BL + bl * (max_cols + 1);  
-                        }
+                            if (bl == 0) // Skip the first row of the block
+                                continue;
+                            DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
 
-                        if (bl == 0) // Skip the first row of the block
+                        }
+                        if (bl == 0) {
+                            mram_offset += (BL+2) * sizeof(int32_t);
                             continue;
-                        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
-
-                    }
-                    if (bl == 0) {
+                        }
+                        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
                         mram_offset += (BL+2) * sizeof(int32_t);
-                        continue;
-                    }
-                    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
-                    mram_offset += (BL+2) * sizeof(int32_t);
 
+                    }
                 }
             }
+            // Banded mode: the last column pulled with a block is the first one of its right
+            // neighbor, which has to stay MINUS_INF when that block is outside the band
+            if (band >= 0)
+                band_edge(input_itemsets, &dpu_layout, diag, diag_first + diag_blocks - 1);
+#ifdef LOCAL
+            // Best cell of the local alignment so far
+            i = 0;
+            DPU_FOREACH(dpu_set, dpu, i) {
+                DPU_ASSERT(dpu_prepare_xfer(dpu, results + i * NR_TASKLETS));
+            }
+            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_RESULTS", 0, NR_TASKLETS * sizeof(dpu_results_t), DPU_XFER_DEFAULT));
+            for (unsigned int t = 0; t < nr_of_dpus * NR_TASKLETS; t++) {
+                if (BETTER_CELL(results[t].max, results[t].row, results[t].col, best.max, best.row, best.col))
+                    best = results[t];
+            }
+#endif
             if (rep >= p.n_warmup) {
                 stop(&timer, 4);
                 // Timer for longest diagonal
@@ -575,10 +1440,16 @@ int main(int argc, char **argv) {
 
         // Bottom-right computation on DPUs
         for (unsigned int blk = 2; blk <= (max_cols-1)/BL; blk++) {
+            // Blocks of this diagonal (within the band in banded mode)
+            unsigned int diag_first;
+            unsigned int diag = (max_cols-1)/BL + blk - 2;
+            unsigned int diag_blocks = diagonal_blocks(band, diag, blk - 1, (max_cols-1)/BL - 1, &diag_first);
+            if (diag_blocks == 0)
+                continue;
 #if DYNAMIC
             // If nr_of_blocks are lower than max_dpus,
             // set nr_of_dpus to be equal with nr_of_blocks
-            unsigned nr_of_blocks = (((max_cols-1)/BL) - blk + 1);
+            unsigned nr_of_blocks = diag_blocks;
             if (nr_of_blocks < max_dpus) {
                 DPU_ASSERT(dpu_free(dpu_set));
                 DPU_ASSERT(dpu_alloc(nr_of_blocks, NULL, &dpu_set));
@@ -593,26 +1464,33 @@ int main(int argc, char **argv) {
                 DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus));
             }
 #if PRINT
-            printf("Allocated %d DPU(s) for %d (%d) blocks\n", nr_of_dpus, nr_of_blocks, (((max_cols-1)/BL) - blk + 1));
+            printf("Allocated %d DPU(s) for %d (%d) blocks\n", nr_of_dpus, nr_of_blocks, diag_blocks);
 #endif
 #endif
 
             // Copy data to DPUs
             unsigned int i=0;
             DPU_FOREACH(dpu_set, dpu, i) {
-                unsigned int blocks_per_dpu = (((max_cols-1)/BL) - blk + 1) / nr_of_dpus;
-                unsigned int active_blocks_per_dpu = (((max_cols-1)/BL) - blk + 1) / nr_of_dpus;
-                unsigned int rest_blocks = (((max_cols-1)/BL) - blk + 1) % nr_of_dpus;
+                unsigned int blocks_per_dpu = diag_blocks / nr_of_dpus;
+                unsigned int active_blocks_per_dpu = diag_blocks / nr_of_dpus;
+                unsigned int rest_blocks = diag_blocks % nr_of_dpus;
                 if(i < rest_blocks)
                     blocks_per_dpu++;
 
                 if(rest_blocks != 0)
                     active_blocks_per_dpu++;
 
+                // First block of this DPU
+                unsigned int first_block = (i < rest_blocks) ? i * (diag_blocks / nr_of_dpus + 1) : rest_blocks * (diag_blocks / nr_of_dpus + 1) + (i - rest_blocks) * (diag_blocks / nr_of_dpus);
+
                 // Copy input arguments to dpu
                 input_args[i].nblocks = blocks_per_dpu;
                 input_args[i].active_blocks = active_blocks_per_dpu;
                 input_args[i].penalty = penalty;
+                input_args[i].gap_open = gap_open;
+                input_args[i].block_col = diag_first + first_block;
+                input_args[i].block_row = (max_cols-1)/BL + blk - 2 - (diag_first + first_block);
+                input_args[i].kernel = kernel1;
                 DPU_ASSERT(dpu_prepare_xfer(dpu, input_args + i));
             } 
             DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(dpu_arguments_t), DPU_XFER_DEFAULT));
@@ -620,54 +1498,56 @@ int main(int argc, char **argv) {
             if (rep >= p.n_warmup)
                 start(&timer, 1, rep - p.n_warmup + blk - 1);
             // Copy itemsets to DPUs
-            unsigned int blocks_per_dpu = (((max_cols-1)/BL) - blk + 1) / nr_of_dpus;
-            if ((((max_cols-1)/BL) - blk + 1) % nr_of_dpus != 0)
+            unsigned int blocks_per_dpu = diag_blocks / nr_of_dpus;
+            if (diag_blocks % nr_of_dpus != 0)
                 blocks_per_dpu++;
 #if PRINT
             uint64_t total_dpu_memory = 0;
-            total_dpu_memory = (uint64_t) blocks_per_dpu * (BL+1) * (BL+2) * sizeof(int32_t) + (uint64_t) blocks_per_dpu * BL * BL * sizeof(int32_t);
+            total_dpu_memory = (uint64_t) blocks_per_dpu * NR_MATRICES * (BL+1) * (BL+2) * sizeof(int32_t) + (uint64_t) blocks_per_dpu * BL * BL * sizeof(int32_t);
             printf("Total memory allocated in each DPU %u bytes\n", total_dpu_memory);
 #endif
             unsigned int mram_offset = 0;
             for (unsigned int bl_indx = 0; bl_indx < blocks_per_dpu; bl_indx++) {
-                for (unsigned int bl = 0; bl < BL + 1; bl++) {
+                for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                    for (unsigned int bl = 0; bl < BL + 1; bl++) {
+
+                        i = 0;
+                        DPU_FOREACH(dpu_set, dpu, i) {
+                            unsigned int chunks = diag_blocks / nr_of_dpus;
+                            unsigned int prev_block_index = 0;
+                            unsigned int rest_blocks = diag_blocks % nr_of_dpus;
+                            if (rest_blocks > 0) {
+                                if (i >= rest_blocks) {
+                                    prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                                } else {
+                                    prev_block_index = i * (chunks + 1);
+                                }
+                            } else {
+                                prev_block_index = i * blocks_per_dpu; 
+                            }
 
-                    i = 0;
-                    DPU_FOREACH(dpu_set, dpu, i) {
-                        unsigned int chunks = (((max_cols-1)/BL) - blk + 1) / nr_of_dpus;
-                        unsigned int prev_block_index = 0;
-                        unsigned int rest_blocks = (((max_cols-1)/BL) - blk + 1) % nr_of_dpus;
-                        if (rest_blocks > 0) {
-                            if (i >= rest_blocks) {
-                                prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                            uint64_t input_itemsets_offset = 0;  
+                            int32_t *dpu_pointer;  
+                            if (i + bl_indx * nr_of_dpus >= diag_blocks) {
+                                dpu_pointer = dummy;
+                                input_itemsets_offset = 0;  
                             } else {
-                                prev_block_index = i * (chunks + 1);
+                                uint64_t b_index_x = diag_first + prev_block_index + bl_indx;
+                                uint64_t b_index_y = (max_cols-1)/BL + blk - 2 - b_index_x;
+                                dpu_pointer = matrices[m];
+                                input_itemsets_offset = cell_offset(&dpu_layout, b_index_y * BL + bl, b_index_x * BL);  
                             }
-                        } else {
-                            prev_block_index = i * blocks_per_dpu; 
-                        }
 
-                        uint64_t input_itemsets_offset = 0;  
-                        int32_t *dpu_pointer;  
-                        if (i + bl_indx * nr_of_dpus >= (((max_cols-1)/BL) - blk + 1)) {
-                            dpu_pointer = dummy;
-                            input_itemsets_offset = 0;  
-                        } else {
-                            uint64_t b_index_x = blk - 1 + prev_block_index + bl_indx;
-                            uint64_t b_index_y = (max_cols-1)/BL + blk - 2 - b_index_x;
-                            dpu_pointer = input_itemsets;
-                            input_itemsets_offset = b_index_y * (max_cols+1) * BL + b_index_x * BL + bl * (max_cols + 1);  
+                            DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
                         }
 
-                        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
-                    }
-
-                    if (bl == 0) 
-                        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
-                    else
-                        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, 2 * sizeof(int32_t), DPU_XFER_DEFAULT));
-                    mram_offset += (BL+2) * sizeof(int32_t);
+                        if (bl == 0) 
+                            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
+                        else
+                            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, 2 * sizeof(int32_t), DPU_XFER_DEFAULT));
+                        mram_offset += (BL+2) * sizeof(int32_t);
 
+                    }
                 }
             }
             if (rep >= p.n_warmup)
@@ -677,15 +1557,15 @@ int main(int argc, char **argv) {
             if (rep >= p.n_warmup)
                 start(&timer, 2, rep - p.n_warmup + blk - 1);
             // Copy reference to DPUs
-            mram_offset = blocks_per_dpu * (BL+1) * (BL+2) * sizeof(int32_t); 
+            mram_offset = blocks_per_dpu * NR_MATRICES * (BL+1) * (BL+2) * sizeof(int32_t); 
             for (unsigned int bl_indx = 0; bl_indx < blocks_per_dpu; bl_indx++) {
                 for (unsigned int bl = 0; bl < BL; bl++) {
 
                     i = 0;
                     DPU_FOREACH(dpu_set, dpu, i) {
-                        unsigned int chunks = (((max_cols-1)/BL) - blk + 1) / nr_of_dpus;
+                        unsigned int chunks = diag_blocks / nr_of_dpus;
                         unsigned int prev_block_index = 0;
-                        unsigned int rest_blocks = (((max_cols-1)/BL) - blk + 1) % nr_of_dpus;
+                        unsigned int rest_blocks = diag_blocks % nr_of_dpus;
                         if (rest_blocks > 0) {
                             if (i >= rest_blocks) {
                                 prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
@@ -698,14 +1578,14 @@ int main(int argc, char **argv) {
 
                         uint64_t reference_offset = 0;  
                         int32_t *dpu_pointer;  
-                        if (i + bl_indx * nr_of_dpus >= (((max_cols-1)/BL) - blk + 1)) {
+                        if (i + bl_indx * nr_of_dpus >= diag_blocks) {
                             dpu_pointer = dummy;
                             reference_offset = 0;  
                         } else {
-                            uint64_t b_index_x = blk - 1 + prev_block_index + bl_indx;
+                            uint64_t b_index_x = diag_first + prev_block_index + bl_indx;
                             uint64_t b_index_y = (max_cols-1)/BL + blk - 2 - b_index_x;
                             dpu_pointer = reference;
-                            reference_offset = b_index_y * (max_cols - 1) * BL + b_index_x * BL + bl * (max_cols - 1);  
+                            reference_offset = ref_offset(&dpu_layout, b_index_y * BL + bl, b_index_x * BL);  
                         }
 
                         DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + reference_offset));
@@ -759,50 +1639,68 @@ int main(int argc, char **argv) {
             // Copy output result to Host CPU
             mram_offset = 0;
             for (unsigned int bl_indx = 0; bl_indx < blocks_per_dpu; bl_indx++) {
-                for (unsigned int bl = 0; bl < BL + 1; bl++) {
+                for (unsigned int m = 0; m < NR_MATRICES; m++) {
+                    for (unsigned int bl = 0; bl < BL + 1; bl++) {
+
+                        i = 0;
+                        DPU_FOREACH(dpu_set, dpu, i) {
+                            unsigned int chunks = diag_blocks / nr_of_dpus;
+                            unsigned int prev_block_index = 0;
+                            unsigned int rest_blocks = diag_blocks % nr_of_dpus;
+                            if (rest_blocks > 0) {
+                                if (i >= rest_blocks) {
+                                    prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                                } else {
+                                    prev_block_index = i * (chunks + 1);
+                                }
+                            } else {
+                                prev_block_index = i * blocks_per_dpu; 
+                            }
 
-                    i = 0;
-                    DPU_FOREACH(dpu_set, dpu, i) {
-                        unsigned int chunks = (((max_cols-1)/BL) - blk + 1) / nr_of_dpus;
-                        unsigned int prev_block_index = 0;
-                        unsigned int rest_blocks = (((max_cols-1)/BL) - blk + 1) % nr_of_dpus;
-                        if (rest_blocks > 0) {
-                            if (i >= rest_blocks) {
-                                prev_block_index = rest_blocks * (chunks + 1) + (i - rest_blocks) * chunks;
+                            uint64_t input_itemsets_offset = 0;  
+                            int32_t *dpu_pointer;  
+                            if (i + bl_indx * nr_of_dpus >= diag_blocks) {
+                                dpu_pointer = dummy;
+                                input_itemsets_offset = 0;  
                             } else {
-                                prev_block_index = i * (chunks + 1);
+                                uint64_t b_index_x = diag_first + prev_block_index + bl_indx;
+                                uint64_t b_index_y = (max_cols-1)/BL + blk - 2 - b_index_x;
+                                dpu_pointer = matrices[m];
+                                input_itemsets_offset = cell_offset(&dpu_layout, b_index_y * BL + bl, b_index_x * BL);  
                             }
-                        } else {
-                            prev_block_index = i * blocks_per_dpu; 
-                        }
 
-                        uint64_t input_itemsets_offset = 0;  
-                        int32_t *dpu_pointer;  
-                        if (i + bl_indx * nr_of_dpus >= (((max_cols-1)/BL) - blk + 1)) {
-                            dpu_pointer = dummy;
-                            input_itemsets_offset = 0;  
-                        } else {
-                            uint64_t b_index_x = blk - 1 + prev_block_index + bl_indx;
-                            uint64_t b_index_y = (max_cols-1)/BL + blk - 2 - b_index_x;
-                            dpu_pointer = input_itemsets;
-                            input_itemsets_offset = b_index_y * (max_cols+1) * BL + b_index_x * BL + bl * (max_cols + 1);  
+                            if (bl == 0) // Skip the first row of the block
+                                continue;
+                            DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
+
                         }
 
-                        if (bl == 0) // Skip the first row of the block
+                        if (bl == 0) {
+                            mram_offset += (BL+2) * sizeof(int32_t);
                             continue;
-                        DPU_ASSERT(dpu_prepare_xfer(dpu, dpu_pointer + input_itemsets_offset));
-
-                    }
-
-                    if (bl == 0) {
+                        }
+                        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
                         mram_offset += (BL+2) * sizeof(int32_t);
-                        continue;
-                    }
-                    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_offset, (BL+2) * sizeof(int32_t), DPU_XFER_DEFAULT));
-                    mram_offset += (BL+2) * sizeof(int32_t);
 
+                    }
                 }
             }
+            // Banded mode: the last column pulled with a block is the first one of its right
+            // neighbor, which has to stay MINUS_INF when that block is outside the band
+            if (band >= 0)
+                band_edge(input_itemsets, &dpu_layout, diag, diag_first + diag_blocks - 1);
+#ifdef LOCAL
+            // Best cell of the local alignment so far
+            i = 0;
+            DPU_FOREACH(dpu_set, dpu, i) {
+                DPU_ASSERT(dpu_prepare_xfer(dpu, results + i * NR_TASKLETS));
+            }
+            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_RESULTS", 0, NR_TASKLETS * sizeof(dpu_results_t), DPU_XFER_DEFAULT));
+            for (unsigned int t = 0; t < nr_of_dpus * NR_TASKLETS; t++) {
+                if (BETTER_CELL(results[t].max, results[t].row, results[t].col, best.max, best.row, best.col))
+                    best = results[t];
+            }
+#endif
             if (rep >= p.n_warmup)
                 stop(&timer, 4);
 
@@ -812,12 +1710,28 @@ int main(int argc, char **argv) {
         // Traceback step
         if (rep >= p.n_warmup)
             start(&timer, 1, 1);
+        if (linear_traceback) {
+            hirschberg(&hb, traceback_output);
+        } else {
+#if defined(AFFINE) || defined(LOCAL)
+            FILE *fpo = NULL;
 #if PRINT_FILE
-        char *dpu_file = "./bin/dpu_output.txt";
-        traceback(traceback_output, dpu_file, input_itemsets, reference, max_rows+1, max_cols+1, penalty);
+            fpo = fopen("./bin/dpu_output.txt", "w");
+#endif
+#ifdef LOCAL
+            traceback_scheme(traceback_output, fpo, matrices, reference, max_cols+1, max_cols-1, best.row, best.col, penalty, gap_open);
+#else
+            traceback_scheme(traceback_output, fpo, matrices, reference, max_cols+1, max_cols-1, max_rows-1, max_cols-1, penalty, gap_open);
+#endif
+            if (fpo != NULL)
+                fclose(fpo);
+#elif PRINT_FILE
+            char *dpu_file = "./bin/dpu_output.txt";
+            traceback(traceback_output, dpu_file, input_itemsets, reference, max_rows+1, max_cols+1, penalty);
 #else
-        traceback(traceback_output, input_itemsets, reference, max_rows+1, max_cols+1, penalty);
+            traceback(traceback_output, input_itemsets, reference, max_rows+1, max_cols+1, penalty);
 #endif
+        }
         if (rep >= p.n_warmup)
             stop(&timer, 1);
 
@@ -851,16 +1765,33 @@ int main(int argc, char **argv) {
 
     // Check output
     bool status = true;
-    for (uint64_t i = 1; i < max_rows; i++) {
-        for (uint64_t j = 1; j < max_cols; j++) {
-            if (input_itemsets_host[i*max_cols + j] != input_itemsets[i*(max_cols+1) + j]) {
-                status = false;
+    for (unsigned int m = 0; m < NR_MATRICES; m++) {
+        for (uint64_t i = 1; i < max_rows; i++) {
+            uint64_t lo, hi;
+            band_range(band, i, max_cols - 1, &lo, &hi);
+            for (uint64_t j = (lo > 1 ? lo : 1); j <= hi; j++) {
+                if (matrices_host[m][cell_offset(&host_layout, i, j)] != matrices[m][cell_offset(&dpu_layout, i, j)]) {
+                    status = false;
 #if PRINT
-                printf("%ld (%ld, %ld): %d %d\n", i*max_cols + j, i, j, input_itemsets_host[i*max_cols + j], input_itemsets[i*(max_cols+1) + j]); 
+                    printf("%u (%ld, %ld): %d %d\n", m, i, j, matrices_host[m][cell_offset(&host_layout, i, j)], matrices[m][cell_offset(&dpu_layout, i, j)]); 
 #endif
-            } 
+                } 
+            }
         }
     }
+    if (linear_traceback) {
+        printf("Alignment score %d, path of %lu steps\n", traceback_output[0], hb.nr_ops);
+        if (!hirschberg_check(&hb, traceback_output, input_itemsets, &dpu_layout))
+            status = false;
+        for (int k = 0; k < 4; k++)
+            free(hb.rows[k]);
+        free(hb.ops);
+    }
+#ifdef LOCAL
+    printf("Local alignment: score %d at (%u, %u)\n", best.max, best.row, best.col);
+    if (best.max != best_host.max || best.row != best_host.row || best.col != best_host.col)
+        status = false;
+#endif
     
     if (status) {
         printf("[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] Outputs are equal\n");
@@ -870,6 +1801,15 @@ int main(int argc, char **argv) {
 
     free(input_itemsets_host);
     free(input_itemsets);
+#ifdef AFFINE
+    free(input_e_host);
+    free(input_f_host);
+    free(input_e);
+    free(input_f);
+#endif
+#ifdef LOCAL
+    free(results);
+#endif
     free(reference);
     free(traceback_output);
     free(traceback_output_host);
@@ -6,13 +6,67 @@ typedef struct {
     uint32_t nblocks;
     uint32_t active_blocks;
     uint32_t penalty;
+	enum kernels {
+	    kernel1 = 0, // Wavefront: blocks of one diagonal of a single alignment
+	    kernel2 = 1, // Batch: independent alignments of many sequence pairs
+	    nr_kernels = 2,
+	} kernel;
+    uint32_t nr_pairs;
+    uint32_t max_pairs;
+    uint32_t stride;
+    uint32_t traceback;
+    uint32_t gap_open;
+    uint32_t block_row;
+    uint32_t block_col;
     uint32_t dummy;
 } dpu_arguments_t;
 
+// Best cell of a local alignment (max. score and its position in the whole matrix)
+typedef struct {
+    int32_t max;
+    uint32_t row;
+    uint32_t col;
+    uint32_t dummy;
+} dpu_results_t;
+
+// Result of one sequence pair in batch mode
+typedef struct {
+    int32_t score;
+    uint32_t path_len;
+} pair_result_t;
+
 #ifndef BL
 #define BL 16 
 #endif
 
+// Scoring scheme of the wavefront kernel (select with -DAFFINE or -DLOCAL):
+// LINEAR: global alignment, linear gap penalty (default)
+// AFFINE: global alignment, affine gap penalty (Gotoh): H, E (vertical gaps) and F (horizontal gaps) matrices
+// LOCAL:  local alignment (Smith-Waterman), linear gap penalty
+#ifdef AFFINE
+#define NR_MATRICES 3
+#else
+#define NR_MATRICES 1
+#endif
+#define MINUS_INF (-(1 << 28)) // Small enough to never win, far from overflow
+
+// Batch mode: columns of the DP matrix computed per pass (strip) and
+// number of rows (or path steps) moved per MRAM transfer
+#ifndef STRIP
+#define STRIP 256
+#endif
+#define BATCH_CHUNK 64
+
+// Traceback directions (batch mode)
+#define DIR_DIAG 0
+#define DIR_UP 1
+#define DIR_LEFT 2
+
+// Alignment operations of a traceback path (batch mode)
+#define OP_MATCH 'M' // Diagonal: a[i] aligned with b[j]
+#define OP_DEL 'D'   // Up: a[i] aligned with a gap
+#define OP_INS 'I'   // Left: b[j] aligned with a gap
+
 // Data type
 #define T int32_t
 
@@ -32,6 +86,10 @@ int32_t maximum(int32_t a, int32_t b, int32_t c) {
         
 }
 
+// Better cell of a local alignment: higher score, then smaller row, then smaller column
+#define BETTER_CELL(v, r, c, best, best_r, best_c) \
+    ((v) > (best) || ((v) == (best) && ((r) < (best_r) || ((r) == (best_r) && (c) < (best_c)))))
+
 #define DPU_CAPACITY (64 << 20) // A DPU's capacity is 64 MiB
 
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -67,6 +125,11 @@ int blosum62[24][24] = {
     {-4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1}
 };
 
+#define roundup8(n) (((n) + 7) & ~7)
+// MRAM scratch per tasklet in batch mode: boundary column and traceback directions
+#define BATCH_COL_BYTES(stride) (((stride) / BATCH_CHUNK + 1) * BATCH_CHUNK * sizeof(int32_t))
+#define BATCH_DIR_BYTES(stride) ((stride) * (stride) + BATCH_CHUNK)
+
 #define DYNAMIC 1
 #define PRINT 0
 #define PRINT_FILE 0
@@ -6,8 +6,14 @@
 typedef struct Params {
     unsigned int   max_rows;
     unsigned int   penalty;
+    unsigned int   gap_open;
     unsigned int   n_warmup;
     unsigned int   n_reps;
+    char*          file_name;
+    unsigned int   nr_pairs;
+    unsigned int   batch_pairs;
+    unsigned int   traceback;
+    unsigned int   band;
 } Params;
 
 static void usage() {
@@ -21,7 +27,16 @@ static void usage() {
             "\n"
             "\nBenchmark-specific options:"
             "\n    -n <N>    size of sequence: length of the sequence"
-            "\n    -p <P>    penalty: a positive integer"
+            "\n    -p <P>    penalty: a positive integer (gap extension penalty with SCORE=AFFINE)"
+            "\n    -o <O>    gap open penalty with SCORE=AFFINE (default=10)"
+            "\n    -d <D>    banded mode: band of D diagonals on each side, rounded up to BL (default=0, full matrix; N must be a multiple of BL),"
+            "\n              with a linear-memory (Hirschberg) traceback"
+            "\n"
+            "\nBatch mode options (many independent alignments, N is the max. length):"
+            "\n    -f <F>    input file: one pair of sequences per line"
+            "\n    -b <B>    # of random sequence pairs (used if no input file is given)"
+            "\n    -s <S>    # of pairs per DPU in each batch (default=256)"
+            "\n    -t        return tracebacks besides scores"
             "\n");
 }
 
@@ -31,9 +46,15 @@ struct Params input_params(int argc, char **argv) {
     p.n_reps        = 3;
     p.max_rows      = 256;
     p.penalty       = 1;
+    p.gap_open      = 10;
+    p.file_name     = NULL;
+    p.nr_pairs      = 0;
+    p.batch_pairs   = 256;
+    p.traceback     = 0;
+    p.band          = 0;
 
     int opt;
-    while((opt = getopt(argc, argv, "hw:e:n:p:")) >= 0) {
+    while((opt = getopt(argc, argv, "hw:e:n:p:o:d:f:b:s:t")) >= 0) {
         switch(opt) {
             case 'h':
                 usage();
@@ -43,6 +64,12 @@ struct Params input_params(int argc, char **argv) {
             case 'e': p.n_reps        = atoi(optarg); break;
             case 'n': p.max_rows      = atoi(optarg); break;
             case 'p': p.penalty       = atoi(optarg); break;
+            case 'o': p.gap_open      = atoi(optarg); break;
+            case 'd': p.band          = atoi(optarg); break;
+            case 'f': p.file_name     = optarg; break;
+            case 'b': p.nr_pairs      = atoi(optarg); break;
+            case 's': p.batch_pairs   = atoi(optarg); break;
+            case 't': p.traceback     = 1; break;
             default:
                       fprintf(stderr, "\nUnrecognized option!\n");
                       usage();
@@ -50,6 +77,13 @@ struct Params input_params(int argc, char **argv) {
         }
     }
     assert(NR_DPUS > 0 && "Invalid # of dpus!");
+    // The banded layout (and its linear-memory traceback) stores whole blocks only
+    assert((p.band == 0 || p.max_rows % BL == 0) && "Banded mode requires N to be a multiple of BL!");
+#if defined(AFFINE) || defined(LOCAL)
+    // The batch kernel and the banded mode implement the LINEAR scoring scheme only
+    assert(p.file_name == NULL && p.nr_pairs == 0 && "Batch mode requires SCORE=LINEAR!");
+    assert(p.band == 0 && "Banded mode requires SCORE=LINEAR!");
+#endif
 
     return p;
 }
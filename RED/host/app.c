@@ -16,6 +16,8 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#define MERGE_T T
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -159,47 +161,38 @@ int main(int argc, char **argv) {
 #endif
 
         printf("Retrieve results\n");
+#if PERF
         dpu_results_t results[nr_of_dpus];
+#endif
         T* results_count = malloc(nr_of_dpus * sizeof(T));
         if(rep >= p.n_warmup)
             start(&timer, 3, rep - p.n_warmup);
         i = 0;
         // PARALLEL RETRIEVE TRANSFER
-        dpu_results_t* results_retrieve[nr_of_dpus];
+        dpu_results_t* results_retrieve = (dpu_results_t*)malloc(nr_of_dpus * NR_TASKLETS * sizeof(dpu_results_t));
 
         DPU_FOREACH(dpu_set, dpu, i) {
-            results_retrieve[i] = (dpu_results_t*)malloc(NR_TASKLETS * sizeof(dpu_results_t));
-            DPU_ASSERT(dpu_prepare_xfer(dpu, results_retrieve[i]));
+            DPU_ASSERT(dpu_prepare_xfer(dpu, results_retrieve + i * NR_TASKLETS));
         }
         DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_RESULTS", 0, NR_TASKLETS * sizeof(dpu_results_t), DPU_XFER_DEFAULT));
 
-        DPU_FOREACH(dpu_set, dpu, i) {
-            // Retrieve tasklet timings
-            for (unsigned int each_tasklet = 0; each_tasklet < NR_TASKLETS; each_tasklet++) {
-                if(each_tasklet == 0)
-                    results[i].t_count = results_retrieve[i][each_tasklet].t_count;
-            }
-#if !PERF
-            free(results_retrieve[i]);
-#endif
-            // Sequential reduction
-            count += results[i].t_count;
+        // Parallel reduction of the counts of all DPUs (held by tasklet 0)
+        merge_partials(&count, &results_retrieve[0].t_count, nr_of_dpus, 1, NR_TASKLETS * sizeof(dpu_results_t) / sizeof(T));
 #if PRINT
-            printf("i=%d -- %lu\n", i, count);
+        printf("count -- %lu\n", count);
 #endif
-        }
 
 #if PERF
         DPU_FOREACH(dpu_set, dpu, i) {
             results[i].cycles = 0;
             // Retrieve tasklet timings
             for (unsigned int each_tasklet = 0; each_tasklet < NR_TASKLETS; each_tasklet++) {
-                if (results_retrieve[i][each_tasklet].cycles > results[i].cycles)
-                    results[i].cycles = results_retrieve[i][each_tasklet].cycles;
+                if (results_retrieve[i * NR_TASKLETS + each_tasklet].cycles > results[i].cycles)
+                    results[i].cycles = results_retrieve[i * NR_TASKLETS + each_tasklet].cycles;
             }
-            free(results_retrieve[i]);
         }
 #endif
+        free(results_retrieve);
         if(rep >= p.n_warmup)
             stop(&timer, 3);
 
@@ -16,6 +16,7 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -182,15 +183,13 @@ int main(int argc, char **argv) {
                     results[i].t_count = results_retrieve[i][each_tasklet].t_count;
                 }
             }
-            // Sequential scan
-            uint32_t temp = results[i].t_count;
-            results_scan[i] = accum;
-            accum += temp;
-#if PRINT
-            printf("i=%d -- %u,  %u, %u\n", i, results_scan[i], accum, temp);
-#endif
             free(results_retrieve[i]);
         }
+        // Scan of the counts of all DPUs
+        accum = scan_partials(results_scan, &results[0].t_count, nr_of_dpus, sizeof(dpu_results_t) / sizeof(uint32_t));
+#if PRINT
+        printf("accum -- %u\n", accum);
+#endif
         if(rep >= p.n_warmup)
             stop(&timer, 3);
 
@@ -0,0 +1,354 @@
+// Matrix transposition CPU baseline with cache blocking and in-register 8x8 transposes
+//
+// The matrix is split in TILE x TILE tiles, fetched dynamically by the threads. Inside a tile,
+// every 8x8 block is loaded in 8 vector registers, transposed with unpack/shuffle instructions
+// (AVX-512 for double, AVX for float and for double without AVX-512, scalar otherwise) and
+// stored to the output with non-temporal stores when its rows are whole cache lines, so that the
+// output does not evict the input from the caches. The in-place variant (square matrices) swaps tiles (i, j) and (j, i) through
+// two 8x8 buffers and uses regular stores, since the written lines have just been read.
+#include "support/setup.h"
+#include "support/common.h"
+#include "support/timer.h"
+
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <immintrin.h>
+
+#define BLOCK 8 // Register block (BLOCK x BLOCK elements)
+#ifndef TILE
+#define TILE 64 // Cache block (TILE x TILE elements), a multiple of BLOCK
+#endif
+
+// 8x8 transposes ----------------------------------------------------------------------------------
+// dst[j * ld + i] = src[i * ls + j] for i, j < 8. Non-temporal stores if stream (rows of dst aligned)
+#if DOUBLE_PRECISION && defined(__AVX512F__)
+#define VEC_BYTES 64
+static inline void store_row(T *dst, __m512d v, bool stream) {
+    if(stream)
+        _mm512_stream_pd(dst, v);
+    else
+        _mm512_storeu_pd(dst, v);
+}
+static inline void transpose_block(const T *src, size_t ls, T *dst, size_t ld, bool stream) {
+    __m512d t[8], u[8];
+    for(int i = 0; i < 8; i += 2) {
+        __m512d r0 = _mm512_loadu_pd(src + i * ls);
+        __m512d r1 = _mm512_loadu_pd(src + (i + 1) * ls);
+        t[i]     = _mm512_unpacklo_pd(r0, r1); // Columns 0, 2, 4, 6 of rows i, i + 1
+        t[i + 1] = _mm512_unpackhi_pd(r0, r1); // Columns 1, 3, 5, 7
+    }
+    for(int k = 0; k < 2; k++) {
+        u[k]     = _mm512_shuffle_f64x2(t[k], t[k + 2], _MM_SHUFFLE(2, 0, 2, 0));
+        u[k + 2] = _mm512_shuffle_f64x2(t[k], t[k + 2], _MM_SHUFFLE(3, 1, 3, 1));
+        u[k + 4] = _mm512_shuffle_f64x2(t[k + 4], t[k + 6], _MM_SHUFFLE(2, 0, 2, 0));
+        u[k + 6] = _mm512_shuffle_f64x2(t[k + 4], t[k + 6], _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    for(int k = 0; k < 2; k++) {
+        store_row(dst + k * ld,       _mm512_shuffle_f64x2(u[k], u[k + 4], _MM_SHUFFLE(2, 0, 2, 0)), stream);
+        store_row(dst + (k + 4) * ld, _mm512_shuffle_f64x2(u[k], u[k + 4], _MM_SHUFFLE(3, 1, 3, 1)), stream);
+        store_row(dst + (k + 2) * ld, _mm512_shuffle_f64x2(u[k + 2], u[k + 6], _MM_SHUFFLE(2, 0, 2, 0)), stream);
+        store_row(dst + (k + 6) * ld, _mm512_shuffle_f64x2(u[k + 2], u[k + 6], _MM_SHUFFLE(3, 1, 3, 1)), stream);
+    }
+}
+#elif DOUBLE_PRECISION && defined(__AVX__)
+#define VEC_BYTES 32
+static inline void store_row(T *dst, __m256d v, bool stream) {
+    if(stream)
+        _mm256_stream_pd(dst, v);
+    else
+        _mm256_storeu_pd(dst, v);
+}
+// Four 4x4 transposes. Both halves of an output row are stored one after the other (a full cache line)
+static inline void transpose_block(const T *src, size_t ls, T *dst, size_t ld, bool stream) {
+    for(int bj = 0; bj < 8; bj += 4) {
+        __m256d o[8];
+        for(int bi = 0; bi < 8; bi += 4) {
+            const T *s = src + bi * ls + bj;
+            __m256d t0 = _mm256_unpacklo_pd(_mm256_loadu_pd(s), _mm256_loadu_pd(s + ls));
+            __m256d t1 = _mm256_unpackhi_pd(_mm256_loadu_pd(s), _mm256_loadu_pd(s + ls));
+            __m256d t2 = _mm256_unpacklo_pd(_mm256_loadu_pd(s + 2 * ls), _mm256_loadu_pd(s + 3 * ls));
+            __m256d t3 = _mm256_unpackhi_pd(_mm256_loadu_pd(s + 2 * ls), _mm256_loadu_pd(s + 3 * ls));
+            o[bi]     = _mm256_permute2f128_pd(t0, t2, 0x20);
+            o[bi + 1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+            o[bi + 2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+            o[bi + 3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+        }
+        for(int k = 0; k < 4; k++) {
+            store_row(dst + (bj + k) * ld,     o[k], stream);
+            store_row(dst + (bj + k) * ld + 4, o[k + 4], stream);
+        }
+    }
+}
+#elif !DOUBLE_PRECISION && defined(__AVX__)
+#define VEC_BYTES 32
+static inline void store_row(T *dst, __m256 v, bool stream) {
+    if(stream)
+        _mm256_stream_ps(dst, v);
+    else
+        _mm256_storeu_ps(dst, v);
+}
+static inline void transpose_block(const T *src, size_t ls, T *dst, size_t ld, bool stream) {
+    __m256 t[8], s[8];
+    for(int i = 0; i < 8; i += 2) {
+        __m256 r0 = _mm256_loadu_ps(src + i * ls);
+        __m256 r1 = _mm256_loadu_ps(src + (i + 1) * ls);
+        t[i]     = _mm256_unpacklo_ps(r0, r1);
+        t[i + 1] = _mm256_unpackhi_ps(r0, r1);
+    }
+    for(int k = 0; k < 8; k += 4) {
+        s[k]     = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        s[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        s[k + 2] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        s[k + 3] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for(int k = 0; k < 4; k++) {
+        store_row(dst + k * ld,       _mm256_permute2f128_ps(s[k], s[k + 4], 0x20), stream);
+        store_row(dst + (k + 4) * ld, _mm256_permute2f128_ps(s[k], s[k + 4], 0x31), stream);
+    }
+}
+#else
+#define VEC_BYTES 0
+static inline void transpose_block(const T *src, size_t ls, T *dst, size_t ld, bool stream) {
+    (void)stream;
+    for(int i = 0; i < 8; i++)
+        for(int j = 0; j < 8; j++)
+            dst[j * ld + i] = src[i * ls + j];
+}
+#endif
+
+// Non-temporal stores only pay off for whole cache lines: every row of the destination block must be
+// one aligned line (double). Partial lines (float) are written with regular stores
+static inline bool can_stream(const T *dst, size_t ld) {
+    return VEC_BYTES > 0 && BLOCK * sizeof(T) == 64 && ((uintptr_t)dst % 64) == 0 && (ld * sizeof(T)) % 64 == 0;
+}
+
+// Transpose rows [r0, r1) x columns [c0, c1) of the A x B matrix in into the B x A matrix out
+static void transpose_tile(const T *in, T *out, size_t A, size_t B, size_t r0, size_t r1, size_t c0, size_t c1) {
+    size_t r8 = r0 + (r1 - r0) / BLOCK * BLOCK;
+    size_t c8 = c0 + (c1 - c0) / BLOCK * BLOCK;
+    for(size_t r = r0; r < r8; r += BLOCK) {
+        for(size_t c = c0; c < c8; c += BLOCK) {
+            T *dst = out + c * A + r;
+            transpose_block(in + r * B + c, B, dst, A, can_stream(dst, A));
+        }
+    }
+    // Remainders
+    for(size_t r = r0; r < r1; r++)
+        for(size_t c = (r < r8) ? c8 : c0; c < c1; c++)
+            out[c * A + r] = in[r * B + c];
+}
+
+// CPU threads ---------------------------------------------------------------------------------
+// Out-of-place: out (B x A) = transpose of in (A x B)
+void run_cpu_threads_oop(const T *in, T *out, size_t A, size_t B, int threads) {
+    size_t tiles_r = divceil(A, TILE);
+    size_t tiles_c = divceil(B, TILE);
+    std::atomic<size_t> head(0);
+
+    std::vector<std::thread> cpu_threads;
+    for(int i = 0; i < threads; i++) {
+        cpu_threads.push_back(std::thread([&]() {
+            // Dynamic fetch
+            for(size_t gid = head.fetch_add(1); gid < tiles_r * tiles_c; gid = head.fetch_add(1)) {
+                size_t r0 = (gid / tiles_c) * TILE;
+                size_t c0 = (gid % tiles_c) * TILE;
+                transpose_tile(in, out, A, B, r0, std::min(r0 + TILE, A), c0, std::min(c0 + TILE, B));
+            }
+#if VEC_BYTES
+            _mm_sfence(); // Non-temporal stores are visible after the join
+#endif
+        }));
+    }
+    std::for_each(cpu_threads.begin(), cpu_threads.end(), [](std::thread &t) { t.join(); });
+}
+
+// In-place: square N x N matrix. Blocks (i, j) and (j, i) are swapped, each transposed through a buffer
+void run_cpu_threads_inplace(T *inout, size_t N, int threads) {
+    size_t tiles = divceil(N, TILE);
+    std::atomic<size_t> head(0);
+
+    std::vector<std::thread> cpu_threads;
+    for(int i = 0; i < threads; i++) {
+        cpu_threads.push_back(std::thread([&]() {
+            alignas(64) T x[BLOCK * BLOCK];
+            alignas(64) T y[BLOCK * BLOCK];
+            size_t N8 = N / BLOCK * BLOCK;
+            // Dynamic fetch, pairs of tiles (ti, tj) with ti <= tj
+            for(size_t gid = head.fetch_add(1); gid < tiles * tiles; gid = head.fetch_add(1)) {
+                size_t ti = gid / tiles, tj = gid % tiles;
+                if(tj < ti)
+                    continue;
+                size_t r1 = std::min((ti + 1) * TILE, N8);
+                size_t c1 = std::min((tj + 1) * TILE, N8);
+                for(size_t r = ti * TILE; r < r1; r += BLOCK) {
+                    for(size_t c = (ti == tj) ? r : tj * TILE; c < c1; c += BLOCK) {
+                        T *p = inout + r * N + c;
+                        T *q = inout + c * N + r;
+                        transpose_block(p, N, x, BLOCK, false);
+                        if(p != q) {
+                            transpose_block(q, N, y, BLOCK, false);
+                            for(int k = 0; k < BLOCK; k++)
+                                memcpy(p + k * N, y + k * BLOCK, BLOCK * sizeof(T));
+                        }
+                        for(int k = 0; k < BLOCK; k++)
+                            memcpy(q + k * N, x + k * BLOCK, BLOCK * sizeof(T));
+                    }
+                }
+                // Remainder rows and columns (past N8), once by the last diagonal tile
+                if(ti == tj && ti == tiles - 1) {
+                    for(size_t r = 0; r < N; r++)
+                        for(size_t c = std::max(r + 1, N8); c < N; c++)
+                            std::swap(inout[r * N + c], inout[c * N + r]);
+                }
+            }
+        }));
+    }
+    std::for_each(cpu_threads.begin(), cpu_threads.end(), [](std::thread &t) { t.join(); });
+}
+
+// Params ---------------------------------------------------------------------
+struct Params {
+
+    int n_threads;
+    int n_warmup;
+    int n_reps;
+    int M_;
+    int m;
+    int N_;
+    int n;
+
+    Params(int argc, char **argv) {
+        n_threads     = 4;
+        n_warmup      = 5;
+        n_reps        = 50;
+        M_            = 128;
+        m             = 16;
+        N_            = 128;
+        n             = 8;
+        int opt;
+        while((opt = getopt(argc, argv, "ht:w:r:m:n:o:p:")) >= 0) {
+            switch(opt) {
+            case 'h':
+                usage();
+                exit(0);
+                break;
+            case 't': n_threads     = atoi(optarg); break;
+            case 'w': n_warmup      = atoi(optarg); break;
+            case 'r': n_reps        = atoi(optarg); break;
+            case 'm': m             = atoi(optarg); break;
+            case 'n': n             = atoi(optarg); break;
+            case 'o': M_            = atoi(optarg); break;
+            case 'p': N_            = atoi(optarg); break;
+            default:
+                fprintf(stderr, "\nUnrecognized option!\n");
+                usage();
+                exit(0);
+            }
+        }
+    }
+
+    void usage() {
+        fprintf(stderr,
+                "\nUsage:  ./trns_simd [options]"
+                "\n"
+                "\nGeneral options:"
+                "\n    -h        help"
+                "\n    -t <T>    # of host threads (default=4)"
+                "\n    -w <W>    # of untimed warmup iterations (default=5)"
+                "\n    -r <R>    # of timed repetition iterations (default=50)"
+                "\n"
+                "\nBenchmark-specific options (the matrix has M_ * m rows and N_ * n columns):"
+                "\n    -m <I>    m (default=16 elements)"
+                "\n    -n <I>    n (default=8 elements)"
+                "\n    -o <I>    M_ (default=128 elements)"
+                "\n    -p <I>    N_ (default=128 elements)"
+                "\n");
+    }
+};
+
+// Input Data -----------------------------------------------------------------
+void read_input(T *x_vector, size_t in_size) {
+    srand(5432);
+    for(size_t i = 0; i < in_size; i++) {
+        x_vector[i] = ((T)(rand() % 100) / 100);
+    }
+}
+
+// Main ------------------------------------------------------------------------------------------
+int main(int argc, char **argv) {
+
+    const Params p(argc, argv);
+    Timer        timer;
+
+    // Allocate
+    timer.start("Allocation");
+    size_t A       = (size_t)p.M_ * p.m;
+    size_t B       = (size_t)p.N_ * p.n;
+    size_t in_size = A * B;
+    size_t bytes   = divceil(in_size * sizeof(T), 64) * 64;
+    T *h_in  = (T *)aligned_alloc(64, bytes);
+    T *h_out = (T *)aligned_alloc(64, bytes);
+    ALLOC_ERR(h_in, h_out);
+    timer.stop("Allocation");
+    timer.print("Allocation", 1);
+
+    // Initialize
+    timer.start("Initialization");
+    read_input(h_in, in_size);
+    memset(h_out, 0, in_size * sizeof(T)); // First touch
+    timer.stop("Initialization");
+    timer.print("Initialization", 1);
+
+    bool status = true;
+
+    // Out-of-place
+    for(int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
+        if(rep >= p.n_warmup)
+            timer.start("Out-of-place");
+        run_cpu_threads_oop(h_in, h_out, A, B, p.n_threads);
+        if(rep >= p.n_warmup)
+            timer.stop("Out-of-place");
+    }
+    timer.print("Out-of-place", p.n_reps);
+    for(size_t r = 0; r < A; r++)
+        for(size_t c = 0; c < B; c++)
+            if(h_out[c * A + r] != h_in[r * B + c])
+                status = false;
+
+    // In-place (square matrices): an even number of transpositions gives back the input
+    if(A == B) {
+        memcpy(h_out, h_in, in_size * sizeof(T));
+        for(int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
+            if(rep >= p.n_warmup)
+                timer.start("In-place");
+            run_cpu_threads_inplace(h_out, A, p.n_threads);
+            if(rep >= p.n_warmup)
+                timer.stop("In-place");
+        }
+        timer.print("In-place", p.n_reps);
+        for(size_t r = 0; r < A; r++)
+            for(size_t c = 0; c < B; c++) {
+                T ref = ((p.n_warmup + p.n_reps) % 2) ? h_in[c * B + r] : h_in[r * B + c];
+                if(h_out[r * B + c] != ref)
+                    status = false;
+            }
+    } else {
+        printf("In-place skipped (%zu x %zu matrix is not square)\n", A, B);
+    }
+
+    // Free memory
+    free(h_in);
+    free(h_out);
+
+    if(status) {
+        printf("Test Passed\n");
+    } else {
+        printf("Test Failed\n");
+    }
+    return status ? 0 : -1;
+}
@@ -10,6 +10,7 @@
 #include <alloc.h>
 #include <perfcounter.h>
 #include <mutex.h>
+#include <mutex_pool.h>
 #include <barrier.h>
 
 #include "../support/common.h"
@@ -17,7 +18,8 @@
 __host dpu_arguments_t DPU_INPUT_ARGUMENTS;
 
 uint32_t curr_tile = 0; // protected by MUTEX
-uint32_t get_tile();
+uint32_t* done_wram; // Done bitmap of step 3 in WRAM, NULL if it is in MRAM
+uint32_t get_tile(uint32_t tile, uint32_t* last_tile);
 void read_tile_step2(uint32_t A, uint32_t offset, T* variable, uint32_t m, uint32_t n);
 void write_tile_step2(uint32_t A, uint32_t offset, T* variable, uint32_t m, uint32_t n);
 void read_tile_step3(uint32_t A, uint32_t offset, T* variable, uint32_t m);
@@ -30,14 +32,18 @@ BARRIER_INIT(my_barrier, NR_TASKLETS);
 
 // Mutexes
 MUTEX_INIT(tile_mutex);
-MUTEX_INIT(done_mutex);
+MUTEX_POOL_INIT(done_mutexes, NR_LOCKS);
 
 extern int main_kernel1(void);
 extern int main_kernel2(void);
+extern int main_kernel3(void);
 
-int (*kernels[nr_kernels])(void) = {main_kernel1, main_kernel2};
+int (*kernels[nr_kernels])(void) = {main_kernel1, main_kernel2, main_kernel3};
 
 int main(void) { 
+    // Idle in this round
+    if(DPU_INPUT_ARGUMENTS.idle)
+        return 0;
     // Kernel
     return kernels[DPU_INPUT_ARGUMENTS.kernel](); 
 }
@@ -81,6 +87,9 @@ int main_kernel2() {
 #endif
     if (tasklet_id == 0){ // Initialize once the cycle counter
         mem_reset(); // Reset the heap
+        curr_tile = 0; // The DPU is relaunched in every round
+        uint32_t done_bytes = ((DPU_INPUT_ARGUMENTS.M_ * DPU_INPUT_ARGUMENTS.n + 31) >> 5) * sizeof(uint32_t);
+        done_wram = (done_bytes <= DONE_WRAM) ? (uint32_t*) mem_alloc(done_bytes) : NULL;
     }
     // Barrier
     barrier_wait(&my_barrier);
@@ -97,15 +106,25 @@ int main_kernel2() {
     T* backup = (T*)mem_alloc(sizeof(T) * m);
     T* read_done = (T*)mem_alloc(sizeof(T));
 
+    // Initialize done bitmap in WRAM
+    if(done_wram != NULL){
+        for(unsigned int i = tasklet_id; i < ((M_ * n + 31) >> 5); i += NR_TASKLETS){
+            done_wram[i] = 0;
+        }
+    }
+    // Barrier
+    barrier_wait(&my_barrier);
+
     uint32_t tile;
+    uint32_t last_tile = 0;
     _Bool done;
 
-    tile = get_tile();
+    tile = get_tile(0, &last_tile);
 
     while (tile < tile_max){
         uint32_t next_in_cycle = ((tile * M_) - tile_max * (tile / n));
         if (next_in_cycle == tile){
-            tile = get_tile();
+            tile = get_tile(tile, &last_tile);
             continue;
         }
         read_tile_step3(A, tile * m, data, m);
@@ -123,18 +142,57 @@ int main_kernel2() {
                 data[i] = backup[i];
             }
         }
-        tile = get_tile();
+        tile = get_tile(tile, &last_tile);
     }
 		
     return 0;
 }
 
+// Steps 2 and 3, out of place: 1000
+// Every tile is transposed in WRAM and its n rows of m elements are written to their final place in a second copy of the matrix
+int main_kernel3() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0){ // Initialize once the cycle counter
+        mem_reset(); // Reset the heap
+    }
+    // Barrier
+    barrier_wait(&my_barrier);
+
+    uint32_t A = (uint32_t)DPU_MRAM_HEAP_POINTER; // A in MRAM
+    uint32_t M_ = DPU_INPUT_ARGUMENTS.M_;
+    uint32_t m = DPU_INPUT_ARGUMENTS.m;
+    uint32_t n = DPU_INPUT_ARGUMENTS.n;
+    uint32_t B = (uint32_t)(DPU_MRAM_HEAP_POINTER + M_ * m * n * sizeof(T)); // Transposed A in MRAM
+
+    T* data = (T*) mem_alloc(m * n * sizeof(T));
+    T* backup = (T*) mem_alloc(m * n * sizeof(T));
+
+    for(unsigned int tile = tasklet_id; tile < M_; tile += NR_TASKLETS){
+        read_tile_step2(A, tile * m * n, data, m, n);
+        for (unsigned int i = 0; i < m * n; i++){
+            backup[(i * m) - (m * n - 1) * (i / n)] = data[i];
+        }
+        for (unsigned int j = 0; j < n; j++){
+            write_tile_step3(B, j * M_ * m + tile * m, backup + j * m, m);
+        }
+    }
+
+    return 0;
+}
+
 // Auxiliary functions
-uint32_t get_tile(){
+// Next tile after tile, from the batch [last_tile - TILE_BATCH, last_tile) of this tasklet or from a newly claimed one
+uint32_t get_tile(uint32_t tile, uint32_t* last_tile){
+    if(tile + 1 < *last_tile)
+        return tile + 1;
     mutex_lock(tile_mutex);
     uint32_t value = curr_tile;
-    curr_tile++;
+    curr_tile += TILE_BATCH;
     mutex_unlock(tile_mutex);
+    *last_tile = value + TILE_BATCH;
     return value;
 }
 
@@ -147,7 +205,7 @@ void read_tile_step2(uint32_t A, uint32_t offset, T* variable, uint32_t m, uint3
       } else {
             transfer = rest;
       }
-      mram_read((__mram_ptr void*)(A + (offset + m * n - rest) * sizeof(T)), variable + (m * n - rest) * sizeof(T), sizeof(T) * transfer);
+      mram_read((__mram_ptr void*)(A + (offset + m * n - rest) * sizeof(T)), variable + (m * n - rest), sizeof(T) * transfer);
       rest -= transfer;
     }
 }
@@ -161,7 +219,7 @@ void write_tile_step2(uint32_t A, uint32_t offset, T* variable, uint32_t m, uint
       } else {
             transfer = rest;
       }
-      mram_write(variable + (m * n - rest) * sizeof(T), (__mram_ptr void*)(A + (offset + m * n - rest) * sizeof(T)), sizeof(T) * transfer);
+      mram_write(variable + (m * n - rest), (__mram_ptr void*)(A + (offset + m * n - rest) * sizeof(T)), sizeof(T) * transfer);
       rest -= transfer;
     }
 }
@@ -177,10 +235,13 @@ void write_tile_step3(uint32_t A, uint32_t offset, T* variable, uint32_t m){
 _Bool get_done(uint32_t done_array_step3, uint32_t address, T* read_done){
     uint32_t result;
 
-    mutex_lock(done_mutex);
+    if(done_wram != NULL) // A WRAM word is read atomically
+        return (_Bool)((done_wram[address >> 5] >> (address & 31)) & 1);
+
+    mutex_pool_lock(&done_mutexes, address >> 3);
     mram_read((__mram_ptr void*)(done_array_step3 + address), read_done, sizeof(T));
     result = ((*read_done & (0x01 << (address % sizeof(T)))) != 0);
-    mutex_unlock(done_mutex);
+    mutex_pool_unlock(&done_mutexes, address >> 3);
 
     return (_Bool)result;
 }
@@ -188,12 +249,21 @@ _Bool get_done(uint32_t done_array_step3, uint32_t address, T* read_done){
 _Bool get_and_set_done(uint32_t done_array_step3, uint32_t address, T* read_done){
     uint32_t result;
 
-    mutex_lock(done_mutex);
+    if(done_wram != NULL){
+        mutex_pool_lock(&done_mutexes, address >> 5);
+        result = (done_wram[address >> 5] >> (address & 31)) & 1;
+        done_wram[address >> 5] |= (1u << (address & 31));
+        mutex_pool_unlock(&done_mutexes, address >> 5);
+        return (_Bool)result;
+    }
+
+    // Locks are striped by 8-byte MRAM word (8 tiles)
+    mutex_pool_lock(&done_mutexes, address >> 3);
     mram_read((__mram_ptr void*)(done_array_step3 + address), read_done, sizeof(T));
     result = ((*read_done & (0x01 << (address % sizeof(T)))) != 0);
     *read_done |= (0x01 << (address % sizeof(T)));
     mram_write(read_done, (__mram_ptr void*)(done_array_step3 + address), sizeof(T));
-    mutex_unlock(done_mutex);
+    mutex_pool_unlock(&done_mutexes, address >> 3);
 
     return (_Bool)result;
 }
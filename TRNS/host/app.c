@@ -32,12 +32,32 @@ static T* A_host;
 static T* A_backup;
 static T* A_result;
 
+// Step 1 as a scatter-gather transfer: block j of DPU d is row j of its column band
+// of the input (n elements), so each DPU receives M_ * m rows with a single transfer
+typedef struct {
+    T* A;
+    uint64_t rows;
+    uint64_t row_size; // N_ * n
+    uint64_t n;
+    uint64_t first_dpu;
+    uint64_t active_dpus; // DPUs past this one are idle in this round
+} step1_blocks_t;
+
+static bool get_step1_block(struct sg_block_info *out, uint32_t dpu_index, uint32_t block_index, void *args) {
+    step1_blocks_t* blocks = (step1_blocks_t*) args;
+    if(block_index >= blocks->rows || dpu_index >= blocks->active_dpus)
+        return false;
+    out->addr = (uint8_t*) &blocks->A[block_index * blocks->row_size + blocks->n * (blocks->first_dpu + dpu_index)];
+    out->length = blocks->n * sizeof(T);
+    return true;
+}
+
 // Create input arrays
 static void read_input(T* A,   uint64_t  nr_elements) {
     srand(0);
     printf("nr_elements\t%llu\t", nr_elements);
     for ( uint64_t i = 0; i < nr_elements; i++) {
-        A[i] = (T) (1);
+        A[i] = (T) i; // Distinct values, so that misplaced elements are detected
     }
 }
 
@@ -79,89 +99,79 @@ int main(int argc, char **argv) {
 
     // Input/output allocation
     A_host = malloc(M_ * m * N_ * n * sizeof(T));
-    
+    A_backup = malloc(M_ * m * N_ * n * sizeof(T));
+    A_result = malloc(M_ * m * N_ * n * sizeof(T));
     T* done_host = malloc(M_ * n); // Host array to reset done array of step 3
     memset(done_host, 0, M_ * n);
 
     // Create an input file with arbitrary data
     read_input(A_host, M_ * m * N_ * n);
-    // memcpy(A_backup, A_host, M_ * m * N_ * n * sizeof(T));
+    memcpy(A_backup, A_host, M_ * m * N_ * n * sizeof(T));
 
     // Timer declaration
     Timer timer;
+    for(int j=0;j<7;++j){
+        init(&timer, j);
+    }
 
     printf("NR_TASKLETS\t%d\n", NR_TASKLETS);
     printf("M_\t%u, m\t%u, N_\t%u, n\t%u\n", M_, m, N_, n);
 
+    // Out-of-place transposition into a second region of MRAM when both copies of the matrix fit
+    const bool out_of_place = (p.in_place == -1) ? (2 * M_ * m * n * sizeof(T) <= MATRIX_MRAM) : !p.in_place;
+    printf("Transposition\t%s\n", out_of_place ? "out-of-place" : "in-place");
+
+    // Allocate DPUs and load binary, once for all rounds
+    DPU_ASSERT(dpu_alloc(N_ < NR_DPUS ? N_ : NR_DPUS, "sgXferEnable=true", &dpu_set));
+    DPU_ASSERT(dpu_load(dpu_set, DPU_BINARY, NULL));
+    DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus));
+    printf("Allocated %d DPU(s)\n", nr_of_dpus);
+
     // Loop over main kernel
     for(int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
-        int count = 0;
         int timer_fix = 0;
         // Compute output on CPU (performance comparison and verification purposes)
-        // memcpy(A_host, A_backup, M_ * m * N_ * n * sizeof(T));
+        memcpy(A_host, A_backup, M_ * m * N_ * n * sizeof(T));
         if(rep >= p.n_warmup)
             start(&timer, 0, rep - p.n_warmup + timer_fix);
         trns_host(A_host, M_ * m, N_ * n, 1);
         if(rep >= p.n_warmup)
             stop(&timer, 0);
-        
-        A_backup = malloc(M_ * m * N_ * n * sizeof(T));
-        
-        memcpy(A_backup, A_host, M_ * m * N_ * n * sizeof(T));
-        memcpy(A_host, A_backup, M_ * m * N_ * n * sizeof(T));
-        free(A_host);
         printf("CPU Finish\n");
-        A_result = malloc(M_ * m * N_ * n * sizeof(T));
          uint64_t curr_dpu = 0;
          uint64_t active_dpus;
-         uint64_t active_dpus_before = 0;
-         uint64_t first_round = 1;
 
         while(curr_dpu < N_){
-            // Allocate DPUs and load binary
-            printf("count : %d",count);
-            if((N_ - curr_dpu) > NR_DPUS){
-                active_dpus = NR_DPUS;
+            // DPUs past active_dpus stay idle in the last round
+            if((N_ - curr_dpu) > nr_of_dpus){
+                active_dpus = nr_of_dpus;
             } else {
                 active_dpus = (N_ - curr_dpu);
             }
-            if((active_dpus_before != active_dpus) && (!(first_round))){
-                DPU_ASSERT(dpu_free(dpu_set));
-                DPU_ASSERT(dpu_alloc(active_dpus, NULL, &dpu_set));
-                DPU_ASSERT(dpu_load(dpu_set, DPU_BINARY, NULL));
-                DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus));
-                printf("Allocated %d DPU(s)\n", nr_of_dpus);
-            } else if (first_round){
-                DPU_ASSERT(dpu_alloc(active_dpus, NULL, &dpu_set));
-                DPU_ASSERT(dpu_load(dpu_set, DPU_BINARY, NULL));
-                DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus));
-                printf("Allocated %d DPU(s)\n", nr_of_dpus);
-            }
 
             printf("Load input data (step 1)\n");
             if(rep >= p.n_warmup)
                 start(&timer, 1, rep - p.n_warmup + timer_fix);
             // Load input matrix (step 1)
-            for( uint64_t j = 0; j < M_ * m; j++){
-                 uint64_t i = 0;
-                DPU_FOREACH(dpu_set, dpu) {
-                    DPU_ASSERT(dpu_prepare_xfer(dpu, &A_backup[j * N_ * n + n * (i + curr_dpu)]));
-                    i++;
-                }
-                DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, sizeof(T) * j * n, sizeof(T) * n, DPU_XFER_DEFAULT));
-            }
+            step1_blocks_t blocks = {A_backup, M_ * m, N_ * n, n, curr_dpu, active_dpus};
+            get_block_t get_block_info = {.f = &get_step1_block, .args = &blocks, .args_size = sizeof(blocks)};
+            DPU_ASSERT(dpu_push_sg_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, sizeof(T) * M_ * m * n, &get_block_info, DPU_SG_XFER_DISABLE_LENGTH_CHECK));
             if(rep >= p.n_warmup)
                 stop(&timer, 1);
             // Reset done array (for step 3)
-            DPU_FOREACH(dpu_set, dpu) {
-                DPU_ASSERT(dpu_prepare_xfer(dpu, done_host));
+            if(!out_of_place){
+                DPU_FOREACH(dpu_set, dpu, i) {
+                    if(i < active_dpus)
+                        DPU_ASSERT(dpu_prepare_xfer(dpu, done_host));
+                }
+                DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, M_ * m * n * sizeof(T), (M_ * n) / 8 == 0 ? 8 : M_ * n, DPU_XFER_DEFAULT));
             }
-            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, M_ * m * n * sizeof(T), (M_ * n) / 8 == 0 ? 8 : M_ * n, DPU_XFER_DEFAULT));
 
-             uint64_t kernel = 0;
-            dpu_arguments_t input_arguments = {m, n, M_, kernel};
+             uint64_t kernel = out_of_place ? 2 : 0; // Steps 2 and 3 at once when out of place
+            dpu_arguments_t input_arguments = {m, n, M_, kernel, 0};
+            dpu_arguments_t idle_input_arguments = {m, n, M_, kernel, 1};
 	        DPU_FOREACH(dpu_set, dpu, i) {
-	            DPU_ASSERT(dpu_prepare_xfer(dpu, &input_arguments));
+	            DPU_ASSERT(dpu_prepare_xfer(dpu, i < active_dpus ? &input_arguments : &idle_input_arguments));
 	        }
 	        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_arguments), DPU_XFER_DEFAULT));
             printf("Run step 2 on DPU(s) \n");
@@ -191,56 +201,56 @@ int main(int argc, char **argv) {
         }
 #endif
 
-            kernel = 1;
-            dpu_arguments_t input_arguments2 = {m, n, M_, kernel};
-	        DPU_FOREACH(dpu_set, dpu, i) {
-	            DPU_ASSERT(dpu_prepare_xfer(dpu, &input_arguments2));
-	        }
-	        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_arguments2), DPU_XFER_DEFAULT));
-            printf("Run step 3 on DPU(s) \n");
-            // Run DPU kernel
-            if(rep >= p.n_warmup){
-                start(&timer, 3, rep - p.n_warmup + timer_fix);
+            if(!out_of_place){
+                kernel = 1;
+                dpu_arguments_t input_arguments2 = {m, n, M_, kernel, 0};
+                dpu_arguments_t idle_input_arguments2 = {m, n, M_, kernel, 1};
+	            DPU_FOREACH(dpu_set, dpu, i) {
+	                DPU_ASSERT(dpu_prepare_xfer(dpu, i < active_dpus ? &input_arguments2 : &idle_input_arguments2));
+	            }
+	            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_arguments2), DPU_XFER_DEFAULT));
+                printf("Run step 3 on DPU(s) \n");
+                // Run DPU kernel
+                if(rep >= p.n_warmup){
+                    start(&timer, 3, rep - p.n_warmup + timer_fix);
 #if ENERGY
-                DPU_ASSERT(dpu_probe_start(&probe));
+                    DPU_ASSERT(dpu_probe_start(&probe));
 #endif
-            }
-            DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
-            if(rep >= p.n_warmup){
-                stop(&timer, 3);
+                }
+                DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+                if(rep >= p.n_warmup){
+                    stop(&timer, 3);
 #if ENERGY
-                DPU_ASSERT(dpu_probe_stop(&probe));
+                    DPU_ASSERT(dpu_probe_stop(&probe));
 #endif
-            }
+                }
 #if PRINT
-        {
-             uint64_t each_dpu = 0;
-            printf("Display DPU Logs\n");
-            DPU_FOREACH (dpu_set, dpu) {
-                printf("DPU#%d:\n", each_dpu);
-                DPU_ASSERT(dpulog_read_for_dpu(dpu.dpu, stdout));
-                each_dpu++;
+            {
+                 uint64_t each_dpu = 0;
+                printf("Display DPU Logs\n");
+                DPU_FOREACH (dpu_set, dpu) {
+                    printf("DPU#%d:\n", each_dpu);
+                    DPU_ASSERT(dpulog_read_for_dpu(dpu.dpu, stdout));
+                    each_dpu++;
+                }
             }
-        }
 #endif
+            }
 
             printf("Retrieve results\n");
             if(rep >= p.n_warmup)
                 start(&timer, 5, rep - p.n_warmup + timer_fix);
-            DPU_FOREACH(dpu_set, dpu) {
-                DPU_ASSERT(dpu_prepare_xfer(dpu, (T*)(&A_result[curr_dpu * m * n * M_])));
-                curr_dpu++;
+            DPU_FOREACH(dpu_set, dpu, i) {
+                if(i < active_dpus)
+                    DPU_ASSERT(dpu_prepare_xfer(dpu, (T*)(&A_result[(curr_dpu + i) * m * n * M_])));
             }
-            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, sizeof(T) * m * n * M_, DPU_XFER_DEFAULT));
+            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, out_of_place ? sizeof(T) * m * n * M_ : 0, sizeof(T) * m * n * M_, DPU_XFER_DEFAULT));
+            curr_dpu += active_dpus;
             if(rep >= p.n_warmup)
                 stop(&timer, 5);
 
-            if(first_round){
-                first_round = 0;
-            }
             timer_fix++;
         }
-        DPU_ASSERT(dpu_free(dpu_set));
 
     }
 
@@ -264,14 +274,14 @@ int main(int argc, char **argv) {
 
     // Check output
     bool status = true;
-//     for (i = 0; i < M_ * m * N_ * n; i++) {
-//         if(A_host[i] != A_result[i]){ 
-//             status = false;
-// #if PRINT
-//             printf("%d: %lu -- %lu\n", i, A_host[i], A_result[i]);
-// #endif
-//         }
-//     }
+    for (i = 0; i < M_ * m * N_ * n; i++) {
+        if(A_host[i] != A_result[i]){ 
+            status = false;
+#if PRINT
+            printf("%d: %lu -- %lu\n", i, A_host[i], A_result[i]);
+#endif
+        }
+    }
     if (status) {
         printf("[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] Outputs are equal\n");
     } else {
@@ -279,7 +289,8 @@ int main(int argc, char **argv) {
     }
 
     // Deallocation
-    // free(A_host);
+    DPU_ASSERT(dpu_free(dpu_set));
+    free(A_host);
     free(A_backup);
     free(A_result);
     free(done_host);
@@ -14,6 +14,16 @@
 // Data type
 #define T int64_t
 
+// Step 3: done bitmap in WRAM when it fits (else in MRAM), striped locks and tiles claimed in batches
+#ifndef DONE_WRAM
+#define DONE_WRAM (16 << 10)
+#endif
+#define NR_LOCKS 8
+#define TILE_BATCH 4
+
+// MRAM for the matrix (the rest is left to the runtime). Out-of-place transposition needs two copies
+#define MATRIX_MRAM (63 << 20)
+
 // Structures used by both the host and the dpu to communicate information 
 typedef struct {
     uint32_t m;
@@ -22,8 +32,10 @@ typedef struct {
 	enum kernels {
 	    kernel1 = 0,
 	    kernel2 = 1,
-	    nr_kernels = 2,
+	    kernel3 = 2,
+	    nr_kernels = 3,
 	} kernel;
+    uint32_t idle; // DPU without data in this round (returns immediately)
 } dpu_arguments_t;
 
 #ifndef ENERGY
@@ -11,6 +11,7 @@ typedef struct Params {
     int   n_warmup;
     int   n_reps;
     int  exp;
+    int  in_place;
 }Params;
 
 static void usage() {
@@ -28,6 +29,7 @@ static void usage() {
         "\n    -n <I>    n (default=8 elements)"
         "\n    -o <I>    M_ (default=12288 elements)"
         "\n    -p <I>    N_ (default=1 elements)"
+        "\n    -i <I>    out-of-place (0), in-place (1) or out-of-place if it fits in MRAM (-1) (default=-1)"
         "\n");
 }
 
@@ -40,9 +42,10 @@ struct Params input_params(int argc, char **argv) {
     p.n_warmup      = 1;
     p.n_reps        = 3;
     p.exp           = 0;
+    p.in_place      = -1;
 
     int opt;
-    while((opt = getopt(argc, argv, "hw:e:x:m:n:o:p:")) >= 0) {
+    while((opt = getopt(argc, argv, "hw:e:x:m:n:o:p:i:")) >= 0) {
         switch(opt) {
         case 'h':
         usage();
@@ -55,6 +58,7 @@ struct Params input_params(int argc, char **argv) {
         case 'n': p.n             = atoi(optarg); break;
         case 'o': p.M_            = atoi(optarg); break;
         case 'p': p.N_            = atoi(optarg); break;
+        case 'i': p.in_place      = atoi(optarg); break;
         default:
             fprintf(stderr, "\nUnrecognized option!\n");
             usage();
@@ -62,6 +66,8 @@ struct Params input_params(int argc, char **argv) {
         }
     }
     assert(NR_DPUS > 0 && "Invalid # of dpus!");
+    assert(p.in_place >= -1 && p.in_place <= 1 && "Invalid transposition mode!");
+    assert((p.in_place != 0 || 2 * (uint64_t) p.M_ * p.m * p.n * sizeof(T) <= MATRIX_MRAM) && "Out-of-place transposition does not fit in MRAM!");
 
     return p;
 }
@@ -56,49 +56,45 @@ void intHandler(int) {
 }
 
 
+// Mean and standard deviation of every subsequence, in a single pass and without temporaries
+// (same scheme as compute_ts_statistics in host/app.c: Welford for the first window of each thread's chunk, then sliding)
 void preprocess()
 {
-  DTYPE* ACumSum   = new DTYPE[timeSeriesLength];
-  DTYPE* ASqCumSum = new DTYPE[timeSeriesLength];
-  DTYPE* ASum      = new DTYPE[ProfileLength];
-  DTYPE* ASumSq    = new DTYPE[ProfileLength];
-  DTYPE* ASigmaSq  = new DTYPE[ProfileLength];
-
   AMean  = new DTYPE[ProfileLength];
   ASigma = new DTYPE[ProfileLength];
 
-  ACumSum[0]   = A[0];
-  ASqCumSum[0] = A[0] * A[0];
+  int chunkSize = std::max(16384, 16 * windowSize);
 
-  for (int i = 1; i < timeSeriesLength; i++)
+  #pragma omp parallel for schedule(static)
+  for (int chunk = 0; chunk < ProfileLength; chunk += chunkSize)
   {
-    ACumSum[i]   = A[i] + ACumSum[i - 1];
-    ASqCumSum[i] = A[i] * A[i] + ASqCumSum[i - 1];
-  }
+    int end = std::min(chunk + chunkSize, ProfileLength);
+    DTYPE mean = 0, m2 = 0;
 
-  ASum[0] = ACumSum[windowSize - 1];
-  ASumSq[0] = ASqCumSum[windowSize - 1];
-
-  for (int i = 0; i < timeSeriesLength - windowSize; i++)
-  {
-    ASum[i + 1]   = ACumSum[windowSize + i] - ACumSum[i];
-    ASumSq[i + 1] = ASqCumSum[windowSize + i] - ASqCumSum[i];
-  }
+    for (int j = 0; j < windowSize; j++)
+    {
+      DTYPE delta = A[chunk + j] - mean;
+      mean += delta / (j + 1);
+      m2 += delta * (A[chunk + j] - mean);
+    }
 
-  for (int i = 0; i < ProfileLength; i++)
-  {
-      AMean[i] = ASum[i]/ windowSize;
-      ASigmaSq[i] = ASumSq[i] / windowSize - AMean[i] * AMean[i];
-      ASigma[i] = sqrt(ASigmaSq[i]);
+    for (int i = chunk; i < end; i++)
+    {
+      if (i > chunk)
+      {
+        // Slide the window: A[i + windowSize - 1] enters, A[i - 1] leaves
+        DTYPE delta = A[i + windowSize - 1] - A[i - 1];
+        DTYPE oldMean = mean;
+        mean += delta / windowSize;
+        m2 += delta * (A[i + windowSize - 1] - mean + A[i - 1] - oldMean);
+      }
+      AMean[i] = mean;
+      ASigma[i] = (m2 > 0) ? sqrt(m2 / windowSize) : 0;
+    }
   }
-
-  delete ACumSum;
-  delete ASqCumSum;
-  delete ASum;
-  delete ASumSq;
-  delete ASigmaSq;
 }
 
+
 void streamp()
 {
 
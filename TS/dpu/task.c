@@ -10,15 +10,26 @@
 #include <alloc.h>
 #include <mram.h>
 #include <barrier.h>
+#include <mutex_pool.h>
 #include "common.h"
+#include "topk.h"
 
 #define DOTPIP BLOCK_SIZE / sizeof(DTYPE)
 
 __host dpu_arguments_t DPU_INPUT_ARGUMENTS;
-__host dpu_result_t DPU_RESULTS[NR_TASKLETS];
+// Statistics of the queries of the batch (kernels 1 and 2)
+__host dpu_query_t DPU_QUERIES[QUERY_BATCH_MAX];
+
+// Query shared by all tasklets (kernel 2)
+DTYPE *query_wram;
+
+// Subsequences per block along a diagonal (kernel 3)
+#define SJ_PIP 32
+// Elements per 8-byte MRAM word
+#define ELEMS_PER_WORD (8 / sizeof(DTYPE))
 
 // Dot product
-static void dot_product(DTYPE *vectorA, DTYPE *vectorA_aux, DTYPE *vectorB, DTYPE * result) {
+static void dot_product(DTYPE *vectorA, DTYPE *vectorA_aux, DTYPE *vectorB, ACCTYPE * result) {
 
 	for(uint32_t i = 0; i <  BLOCK_SIZE / sizeof(DTYPE); i++)
 	{
@@ -26,27 +37,113 @@ static void dot_product(DTYPE *vectorA, DTYPE *vectorA_aux, DTYPE *vectorB, DTYP
 		{
 			if((j + i) > BLOCK_SIZE / sizeof(DTYPE) - 1)
 			{
-				result[j] += vectorA_aux[(j + i) - BLOCK_SIZE / sizeof(DTYPE)]  * vectorB[i];
+				result[j] += PRODUCT(vectorA_aux[(j + i) - BLOCK_SIZE / sizeof(DTYPE)], vectorB[i]);
 			}
 			else
 			{
-				result[j] += vectorA[j + i] * vectorB[i];
+				result[j] += PRODUCT(vectorA[j + i], vectorB[i]);
 			}
 		}
 	}
 }
 
+// Dot products of DOTPIP consecutive subsequences with DOTPIP query elements
+// window holds 2 * DOTPIP consecutive elements of the time series
+static void sliding_dot_product(DTYPE *window, DTYPE *query, ACCTYPE *result) {
+
+	for(uint32_t i = 0; i < DOTPIP; i++)
+	{
+		DTYPE q = query[i];
+		DTYPE *w = window + i;
+		for(uint32_t j = 0; j < DOTPIP; j++)
+		{
+			result[j] += PRODUCT(w[j], q);
+		}
+	}
+}
+
+// Distances of DOTPIP consecutive subsequences, starting at index: minimum and top-k matches
+// Subsequences from limit on are not valid (yet)
+static void block_min(ACCTYPE *dotprods, DTYPE *mean, DTYPE *sigma, uint32_t query_length, DTYPE query_mean, DTYPE query_std,
+		uint32_t index, uint32_t limit, DTYPE *min_distance, uint32_t *min_index, dpu_result_t *result, uint32_t exclusion_zone) {
+
+	for (uint32_t k = 0; k < (BLOCK_SIZE / sizeof(DTYPE)) && index + k < limit; k++)
+	{
+		DTYPE distance = z_distance(dotprods[k], query_length, mean[k], query_mean, sigma[k], query_std);
+
+		if(distance < *min_distance)
+		{
+			*min_distance = distance;
+			*min_index    = index + k;
+		}
+
+		topk_insert(result->motifs, &result->nr_motifs, TOP_K, distance, index + k, exclusion_zone, false);
+		topk_insert(result->discords, &result->nr_discords, TOP_K, distance, index + k, exclusion_zone, true);
+	}
+}
+
+// Read SJ_PIP elements starting at element elem of an MRAM array: returns a pointer to the first one
+// cache holds SJ_PIP + ELEMS_PER_WORD elements, since elem may not be 8-byte aligned
+static DTYPE *read_elems(uint32_t mram_array, uint32_t elem, DTYPE *cache) {
+	uint32_t aligned = elem - elem % ELEMS_PER_WORD;
+	mram_read((__mram_ptr void const *) (mram_array + aligned * sizeof(DTYPE)), cache, (SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	return cache + (elem - aligned);
+}
+
 BARRIER_INIT(my_barrier, NR_TASKLETS);
 
+// Striped locks for the profile shared by the tasklets (one per chunk of SJ_PIP entries)
+MUTEX_POOL_INIT(profile_mutexes, NR_LOCKS);
+
+// Keep in profile (count entries starting at entry first of an MRAM profile) the smaller distances
+// The entries are updated one chunk at a time, holding the lock of the chunk
+static void update_profile(uint32_t mram_profile, uint32_t first, uint32_t count, DTYPE *distances, uint32_t index,
+		dpu_profile_t *cache_profile) {
+	for (uint32_t done = 0; done < count; )
+	{
+		uint32_t chunk = (first + done) / SJ_PIP;
+		uint32_t n = (chunk + 1) * SJ_PIP - (first + done);
+		if(n > count - done) n = count - done;
+		__mram_ptr void *addr = (__mram_ptr void *) (mram_profile + (first + done) * sizeof(dpu_profile_t));
+
+		mutex_pool_lock(&profile_mutexes, chunk);
+		mram_read(addr, cache_profile, n * sizeof(dpu_profile_t));
+		for (uint32_t k = 0; k < n; k++)
+		{
+			if(distances[done + k] < cache_profile[k].value)
+			{
+				cache_profile[k].value = distances[done + k];
+				cache_profile[k].index = index + done + k;
+			}
+		}
+		mram_write(cache_profile, addr, n * sizeof(dpu_profile_t));
+		mutex_pool_unlock(&profile_mutexes, chunk);
+
+		done += n;
+	}
+}
+
 extern int main_kernel1(void);
+extern int main_kernel2(void);
+extern int main_kernel3(void);
 
-int(*kernels[nr_kernels])(void) = {main_kernel1};
+int(*kernels[nr_kernels])(void) = {main_kernel1, main_kernel2, main_kernel3};
 
 int main(void){
 	// Kernel
 	return kernels[DPU_INPUT_ARGUMENTS.kernel]();
 }
 
+// MRAM layout of kernels 1 and 2: time series slice, means and standard deviations (slice_per_dpu + query_length elements
+// each), a batch of queries (room for QUERY_BATCH_MAX), and the results of each query and tasklet
+static inline uint32_t mram_queries(uint32_t slice_per_dpu, uint32_t query_length) {
+	return (uint32_t) DPU_MRAM_HEAP_POINTER + 3 * (slice_per_dpu + query_length) * sizeof(DTYPE);
+}
+
+static inline uint32_t mram_results(uint32_t slice_per_dpu, uint32_t query_length) {
+	return mram_queries(slice_per_dpu, query_length) + QUERY_BATCH_MAX * query_length * sizeof(DTYPE);
+}
+
 // main_kernel1
 int main_kernel1() {
 	unsigned int tasklet_id = me();
@@ -61,36 +158,21 @@ int main_kernel1() {
 
 	// Input arguments
 	uint32_t query_length  = DPU_INPUT_ARGUMENTS.query_length;
-	DTYPE query_mean       = DPU_INPUT_ARGUMENTS.query_mean;
-	DTYPE query_std        = DPU_INPUT_ARGUMENTS.query_std;
+	uint32_t nr_queries    = DPU_INPUT_ARGUMENTS.nr_queries;
 	uint32_t slice_per_dpu = DPU_INPUT_ARGUMENTS.slice_per_dpu;
+	uint32_t slice_valid   = DPU_INPUT_ARGUMENTS.slice_valid;
 
 	// Boundaries for current tasklet
 	uint32_t myStartElem = tasklet_id  * (slice_per_dpu / (NR_TASKLETS));
 	uint32_t myEndElem   = myStartElem + (slice_per_dpu / (NR_TASKLETS)) - 1;
 
-	// Check time series limit
-	if(myEndElem > slice_per_dpu - query_length) myEndElem = slice_per_dpu - query_length;
-
-	// Starting address of the current processing block in MRAM
-	uint32_t mem_offset = (uint32_t) DPU_MRAM_HEAP_POINTER;
-
-	// Starting address of the query subsequence
-	uint32_t current_mram_block_addr_query = (uint32_t)(mem_offset);
-	mem_offset += query_length * sizeof(DTYPE);
-
-	// Starting address of the time series slice
-	mem_offset += myStartElem * sizeof(DTYPE);
-	uint32_t starting_offset_ts = mem_offset;
-	uint32_t current_mram_block_addr_TS = (uint32_t) mem_offset;
+	// Check time series limit (the slice holds query_length extra points, so every subsequence starting in it is complete)
+	if(myEndElem > slice_valid) myEndElem = slice_valid;
 
-	// Starting address of the time series means
-	mem_offset += (slice_per_dpu + query_length) * sizeof(DTYPE);
-	uint32_t current_mram_block_addr_TSMean = (uint32_t)(mem_offset);
-
-	// Starting address of the time series standard deviations
-	mem_offset += (slice_per_dpu + query_length) * sizeof(DTYPE);
-	uint32_t current_mram_block_addr_TSSigma = (uint32_t)(mem_offset);
+	// Starting addresses of the time series slice, the means and the standard deviations
+	uint32_t starting_offset_ts   = (uint32_t) DPU_MRAM_HEAP_POINTER + myStartElem * sizeof(DTYPE);
+	uint32_t starting_offset_mean  = starting_offset_ts + (slice_per_dpu + query_length) * sizeof(DTYPE);
+	uint32_t starting_offset_sigma = starting_offset_mean + (slice_per_dpu + query_length) * sizeof(DTYPE);
 
 	// Initialize local caches to store the MRAM blocks
 	DTYPE *cache_TS       = (DTYPE *) mem_alloc(BLOCK_SIZE);
@@ -98,58 +180,251 @@ int main_kernel1() {
 	DTYPE *cache_query    = (DTYPE *) mem_alloc(BLOCK_SIZE);
 	DTYPE *cache_TSMean   = (DTYPE *) mem_alloc(BLOCK_SIZE);
 	DTYPE *cache_TSSigma  = (DTYPE *) mem_alloc(BLOCK_SIZE);
-	DTYPE *cache_dotprods = (DTYPE *) mem_alloc(BLOCK_SIZE);
+	ACCTYPE *cache_dotprods = (ACCTYPE *) mem_alloc(DOTPIP * sizeof(ACCTYPE));
+	dpu_result_t *result  = (dpu_result_t *) mem_alloc(sizeof(dpu_result_t));
+
+	for(uint32_t q = 0; q < nr_queries; q++)
+	{
+		uint32_t mram_base_addr_query = mram_queries(slice_per_dpu, query_length) + q * query_length * sizeof(DTYPE);
+		uint32_t current_mram_block_addr_TSMean  = starting_offset_mean;
+		uint32_t current_mram_block_addr_TSSigma = starting_offset_sigma;
 
-	// Create result structure pointer
-	dpu_result_t *result = &DPU_RESULTS[tasklet_id];
+		result->nr_motifs   = 0;
+		result->nr_discords = 0;
 
-	// Auxiliary variables
-	DTYPE distance;
-	DTYPE min_distance = DTYPE_MAX;
-	uint32_t min_index = 0;
+		// Auxiliary variables
+		DTYPE min_distance = DTYPE_MAX;
+		uint32_t min_index = 0;
 
+		for(uint32_t i = myStartElem; i < myEndElem; i+= (BLOCK_SIZE / sizeof(DTYPE)))
+		{
+			for(uint32_t d = 0; d < DOTPIP; d++)
+				cache_dotprods[d] = 0;
+
+			uint32_t current_mram_block_addr_TS    = starting_offset_ts + (i - myStartElem) * sizeof(DTYPE);
+			uint32_t current_mram_block_addr_query = mram_base_addr_query;
+
+			for(uint32_t j = 0; j < (query_length) / (BLOCK_SIZE / sizeof(DTYPE)); j++)
+			{
+				mram_read((__mram_ptr void const *) current_mram_block_addr_TS, cache_TS, BLOCK_SIZE);
+				mram_read((__mram_ptr void const *) current_mram_block_addr_TS + BLOCK_SIZE, cache_TS_aux, BLOCK_SIZE);
+				mram_read((__mram_ptr void const *) current_mram_block_addr_query, cache_query, BLOCK_SIZE);
 
-	for(uint32_t i = myStartElem; i < myEndElem; i+= (BLOCK_SIZE / sizeof(DTYPE)))
+				current_mram_block_addr_TS    += BLOCK_SIZE;
+				current_mram_block_addr_query += BLOCK_SIZE;
+				dot_product(cache_TS, cache_TS_aux, cache_query, cache_dotprods);
+			}
+
+
+			mram_read((__mram_ptr void const *) current_mram_block_addr_TSMean, cache_TSMean, BLOCK_SIZE);
+			mram_read((__mram_ptr void const *) current_mram_block_addr_TSSigma, cache_TSSigma, BLOCK_SIZE);
+			current_mram_block_addr_TSMean  += BLOCK_SIZE;
+			current_mram_block_addr_TSSigma += BLOCK_SIZE;
+
+			block_min(cache_dotprods, cache_TSMean, cache_TSSigma, query_length, DPU_QUERIES[q].mean, DPU_QUERIES[q].std, i, slice_valid,
+					&min_distance, &min_index, result, DPU_INPUT_ARGUMENTS.exclusion_zone);
+		}
+
+		// Save the result
+		result->minValue = min_distance;
+		result->minIndex = min_index;
+		mram_write(result, (__mram_ptr void *) (mram_results(slice_per_dpu, query_length) + (q * NR_TASKLETS + tasklet_id) * sizeof(dpu_result_t)),
+				sizeof(dpu_result_t));
+	}
+
+	return 0;
+}
+
+// main_kernel2: the query stays in WRAM and each chunk of the time series is read once per query chunk
+int main_kernel2() {
+	unsigned int tasklet_id = me();
+#if PRINT
+	printf("tasklet_id = %u\n", tasklet_id);
+#endif
+	if(tasklet_id == 0){
+		mem_reset(); // Reset the heap
+		// Whole blocks, as the query is loaded with BLOCK_SIZE reads
+		query_wram = (DTYPE *) mem_alloc(((DPU_INPUT_ARGUMENTS.query_length * sizeof(DTYPE) + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE);
+	}
+	// Barrier
+	barrier_wait(&my_barrier);
+
+	// Input arguments
+	uint32_t query_length  = DPU_INPUT_ARGUMENTS.query_length;
+	uint32_t nr_queries    = DPU_INPUT_ARGUMENTS.nr_queries;
+	uint32_t slice_per_dpu = DPU_INPUT_ARGUMENTS.slice_per_dpu;
+	uint32_t slice_valid   = DPU_INPUT_ARGUMENTS.slice_valid;
+
+	// Boundaries for current tasklet
+	uint32_t myStartElem = tasklet_id  * (slice_per_dpu / (NR_TASKLETS));
+	uint32_t myEndElem   = myStartElem + (slice_per_dpu / (NR_TASKLETS)) - 1;
+
+	// Check time series limit (the slice holds query_length extra points, so every subsequence starting in it is complete)
+	if(myEndElem > slice_valid) myEndElem = slice_valid;
+
+	// Starting addresses of the time series slice, the means and the standard deviations
+	uint32_t starting_offset_ts   = (uint32_t) DPU_MRAM_HEAP_POINTER + myStartElem * sizeof(DTYPE);
+	uint32_t starting_offset_mean  = starting_offset_ts + (slice_per_dpu + query_length) * sizeof(DTYPE);
+	uint32_t starting_offset_sigma = starting_offset_mean + (slice_per_dpu + query_length) * sizeof(DTYPE);
+
+	// Initialize local caches to store the MRAM blocks
+	DTYPE *cache_window   = (DTYPE *) mem_alloc(2 * BLOCK_SIZE);
+	DTYPE *cache_TSMean   = (DTYPE *) mem_alloc(BLOCK_SIZE);
+	DTYPE *cache_TSSigma  = (DTYPE *) mem_alloc(BLOCK_SIZE);
+	ACCTYPE *cache_dotprods = (ACCTYPE *) mem_alloc(DOTPIP * sizeof(ACCTYPE));
+	dpu_result_t *result  = (dpu_result_t *) mem_alloc(sizeof(dpu_result_t));
+
+	for(uint32_t q = 0; q < nr_queries; q++)
 	{
-		for(uint32_t d = 0; d < DOTPIP; d++)
-			cache_dotprods[d] = 0;
+		// Load the query (tasklets read interleaved blocks), once all tasklets are done with the previous one
+		uint32_t mram_base_addr_query = mram_queries(slice_per_dpu, query_length) + q * query_length * sizeof(DTYPE);
+		if(q > 0)
+			barrier_wait(&my_barrier);
+		for(uint32_t j = tasklet_id * DOTPIP; j < query_length; j += NR_TASKLETS * DOTPIP)
+			mram_read((__mram_ptr void const *) (mram_base_addr_query + j * sizeof(DTYPE)), query_wram + j, BLOCK_SIZE);
+
+		// The query must be in WRAM before any tasklet starts
+		barrier_wait(&my_barrier);
 
-		current_mram_block_addr_TS    = (uint32_t) starting_offset_ts + (i - myStartElem) * sizeof(DTYPE);
-		current_mram_block_addr_query = (uint32_t) DPU_MRAM_HEAP_POINTER;
+		uint32_t current_mram_block_addr_TSMean  = starting_offset_mean;
+		uint32_t current_mram_block_addr_TSSigma = starting_offset_sigma;
 
-		for(uint32_t j = 0; j < (query_length) / (BLOCK_SIZE / sizeof(DTYPE)); j++)
+		result->nr_motifs   = 0;
+		result->nr_discords = 0;
+
+		// Auxiliary variables
+		DTYPE min_distance = DTYPE_MAX;
+		uint32_t min_index = 0;
+
+		for(uint32_t i = myStartElem; i < myEndElem; i+= (BLOCK_SIZE / sizeof(DTYPE)))
 		{
-			mram_read((__mram_ptr void const *) current_mram_block_addr_TS, cache_TS, BLOCK_SIZE);
-			mram_read((__mram_ptr void const *) current_mram_block_addr_TS + BLOCK_SIZE, cache_TS_aux, BLOCK_SIZE);
-			mram_read((__mram_ptr void const *) current_mram_block_addr_query, cache_query, BLOCK_SIZE);
+			for(uint32_t d = 0; d < DOTPIP; d++)
+				cache_dotprods[d] = 0;
+
+			uint32_t current_mram_block_addr_TS = starting_offset_ts + (i - myStartElem) * sizeof(DTYPE);
+
+			for(uint32_t j = 0; j < query_length; j += DOTPIP)
+			{
+				mram_read((__mram_ptr void const *) current_mram_block_addr_TS, cache_window, 2 * BLOCK_SIZE);
+				current_mram_block_addr_TS += BLOCK_SIZE;
+				sliding_dot_product(cache_window, query_wram + j, cache_dotprods);
+			}
+
+			mram_read((__mram_ptr void const *) current_mram_block_addr_TSMean, cache_TSMean, BLOCK_SIZE);
+			mram_read((__mram_ptr void const *) current_mram_block_addr_TSSigma, cache_TSSigma, BLOCK_SIZE);
+			current_mram_block_addr_TSMean  += BLOCK_SIZE;
+			current_mram_block_addr_TSSigma += BLOCK_SIZE;
 
-			current_mram_block_addr_TS    += BLOCK_SIZE;
-			current_mram_block_addr_query += BLOCK_SIZE;
-			dot_product(cache_TS, cache_TS_aux, cache_query, cache_dotprods);
+			block_min(cache_dotprods, cache_TSMean, cache_TSSigma, query_length, DPU_QUERIES[q].mean, DPU_QUERIES[q].std, i, slice_valid,
+					&min_distance, &min_index, result, DPU_INPUT_ARGUMENTS.exclusion_zone);
 		}
 
+		// Save the result
+		result->minValue = min_distance;
+		result->minIndex = min_index;
+		mram_write(result, (__mram_ptr void *) (mram_results(slice_per_dpu, query_length) + (q * NR_TASKLETS + tasklet_id) * sizeof(dpu_result_t)),
+				sizeof(dpu_result_t));
+	}
+
+	return 0;
+}
 
-		mram_read((__mram_ptr void const *) current_mram_block_addr_TSMean, cache_TSMean, BLOCK_SIZE);
-		mram_read((__mram_ptr void const *) current_mram_block_addr_TSSigma, cache_TSSigma, BLOCK_SIZE);
-		current_mram_block_addr_TSMean  += BLOCK_SIZE;
-		current_mram_block_addr_TSSigma += BLOCK_SIZE;
+// main_kernel3: matrix profile self-join (STOMP/SCRIMP)
+// Along diagonal d (subsequence i against subsequence i + d), each dot product is updated in O(1) from the previous one
+// The tasklets share the profile of the DPU in MRAM (striped locks), so its size does not grow with NR_TASKLETS
+int main_kernel3() {
+	unsigned int tasklet_id = me();
+#if PRINT
+	printf("tasklet_id = %u\n", tasklet_id);
+#endif
+	if(tasklet_id == 0){
+		mem_reset(); // Reset the heap
+	}
+	// Barrier
+	barrier_wait(&my_barrier);
+
+	// Input arguments
+	uint32_t ts_length      = DPU_INPUT_ARGUMENTS.ts_length;
+	uint32_t query_length   = DPU_INPUT_ARGUMENTS.query_length;
+	uint32_t profile_length = ts_length - query_length + 1;
+	uint32_t diagonal_step  = DPU_INPUT_ARGUMENTS.diagonal_step * NR_TASKLETS;
+
+	// MRAM layout: time series, means, standard deviations (ts_length elements each), profile of the DPU
+	// Diagonals start after the exclusion zone (first_diagonal), so no pair inside it is ever computed
+	uint32_t mram_base_addr_TS      = (uint32_t) DPU_MRAM_HEAP_POINTER;
+	uint32_t mram_base_addr_TSMean  = mram_base_addr_TS + ts_length * sizeof(DTYPE);
+	uint32_t mram_base_addr_TSSigma = mram_base_addr_TSMean + ts_length * sizeof(DTYPE);
+	uint32_t mram_base_addr_profile = mram_base_addr_TSSigma + ts_length * sizeof(DTYPE);
 
-		for (uint32_t k = 0; k < (BLOCK_SIZE / sizeof(DTYPE)); k++)
+	// Initialize local caches to store the MRAM blocks
+	DTYPE *cache_A          = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_A_in       = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_B          = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_B_in       = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_MeanA      = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_SigmaA     = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_MeanB      = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_SigmaB     = (DTYPE *) mem_alloc((SJ_PIP + ELEMS_PER_WORD) * sizeof(DTYPE));
+	DTYPE *cache_distances  = (DTYPE *) mem_alloc(SJ_PIP * sizeof(DTYPE));
+	dpu_profile_t *cache_profile = (dpu_profile_t *) mem_alloc(SJ_PIP * sizeof(dpu_profile_t));
+
+	// Initialize the profile (each tasklet a range of entries), before any tasklet updates it
+	for (uint32_t k = 0; k < SJ_PIP; k++)
+	{
+		cache_profile[k].value = DTYPE_MAX;
+		cache_profile[k].index = 0;
+	}
+	for (uint32_t i = tasklet_id * SJ_PIP; i < profile_length; i += NR_TASKLETS * SJ_PIP)
+	{
+		uint32_t count = (profile_length - i < SJ_PIP) ? profile_length - i : SJ_PIP;
+		mram_write(cache_profile, (__mram_ptr void *) (mram_base_addr_profile + i * sizeof(dpu_profile_t)), count * sizeof(dpu_profile_t));
+	}
+	barrier_wait(&my_barrier);
+
+	for (uint32_t d = DPU_INPUT_ARGUMENTS.first_diagonal + tasklet_id * DPU_INPUT_ARGUMENTS.diagonal_step; d < profile_length; d += diagonal_step)
+	{
+		uint32_t diagonal_length = profile_length - d;
+
+		// Full dot product of the first pair of subsequences
+		ACCTYPE qt = 0;
+		for (uint32_t j = 0; j < query_length; j += SJ_PIP)
 		{
-			distance = 2 * ((DTYPE) query_length - (cache_dotprods[k] - (DTYPE) query_length * cache_TSMean[k]
-						* query_mean) / (cache_TSSigma[k] * query_std));
+			DTYPE *a = read_elems(mram_base_addr_TS, j, cache_A);
+			DTYPE *b = read_elems(mram_base_addr_TS, j + d, cache_B);
+			uint32_t count = (query_length - j < SJ_PIP) ? query_length - j : SJ_PIP;
+			for (uint32_t k = 0; k < count; k++)
+				qt += PRODUCT(a[k], b[k]);
+		}
 
-			if(distance < min_distance)
+		DTYPE a_last = 0, b_last = 0;
+		for (uint32_t i = 0; i < diagonal_length; i += SJ_PIP)
+		{
+			uint32_t count = (diagonal_length - i < SJ_PIP) ? diagonal_length - i : SJ_PIP;
+			DTYPE *a      = read_elems(mram_base_addr_TS, i, cache_A);
+			DTYPE *a_in   = read_elems(mram_base_addr_TS, i + query_length - 1, cache_A_in);
+			DTYPE *b      = read_elems(mram_base_addr_TS, i + d, cache_B);
+			DTYPE *b_in   = read_elems(mram_base_addr_TS, i + d + query_length - 1, cache_B_in);
+			DTYPE *mean_a = read_elems(mram_base_addr_TSMean, i, cache_MeanA);
+			DTYPE *sigma_a = read_elems(mram_base_addr_TSSigma, i, cache_SigmaA);
+			DTYPE *mean_b = read_elems(mram_base_addr_TSMean, i + d, cache_MeanB);
+			DTYPE *sigma_b = read_elems(mram_base_addr_TSSigma, i + d, cache_SigmaB);
+
+			for (uint32_t k = 0; k < count; k++)
 			{
-				min_distance =  distance;
-				min_index    =  i + k;
+				// Drop the element before the pair, add the last one
+				if(i + k > 0)
+					qt = qt - PRODUCT(k ? a[k - 1] : a_last, k ? b[k - 1] : b_last) + PRODUCT(a_in[k], b_in[k]);
+
+				cache_distances[k] = z_distance(qt, query_length, mean_a[k], mean_b[k], sigma_a[k], sigma_b[k]);
 			}
+			a_last = a[count - 1];
+			b_last = b[count - 1];
+
+			// Both subsequences of each pair: i + k has neighbour i + d + k, and vice versa
+			update_profile(mram_base_addr_profile, i, count, cache_distances, i + d, cache_profile);
+			update_profile(mram_base_addr_profile, i + d, count, cache_distances, i, cache_profile);
 		}
 	}
 
-	// Save the result
-	result->minValue = min_distance;
-	result->minIndex = min_index;
-
 	return 0;
 }
@@ -21,43 +21,89 @@
 
 #include "params.h"
 #include "timer.h"
+#include "topk.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #define DPU_BINARY "./bin/ts_dpu"
 
 #define MAX_DATA_VAL 127
 
-static DTYPE tSeries[1 << 26];
-static DTYPE query  [1 << 15];
-static DTYPE AMean  [1 << 26];
-static DTYPE ASigma [1 << 26];
+// Positions per chunk of the statistics precomputation (at least 16 query lengths)
+#define STATS_CHUNK 16384
+
+// Sized from the input: capacity of the time series (plus one query length of padding for the last DPU)
+static DTYPE *tSeries;
+static DTYPE *query;
+static DTYPE *AMean;
+static DTYPE *ASigma;
 static DTYPE minHost;
 static DTYPE minHostIdx;
 
-// Create input arrays
-static DTYPE *create_test_file(unsigned int ts_elements, unsigned int query_elements) {
+// Time series source: binary file of DTYPE values, or generated data
+static FILE *ts_file;
+
+// Append up to count points at position first of the time series: returns the number of points appended
+static uint64_t append_points(uint64_t first, uint64_t count) {
+	if (ts_file)
+		return fread(tSeries + first, sizeof(DTYPE), count, ts_file);
+
+	for (uint64_t i = first; i < first + count; i++)
+	{
+		tSeries[i] = TO_DTYPE(i % MAX_DATA_VAL);
+	}
+	return count;
+}
+
+// Create input arrays: nr_queries queries of query_length elements
+static DTYPE *create_test_file(const char *query_file, unsigned int query_length, unsigned int nr_queries) {
 	srand(0);
+	uint64_t query_elements = (uint64_t) query_length * nr_queries;
 
-	for (uint64_t i = 0; i < ts_elements; i++)
+	if (query_file)
 	{
-		tSeries[i] = i % MAX_DATA_VAL;
+		FILE *f = fopen(query_file, "rb");
+		if (f == NULL || fread(query, sizeof(DTYPE), query_elements, f) != query_elements)
+		{
+			fprintf(stderr, "Cannot read the query from %s\n", query_file);
+			exit(1);
+		}
+		fclose(f);
+		return tSeries;
 	}
 
 	for (uint64_t i = 0; i < query_elements; i++)
 	{
-		query[i] = i % MAX_DATA_VAL;
+		query[i] = TO_DTYPE((i % query_length + 31 * (i / query_length)) % MAX_DATA_VAL);
 	}
 
 	return tSeries;
 }
 
+// Mean and standard deviation of a query
+static dpu_query_t query_statistics(const DTYPE *query, unsigned int query_length)
+{
+	double queryMean = 0;
+	for(unsigned i = 0; i < query_length; i++) queryMean += FROM_DTYPE(query[i]);
+	queryMean /= (double) query_length;
+
+	double queryVariance = 0;
+	for(unsigned i = 0; i < query_length; i++)
+	{
+		queryVariance += (FROM_DTYPE(query[i]) - queryMean) * (FROM_DTYPE(query[i]) - queryMean);
+	}
+	queryVariance /= (double) query_length;
+
+	dpu_query_t stats = {TO_DTYPE(queryMean), TO_DTYPE(sqrt(queryVariance))};
+	return stats;
+}
+
 // Compute output in the host
 static void streamp(DTYPE* tSeries, DTYPE* AMean, DTYPE* ASigma, int ProfileLength,
 		DTYPE* query, int queryLength, DTYPE queryMean, DTYPE queryStdDeviation)
 {
 	DTYPE distance;
-	DTYPE dotprod;
-	minHost    = INT32_MAX;
+	ACCTYPE dotprod;
+	minHost    = DTYPE_MAX;
 	minHostIdx = 0;
 
 	for (int subseq = 0; subseq < ProfileLength; subseq++)
@@ -65,11 +111,10 @@ static void streamp(DTYPE* tSeries, DTYPE* AMean, DTYPE* ASigma, int ProfileLeng
 		dotprod = 0;
 		for(int j = 0; j < queryLength; j++)
 		{
-			dotprod += tSeries[j + subseq] * query[j];
+			dotprod += PRODUCT(tSeries[j + subseq], query[j]);
 		}
 
-		distance = 2 * (queryLength - (dotprod - queryLength * AMean[subseq]
-					* queryMean) / (ASigma[subseq] * queryStdDeviation));
+		distance = z_distance(dotprod, queryLength, AMean[subseq], queryMean, ASigma[subseq], queryStdDeviation);
 
 		if(distance < minHost)
 		{
@@ -79,42 +124,214 @@ static void streamp(DTYPE* tSeries, DTYPE* AMean, DTYPE* ASigma, int ProfileLeng
 	}
 }
 
-static void compute_ts_statistics(unsigned int timeSeriesLength, unsigned int ProfileLength, unsigned int queryLength)
+// Matrix profile self-join in the host: distance of each subsequence to its nearest neighbour outside the exclusion zone
+static void self_join_host(DTYPE* tSeries, DTYPE* AMean, DTYPE* ASigma, uint32_t ProfileLength, uint32_t queryLength,
+		uint32_t exclusionZone, dpu_profile_t* profile)
+{
+	for (uint32_t i = 0; i < ProfileLength; i++)
+	{
+		profile[i].value = DTYPE_MAX;
+		profile[i].index = 0;
+	}
+
+	for (uint32_t d = exclusionZone; d < ProfileLength; d++)
+	{
+		ACCTYPE dotprod = 0;
+		for (uint32_t j = 0; j < queryLength; j++)
+			dotprod += PRODUCT(tSeries[j], tSeries[j + d]);
+
+		for (uint32_t i = 0; i < ProfileLength - d; i++)
+		{
+			if (i > 0)
+				dotprod = dotprod - PRODUCT(tSeries[i - 1], tSeries[i + d - 1]) + PRODUCT(tSeries[i + queryLength - 1], tSeries[i + d + queryLength - 1]);
+
+			DTYPE distance = z_distance(dotprod, queryLength, AMean[i], AMean[i + d], ASigma[i], ASigma[i + d]);
+
+			if (distance < profile[i].value)
+			{
+				profile[i].value = distance;
+				profile[i].index = i + d;
+			}
+			if (distance < profile[i + d].value)
+			{
+				profile[i + d].value = distance;
+				profile[i + d].index = i;
+			}
+		}
+	}
+}
+
+// Floating-point dot products updated along a diagonal drift from the ones recomputed from scratch
+#if defined(FLOAT)
+#define RECHECK_TOLERANCE(m) (0.01 * (m))
+#else
+#define RECHECK_TOLERANCE(m) 0
+#endif
+
+// Check a matrix profile against the host one: equal distances, and each index points to a neighbour at that distance
+static bool check_profile(dpu_profile_t* profile, dpu_profile_t* profile_host, uint32_t ProfileLength, uint32_t queryLength, uint32_t exclusionZone)
+{
+	for (uint32_t i = 0; i < ProfileLength; i++)
+	{
+		if (profile[i].value != profile_host[i].value)
+			return false;
+		if (profile[i].value == DTYPE_MAX)
+			continue;
+
+		uint32_t j = profile[i].index;
+		if (j >= ProfileLength || (j < i + exclusionZone && i < j + exclusionZone))
+			return false;
+		ACCTYPE dotprod = 0;
+		for (uint32_t k = 0; k < queryLength; k++)
+			dotprod += PRODUCT(tSeries[i + k], tSeries[j + k]);
+		DTYPE distance = z_distance(dotprod, queryLength, AMean[i], AMean[j], ASigma[i], ASigma[j]);
+		if (fabs(FROM_DTYPE(distance) - FROM_DTYPE(profile[i].value)) > RECHECK_TOLERANCE(queryLength))
+			return false;
+	}
+	return true;
+}
+
+// Check top-k matches: sorted, outside each other's exclusion zone, and at the distance the host computes
+static bool check_matches(dpu_match_t* matches, uint32_t nr_matches, uint32_t ProfileLength, DTYPE* query, uint32_t queryLength,
+		DTYPE queryMean, DTYPE queryStdDeviation, uint32_t exclusionZone, bool farthest)
+{
+	for (uint32_t m = 0; m < nr_matches; m++)
+	{
+		uint32_t subseq = matches[m].index;
+		if (subseq >= ProfileLength || (m > 0 && match_better(matches[m], matches[m - 1], farthest)))
+			return false;
+		for (uint32_t o = 0; o < m; o++)
+		{
+			if (subseq < matches[o].index + exclusionZone && matches[o].index < subseq + exclusionZone)
+				return false;
+		}
+
+		ACCTYPE dotprod = 0;
+		for (uint32_t j = 0; j < queryLength; j++)
+			dotprod += PRODUCT(tSeries[j + subseq], query[j]);
+		DTYPE distance = z_distance(dotprod, queryLength, AMean[subseq], queryMean, ASigma[subseq], queryStdDeviation);
+		if (distance != matches[m].value)
+			return false;
+	}
+	return true;
+}
+
+// Distance of two subsequences computed in double precision, to measure the error of DTYPE (NAN for flat subsequences)
+static double distance_double(const DTYPE* a, const DTYPE* b, uint32_t queryLength)
+{
+	double mean_a = 0, mean_b = 0;
+	for (uint32_t k = 0; k < queryLength; k++)
+	{
+		mean_a += FROM_DTYPE(a[k]);
+		mean_b += FROM_DTYPE(b[k]);
+	}
+	mean_a /= queryLength;
+	mean_b /= queryLength;
+
+	double var_a = 0, var_b = 0, cov = 0;
+	for (uint32_t k = 0; k < queryLength; k++)
+	{
+		double da = FROM_DTYPE(a[k]) - mean_a;
+		double db = FROM_DTYPE(b[k]) - mean_b;
+		var_a += da * da;
+		var_b += db * db;
+		cov   += da * db;
+	}
+	if (var_a == 0 || var_b == 0)
+		return NAN;
+	return 2 * queryLength * (1 - cov / sqrt(var_a * var_b));
+}
+
+// Largest error of the distances of some matches of the query
+static double matches_error(dpu_match_t* matches, uint32_t nr_matches, DTYPE* query, uint32_t queryLength)
 {
-	double* ACumSum = malloc(sizeof(double) * timeSeriesLength);
-	ACumSum[0] = tSeries[0];
-	for (uint64_t i = 1; i < timeSeriesLength; i++)
-		ACumSum[i] = tSeries[i] + ACumSum[i - 1];
-	double* ASqCumSum = malloc(sizeof(double) * timeSeriesLength);
-	ASqCumSum[0] = tSeries[0] * tSeries[0];
-	for (uint64_t i = 1; i < timeSeriesLength; i++)
-		ASqCumSum[i] = tSeries[i] * tSeries[i] + ASqCumSum[i - 1];
-	double* ASum = malloc(sizeof(double) * ProfileLength);
-	ASum[0] = ACumSum[queryLength - 1];
-	for (uint64_t i = 0; i < timeSeriesLength - queryLength; i++)
-		ASum[i + 1] = ACumSum[queryLength + i] - ACumSum[i];
-	double* ASumSq = malloc(sizeof(double) * ProfileLength);
-	ASumSq[0] = ASqCumSum[queryLength - 1];
-	for (uint64_t i = 0; i < timeSeriesLength - queryLength; i++)
-		ASumSq[i + 1] = ASqCumSum[queryLength + i] - ASqCumSum[i];
-	double * AMean_tmp = malloc(sizeof(double) * ProfileLength);
-	for (uint64_t i = 0; i < ProfileLength; i++)
-		AMean_tmp[i] = ASum[i] / queryLength;
-	double* ASigmaSq = malloc(sizeof(double) * ProfileLength);
-	for (uint64_t i = 0; i < ProfileLength; i++)
-		ASigmaSq[i] = ASumSq[i] / queryLength - AMean[i] * AMean[i];
-	for (uint64_t i = 0; i < ProfileLength; i++)
+	double error = 0;
+	for (uint32_t m = 0; m < nr_matches; m++)
 	{
-		ASigma[i] = sqrt(ASigmaSq[i]);
-		AMean[i]  = (DTYPE) AMean_tmp[i];
+		double reference = distance_double(tSeries + matches[m].index, query, queryLength);
+		if (!isnan(reference) && fabs(FROM_DTYPE(matches[m].value) - reference) > error)
+			error = fabs(FROM_DTYPE(matches[m].value) - reference);
 	}
+	return error;
+}
 
-	free(ACumSum);
-	free(ASqCumSum);
-	free(ASum);
-	free(ASumSq);
-	free(ASigmaSq);
-	free(AMean_tmp);
+static void print_matches(const char* name, dpu_match_t* matches, uint32_t nr_matches)
+{
+	printf("%s (index:distance):", name);
+	for (uint32_t m = 0; m < nr_matches; m++)
+		printf(" %u:%g", matches[m].index, FROM_DTYPE(matches[m].value));
+	printf("\n");
+}
+
+// Mean and standard deviation of the subsequences starting at positions [first, last), in a single pass and without
+// temporaries. Chunks of positions are processed in parallel: each one computes its first window with Welford's algorithm
+// and then slides it one point at a time, so rounding errors never accumulate over more than one chunk
+static void compute_ts_statistics(uint64_t first, uint64_t last, unsigned int queryLength)
+{
+	uint64_t chunk_size = (STATS_CHUNK > 16 * queryLength) ? STATS_CHUNK : 16 * queryLength;
+
+#pragma omp parallel for schedule(static)
+	for (uint64_t chunk = first; chunk < last; chunk += chunk_size)
+	{
+		uint64_t end = (chunk + chunk_size < last) ? chunk + chunk_size : last;
+		double mean = 0;
+		double m2 = 0; // Sum of squared deviations from the mean
+		for (unsigned int j = 0; j < queryLength; j++)
+		{
+			double x = FROM_DTYPE(tSeries[chunk + j]);
+			double delta = x - mean;
+			mean += delta / (j + 1);
+			m2 += delta * (x - mean);
+		}
+
+		for (uint64_t i = chunk; i < end; i++)
+		{
+			if (i > chunk)
+			{
+				// Slide the window: tSeries[i + queryLength - 1] enters, tSeries[i - 1] leaves
+				double x_in = FROM_DTYPE(tSeries[i + queryLength - 1]);
+				double x_out = FROM_DTYPE(tSeries[i - 1]);
+				double delta = x_in - x_out;
+				double old_mean = mean;
+				mean += delta / queryLength;
+				m2 += delta * (x_in - mean + x_out - old_mean);
+			}
+			ASigma[i] = TO_DTYPE((m2 > 0) ? sqrt(m2 / queryLength) : 0);
+			// Flat segments: avoid dividing by zero
+			if (ASigma[i] == 0)
+				ASigma[i] = TO_DTYPE(1);
+			AMean[i] = TO_DTYPE(mean);
+		}
+	}
+}
+
+// Streaming: push to the DPUs the elements [first, last) of an array, where DPU i holds elements
+// [i * slice_per_dpu, (i + 1) * slice_per_dpu + query_length) at MRAM offset mram_offset
+static void push_range(struct dpu_set_t dpu_set, DTYPE *buffer, uint32_t mram_offset, uint64_t first, uint64_t last,
+		uint32_t slice_per_dpu, uint32_t query_length)
+{
+	struct dpu_set_t dpu;
+	uint32_t i;
+	DPU_FOREACH(dpu_set, dpu, i) {
+		uint64_t slice_start = (uint64_t) i * slice_per_dpu;
+		uint64_t slice_end = slice_start + slice_per_dpu + query_length;
+		if (last <= slice_start || first >= slice_end)
+			continue;
+		// Transfers are 8-byte aligned
+		uint64_t lo = ((first > slice_start ? first : slice_start) - slice_start) & ~1ul;
+		uint64_t hi = (((last < slice_end ? last : slice_end) - slice_start) + 1) & ~1ul;
+		DPU_ASSERT(dpu_copy_to(dpu, DPU_MRAM_HEAP_POINTER_NAME, mram_offset + lo * sizeof(DTYPE), buffer + slice_start + lo, (hi - lo) * sizeof(DTYPE)));
+	}
+}
+
+// Number of complete subsequences of a time series of length ts_length that start in the slice of DPU i
+static uint32_t slice_valid(uint64_t ts_length, uint32_t query_length, uint32_t slice_per_dpu, uint32_t i)
+{
+	uint64_t slice_start = (uint64_t) i * slice_per_dpu;
+	if (ts_length < query_length || ts_length - query_length + 1 <= slice_start)
+		return 0;
+	uint64_t valid = ts_length - query_length + 1 - slice_start;
+	return (valid < slice_per_dpu) ? valid : slice_per_dpu;
 }
 
 // Main of the Host Application
@@ -140,165 +357,353 @@ int main(int argc, char **argv) {
 	unsigned long int ts_size =  p.input_size_n;
 	const unsigned int query_length = p.input_size_m;
 
+	// Streaming: points appended before each repetition after the first
+	unsigned long int nr_appends = p.append ? (p.n_warmup + p.n_reps - 1) * p.append : 0;
+	ts_size += nr_appends;
+
 	// Size adjustment
 	if(ts_size % (nr_of_dpus * NR_TASKLETS*query_length))
 		ts_size = ts_size +  (nr_of_dpus * NR_TASKLETS * query_length - ts_size % (nr_of_dpus * NR_TASKLETS*query_length));
+	// Self-join: arrays are transferred whole, in 8-byte multiples
+	if(p.kernel == kernel3 && ts_size % 2)
+		ts_size++;
+
+	// Buffers sized from the input (ts_size is the capacity, ts_length the number of valid points)
+	tSeries = calloc(ts_size + query_length, sizeof(DTYPE));
+	query   = calloc((uint64_t) query_length * p.nr_queries, sizeof(DTYPE));
+	AMean   = calloc(ts_size + query_length, sizeof(DTYPE));
+	ASigma  = calloc(ts_size + query_length, sizeof(DTYPE));
+	if (p.ts_file && (ts_file = fopen(p.ts_file, "rb")) == NULL) {
+		fprintf(stderr, "Cannot open %s\n", p.ts_file);
+		return -1;
+	}
 
 	// Create an input file with arbitrary data
-	create_test_file(ts_size, query_length);
-	compute_ts_statistics(ts_size, ts_size - query_length, query_length);
-
-	DTYPE query_mean;
-	double queryMean = 0;
-	for(unsigned i = 0; i < query_length; i++) queryMean += query[i];
-	queryMean /= (double) query_length;
-	query_mean = (DTYPE) queryMean;
-
-	DTYPE query_std;
-	double queryStdDeviation;
-	double queryVariance = 0;
-	for(unsigned i = 0; i < query_length; i++)
-	{
-		queryVariance += (query[i] - queryMean) * (query[i] - queryMean);
+	create_test_file(p.query_file, query_length, p.nr_queries);
+	uint64_t ts_length = append_points(0, (p.ts_file || p.append) ? p.input_size_n : ts_size);
+	if (p.kernel == kernel3) {
+		// The self-join uses the whole (even) series
+		ts_size = ts_length & ~1ul;
+		ts_length = ts_size;
 	}
-	queryVariance /= (double) query_length;
-	queryStdDeviation = sqrt(queryVariance);
-	query_std = (DTYPE) queryStdDeviation;
+	if (ts_length < query_length) {
+		fprintf(stderr, "Time series shorter than the query\n");
+		return -1;
+	}
+	compute_ts_statistics(0, ts_length - query_length + 1, query_length);
+
+	dpu_query_t *query_stats = malloc(p.nr_queries * sizeof(dpu_query_t));
+	for (uint32_t q = 0; q < p.nr_queries; q++)
+		query_stats[q] = query_statistics(query + (uint64_t) q * query_length, query_length);
 
 	DTYPE *bufferTS     = tSeries;
-	DTYPE *bufferQ      = query;
 	DTYPE *bufferAMean  = AMean;
 	DTYPE *bufferASigma = ASigma;
 
 	uint32_t slice_per_dpu = ts_size / nr_of_dpus;
 
-	unsigned int kernel = 0;
-	dpu_arguments_t input_arguments = {ts_size, query_length, query_mean, query_std, slice_per_dpu, 0, kernel};
+	unsigned int kernel = p.kernel;
+	dpu_arguments_t input_arguments = {ts_size, query_length, 1, slice_per_dpu, 0, kernel, 0, 0, 0};
 	uint32_t mem_offset;
 
-	dpu_result_t result;
-	result.minValue = INT32_MAX;
-	result.minIndex = 0;
-	result.maxValue = 0;
-	result.maxIndex = 0;
-
-	for (int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
+	// Results of each query: minimum, and top-k nearest (motifs) and farthest (discords) matches
+	dpu_result_t *query_results = calloc(p.nr_queries, sizeof(dpu_result_t));
+	DTYPE *min_host = malloc(p.nr_queries * sizeof(DTYPE));
+
+	int status;
+	double distance_error = 0; // Largest error of the reported distances with respect to double precision
+	if (kernel == kernel3) {
+		// Self-join: every DPU holds the whole series and its statistics, and computes the diagonals
+		// exclusion_zone + i, exclusion_zone + i + nr_of_dpus, ... of the distance matrix
+		// n - m + 1 subsequences; the profile is transferred in 8-byte multiples
+		uint32_t profile_length = ts_size - query_length + 1;
+		uint32_t profile_bytes = (profile_length * sizeof(dpu_profile_t) + 7) & ~7u;
+		uint32_t profile_stride = profile_bytes / sizeof(dpu_profile_t);
+		uint32_t mram_result = 3 * ts_size * sizeof(DTYPE);
+		if ((uint64_t) mram_result + profile_bytes > SJ_MRAM) {
+			printf("[" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] Time series too long for the self-join (MRAM)\n");
+			DPU_ASSERT(dpu_free(dpu_set));
+			return -1;
+		}
 
-		if (rep >= p.n_warmup)
-			start(&timer, 1, rep - p.n_warmup);
-		uint32_t i = 0;
+		dpu_profile_t *profile = malloc(profile_length * sizeof(dpu_profile_t));
+		dpu_profile_t *profile_host = malloc(profile_length * sizeof(dpu_profile_t));
+		dpu_profile_t *profiles_retrieve = malloc(nr_of_dpus * profile_bytes);
 
-		DPU_FOREACH(dpu_set, dpu) {
-			input_arguments.exclusion_zone = 0;
+		for (int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
 
-			DPU_ASSERT(dpu_copy_to(dpu, "DPU_INPUT_ARGUMENTS", 0, (const void *) &input_arguments, sizeof(input_arguments)));
-			i++;
-		}
+			if (rep >= p.n_warmup)
+				start(&timer, 1, rep - p.n_warmup);
+			uint32_t i = 0;
 
-		i = 0;
-		mem_offset = 0;
-		DPU_FOREACH(dpu_set, dpu, i)
-		{
-			DPU_ASSERT(dpu_prepare_xfer(dpu, bufferQ));
-		}
+			input_arguments.exclusion_zone = p.exclusion_zone;
+			input_arguments.diagonal_step = nr_of_dpus;
+			DPU_FOREACH(dpu_set, dpu, i) {
+				input_arguments.first_diagonal = p.exclusion_zone + i;
+				DPU_ASSERT(dpu_copy_to(dpu, "DPU_INPUT_ARGUMENTS", 0, (const void *) &input_arguments, sizeof(input_arguments)));
+			}
 
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, 0, query_length * sizeof(DTYPE), DPU_XFER_DEFAULT));
+			DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, 0, bufferTS, ts_size * sizeof(DTYPE), DPU_XFER_DEFAULT));
+			DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, ts_size * sizeof(DTYPE), bufferAMean, ts_size * sizeof(DTYPE), DPU_XFER_DEFAULT));
+			DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, 2 * ts_size * sizeof(DTYPE), bufferASigma, ts_size * sizeof(DTYPE), DPU_XFER_DEFAULT));
 
-		i = 0;
+			if (rep >= p.n_warmup)
+				stop(&timer, 1);
 
-		mem_offset += query_length * sizeof(DTYPE);
-		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, bufferTS + slice_per_dpu * i));
-		}
+			// Run kernel on DPUs
+			if (rep >= p.n_warmup)
+			{
+				start(&timer, 2, rep - p.n_warmup);
+#if ENERGY
+				DPU_ASSERT(dpu_probe_start(&probe));
+#endif
+			}
 
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mem_offset,(slice_per_dpu + query_length)*sizeof(DTYPE), DPU_XFER_DEFAULT));
+			DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
 
-		mem_offset += ((slice_per_dpu + query_length) * sizeof(DTYPE));
+			if (rep >= p.n_warmup)
+			{
+				stop(&timer, 2);
+#if ENERGY
+				DPU_ASSERT(dpu_probe_stop(&probe));
+#endif
+			}
 
-		i = 0;
-		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, bufferAMean + slice_per_dpu * i));
-		}
+			if (rep >= p.n_warmup)
+				start(&timer, 3, rep - p.n_warmup);
 
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mem_offset, (slice_per_dpu + query_length)*sizeof(DTYPE), DPU_XFER_DEFAULT));
+			DPU_FOREACH(dpu_set, dpu, i) {
+				DPU_ASSERT(dpu_prepare_xfer(dpu, profiles_retrieve + i * profile_stride));
+			}
+			DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_result, profile_bytes, DPU_XFER_DEFAULT));
+
+			// Merge the profiles of the DPUs
+			memcpy(profile, profiles_retrieve, profile_length * sizeof(dpu_profile_t));
+			for (i = 1; i < nr_of_dpus; i++) {
+				for (uint32_t j = 0; j < profile_length; j++) {
+					if (profiles_retrieve[i * profile_stride + j].value < profile[j].value)
+						profile[j] = profiles_retrieve[i * profile_stride + j];
+				}
+			}
 
-		i = 0;
+			if(rep >= p.n_warmup)
+				stop(&timer, 3);
 
-		mem_offset += ((slice_per_dpu + query_length) * sizeof(DTYPE));
+#if PRINT
+			printf("LOGS\n");
+			DPU_FOREACH(dpu_set, dpu) {
+				DPU_ASSERT(dpu_log_read(dpu, stdout));
+			}
+#endif
 
-		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, bufferASigma + slice_per_dpu * i));
+			if (rep >= p.n_warmup)
+				start(&timer, 4, rep - p.n_warmup);
+			self_join_host(tSeries, AMean, ASigma, profile_length, query_length, p.exclusion_zone, profile_host);
+			if(rep >= p.n_warmup)
+				stop(&timer, 4);
 		}
 
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mem_offset, (slice_per_dpu + query_length)*sizeof(DTYPE), DPU_XFER_DEFAULT));
+		status = check_profile(profile, profile_host, profile_length, query_length, p.exclusion_zone);
 
-		if (rep >= p.n_warmup)
-			stop(&timer, 1);
+		// Accuracy of DTYPE over the whole profile
+		for (uint32_t j = 0; j < profile_length; j++) {
+			if (profile[j].value == DTYPE_MAX)
+				continue;
+			double reference = distance_double(tSeries + j, tSeries + profile[j].index, query_length);
+			if (!isnan(reference) && fabs(FROM_DTYPE(profile[j].value) - reference) > distance_error)
+				distance_error = fabs(FROM_DTYPE(profile[j].value) - reference);
+		}
 
-		// Run kernel on DPUs
-		if (rep >= p.n_warmup)
-		{
-			start(&timer, 2, rep - p.n_warmup);
-#if ENERGY
-			DPU_ASSERT(dpu_probe_start(&probe));
-#endif
+		// Motifs and discords: subsequences with the smallest and largest distances to their nearest neighbours
+		for (uint32_t j = 0; j < profile_length; j++) {
+			if (profile[j].value == DTYPE_MAX)
+				continue;
+			topk_insert(query_results[0].motifs, &query_results[0].nr_motifs, TOP_K, profile[j].value, j, p.exclusion_zone, false);
+			topk_insert(query_results[0].discords, &query_results[0].nr_discords, TOP_K, profile[j].value, j, p.exclusion_zone, true);
 		}
+		topk_sort(query_results[0].motifs, query_results[0].nr_motifs, false);
+		topk_sort(query_results[0].discords, query_results[0].nr_discords, true);
+		free(profile);
+		free(profile_host);
+		free(profiles_retrieve);
+	}
+	else {
+		// MRAM layout (see dpu/task.c): time series, means and standard deviations, a batch of queries, and the
+		// results of each query and tasklet. The time series stays in MRAM while the queries stream in batches
+		uint32_t mram_ts      = 0;
+		uint32_t mram_mean    = mram_ts + (slice_per_dpu + query_length) * sizeof(DTYPE);
+		uint32_t mram_sigma   = mram_mean + (slice_per_dpu + query_length) * sizeof(DTYPE);
+		uint32_t mram_queries = mram_sigma + (slice_per_dpu + query_length) * sizeof(DTYPE);
+		uint32_t mram_results = mram_queries + QUERY_BATCH_MAX * query_length * sizeof(DTYPE);
+		dpu_result_t *results_retrieve = malloc(nr_of_dpus * p.batch * NR_TASKLETS * sizeof(dpu_result_t));
+		input_arguments.exclusion_zone = p.exclusion_zone;
+
+		for (int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
+
+			if (rep >= p.n_warmup)
+				start(&timer, 1, rep - p.n_warmup);
+			uint32_t i = 0;
+
+			if (p.append && rep > 0) {
+				// Streaming: append the new points, update the statistics of the subsequences they complete,
+				// and only push to the DPUs the elements that changed
+				uint64_t first = (ts_length >= query_length) ? ts_length - query_length + 1 : 0;
+				uint64_t new_length = ts_length + append_points(ts_length, p.append);
+				if (new_length > ts_length) {
+					compute_ts_statistics(first, new_length - query_length + 1, query_length);
+					push_range(dpu_set, bufferTS, mram_ts, ts_length, new_length, slice_per_dpu, query_length);
+					push_range(dpu_set, bufferAMean, mram_mean, first, new_length - query_length + 1, slice_per_dpu, query_length);
+					push_range(dpu_set, bufferASigma, mram_sigma, first, new_length - query_length + 1, slice_per_dpu, query_length);
+				}
+				ts_length = new_length;
+			}
+			else if (rep == 0 || p.nr_queries == 1) {
+				// A single query re-transfers the time series every repetition; batched queries only the first time
+				mem_offset = mram_ts;
+				DPU_FOREACH(dpu_set, dpu, i) {
+					DPU_ASSERT(dpu_prepare_xfer(dpu, bufferTS + slice_per_dpu * i));
+				}
 
-		DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+				DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mem_offset,(slice_per_dpu + query_length)*sizeof(DTYPE), DPU_XFER_DEFAULT));
 
-		if (rep >= p.n_warmup)
-		{
-			stop(&timer, 2);
-#if ENERGY
-			DPU_ASSERT(dpu_probe_stop(&probe));
-#endif
-		}
+				mem_offset += ((slice_per_dpu + query_length) * sizeof(DTYPE));
 
-		dpu_result_t* results_retrieve[nr_of_dpus];
+				i = 0;
+				DPU_FOREACH(dpu_set, dpu, i) {
+					DPU_ASSERT(dpu_prepare_xfer(dpu, bufferAMean + slice_per_dpu * i));
+				}
 
-		if (rep >= p.n_warmup)
-			start(&timer, 3, rep - p.n_warmup);
+				DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mem_offset, (slice_per_dpu + query_length)*sizeof(DTYPE), DPU_XFER_DEFAULT));
 
-		DPU_FOREACH(dpu_set, dpu, i) {
-			results_retrieve[i] = (dpu_result_t*)malloc(NR_TASKLETS * sizeof(dpu_result_t));
-		}
+				i = 0;
 
+				mem_offset += ((slice_per_dpu + query_length) * sizeof(DTYPE));
 
-		DPU_FOREACH(dpu_set, dpu, i) {
-			DPU_ASSERT(dpu_prepare_xfer(dpu, results_retrieve[i]));
-		}
-		DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_RESULTS", 0, NR_TASKLETS * sizeof(dpu_result_t), DPU_XFER_DEFAULT));
+				DPU_FOREACH(dpu_set, dpu, i) {
+					DPU_ASSERT(dpu_prepare_xfer(dpu, bufferASigma + slice_per_dpu * i));
+				}
 
-		i = 0;
-		DPU_FOREACH(dpu_set, dpu, i) {
-			for (unsigned int each_tasklet = 0; each_tasklet < NR_TASKLETS; each_tasklet++) {
-				if(results_retrieve[i][each_tasklet].minValue < result.minValue && results_retrieve[i][each_tasklet].minValue > 0)
+				DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, mem_offset, (slice_per_dpu + query_length)*sizeof(DTYPE), DPU_XFER_DEFAULT));
+			}
+
+			if (rep >= p.n_warmup)
+				stop(&timer, 1);
+
+			for (uint32_t first_query = 0; first_query < p.nr_queries; first_query += p.batch) {
+				uint32_t nr_batch = (p.nr_queries - first_query < p.batch) ? p.nr_queries - first_query : p.batch;
+				// Timers accumulate over the batches of a repetition (start() only resets them for the first one)
+				int timer_rep = (first_query == 0) ? rep - p.n_warmup : 1;
+
+				// Broadcast the queries of the batch and their statistics
+				if (rep >= p.n_warmup)
+					start(&timer, 1, 1);
+				DPU_FOREACH(dpu_set, dpu, i) {
+					input_arguments.nr_queries = nr_batch;
+					input_arguments.slice_valid = slice_valid(ts_length, query_length, slice_per_dpu, i);
+					DPU_ASSERT(dpu_copy_to(dpu, "DPU_INPUT_ARGUMENTS", 0, (const void *) &input_arguments, sizeof(input_arguments)));
+				}
+				DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, mram_queries, query + (uint64_t) first_query * query_length,
+							nr_batch * query_length * sizeof(DTYPE), DPU_XFER_DEFAULT));
+				DPU_ASSERT(dpu_broadcast_to(dpu_set, "DPU_QUERIES", 0, query_stats + first_query, nr_batch * sizeof(dpu_query_t), DPU_XFER_DEFAULT));
+				if (rep >= p.n_warmup)
+					stop(&timer, 1);
+
+				// Run kernel on DPUs
+				if (rep >= p.n_warmup)
 				{
-					result.minValue = results_retrieve[i][each_tasklet].minValue;
-					result.minIndex = (DTYPE)results_retrieve[i][each_tasklet].minIndex + (i * slice_per_dpu);
+					start(&timer, 2, timer_rep);
+#if ENERGY
+					DPU_ASSERT(dpu_probe_start(&probe));
+#endif
 				}
 
-			}
-			free(results_retrieve[i]);
-			i++;
-		}
+				DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+
+				if (rep >= p.n_warmup)
+				{
+					stop(&timer, 2);
+#if ENERGY
+					DPU_ASSERT(dpu_probe_stop(&probe));
+#endif
+				}
+
+				if (rep >= p.n_warmup)
+					start(&timer, 3, timer_rep);
+
+				DPU_FOREACH(dpu_set, dpu, i) {
+					DPU_ASSERT(dpu_prepare_xfer(dpu, results_retrieve + i * p.batch * NR_TASKLETS));
+				}
+				DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME, mram_results, nr_batch * NR_TASKLETS * sizeof(dpu_result_t), DPU_XFER_DEFAULT));
+
+				for (uint32_t q = 0; q < nr_batch; q++) {
+					dpu_result_t *result = &query_results[first_query + q];
+					result->minValue = DTYPE_MAX;
+					result->minIndex = 0;
+					result->nr_motifs = 0;
+					result->nr_discords = 0;
+					DPU_FOREACH(dpu_set, dpu, i) {
+						for (unsigned int each_tasklet = 0; each_tasklet < NR_TASKLETS; each_tasklet++) {
+							dpu_result_t *r = &results_retrieve[(i * p.batch + q) * NR_TASKLETS + each_tasklet];
+							if(r->minValue < result->minValue)
+							{
+								result->minValue = r->minValue;
+								result->minIndex = r->minIndex + (i * slice_per_dpu);
+							}
+
+							// Merge the top-k heaps, with indices in the whole time series
+							for (uint32_t m = 0; m < r->nr_motifs; m++)
+								topk_insert(result->motifs, &result->nr_motifs, TOP_K, r->motifs[m].value, r->motifs[m].index + i * slice_per_dpu, p.exclusion_zone, false);
+							for (uint32_t m = 0; m < r->nr_discords; m++)
+								topk_insert(result->discords, &result->nr_discords, TOP_K, r->discords[m].value, r->discords[m].index + i * slice_per_dpu, p.exclusion_zone, true);
+						}
+					}
+
+					topk_sort(result->motifs, result->nr_motifs, false);
+					topk_sort(result->discords, result->nr_discords, true);
+				}
 
-		if(rep >= p.n_warmup)
-			stop(&timer, 3);
+				if(rep >= p.n_warmup)
+					stop(&timer, 3);
+			}
 
 
 #if PRINT
-		printf("LOGS\n");
-		DPU_FOREACH(dpu_set, dpu) {
-			DPU_ASSERT(dpu_log_read(dpu, stdout));
-		}
+			printf("LOGS\n");
+			DPU_FOREACH(dpu_set, dpu) {
+				DPU_ASSERT(dpu_log_read(dpu, stdout));
+			}
 #endif
 
-		if (rep >= p.n_warmup)
-			start(&timer, 4, rep - p.n_warmup);
-		streamp(tSeries, AMean, ASigma, ts_size - query_length - 1, query, query_length, query_mean, query_std);
-		if(rep >= p.n_warmup)
-			stop(&timer, 4);
+			if (rep >= p.n_warmup)
+				start(&timer, 4, rep - p.n_warmup);
+			for (uint32_t q = 0; q < p.nr_queries; q++) {
+				streamp(tSeries, AMean, ASigma, ts_length - query_length + 1, query + (uint64_t) q * query_length, query_length,
+						query_stats[q].mean, query_stats[q].std);
+				min_host[q] = minHost;
+			}
+			if(rep >= p.n_warmup)
+				stop(&timer, 4);
+		}
+		free(results_retrieve);
+
+		status = true;
+		for (uint32_t q = 0; q < p.nr_queries; q++) {
+			dpu_result_t *result = &query_results[q];
+			DTYPE *query_q = query + (uint64_t) q * query_length;
+			status = status && (min_host[q] == result->minValue);
+			status = status && check_matches(result->motifs, result->nr_motifs, ts_length - query_length + 1, query_q, query_length,
+					query_stats[q].mean, query_stats[q].std, p.exclusion_zone, false);
+			status = status && check_matches(result->discords, result->nr_discords, ts_length - query_length + 1, query_q, query_length,
+					query_stats[q].mean, query_stats[q].std, p.exclusion_zone, true);
+
+			// Accuracy of DTYPE over the reported matches
+			double motifs_error = matches_error(result->motifs, result->nr_motifs, query_q, query_length);
+			double discords_error = matches_error(result->discords, result->nr_discords, query_q, query_length);
+			if (motifs_error > distance_error)
+				distance_error = motifs_error;
+			if (discords_error > distance_error)
+				distance_error = discords_error;
+		}
 	}
 
 #if ENERGY
@@ -325,14 +730,29 @@ int main(int argc, char **argv) {
 	printf("Energy (J): %f J\t", avg_energy);
 #endif
 
-	int status = (minHost == result.minValue);
 	if (status) {
 		printf("[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] results are equal\n");
 	} else {
 		printf("[" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] results differ!\n");
 	}
+	for (uint32_t q = 0; q < p.nr_queries; q++) {
+		if (p.nr_queries > 1)
+			printf("Query %u\n", q);
+		print_matches("Motifs", query_results[q].motifs, query_results[q].nr_motifs);
+		print_matches("Discords", query_results[q].discords, query_results[q].nr_discords);
+	}
+	printf("Distance error vs. double (max): %g\n", distance_error);
 
 	DPU_ASSERT(dpu_free(dpu_set));
+	free(tSeries);
+	free(query);
+	free(query_stats);
+	free(query_results);
+	free(min_host);
+	free(AMean);
+	free(ASigma);
+	if (ts_file)
+		fclose(ts_file);
 
 #if ENERGY
 	DPU_ASSERT(dpu_probe_deinit(&probe));
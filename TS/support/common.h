@@ -10,30 +10,116 @@
 #define BLOCK_SIZE (1 << BLOCK_SIZE_LOG2)
 #endif
 
-// Data type
+// Data type: INT32 (default), FLOAT, or FIXED (signed Q-format in 32 bits with FRAC_BITS fractional bits,
+// so values must stay below 2^(31 - FRAC_BITS) in magnitude). Dot products are accumulated in ACCTYPE:
+// fixed-point products keep their 2 * FRAC_BITS fractional bits in 64 bits
+#if defined(FLOAT)
+#include <float.h>
+#define DTYPE float
+#define DTYPE_MAX FLT_MAX
+#define ACCTYPE float
+#elif defined(FIXED)
+#ifndef FRAC_BITS
+#define FRAC_BITS 16
+#endif
+#define DTYPE int32_t
+#define DTYPE_MAX INT32_MAX
+#define ACCTYPE int64_t
+#else
 #define DTYPE int32_t
 #define DTYPE_MAX INT32_MAX
+#define ACCTYPE int32_t
+#endif
+
+// Conversions between DTYPE and real numbers (host side)
+#if defined(FIXED)
+#define TO_DTYPE(x) ((DTYPE) ((x) * (1 << FRAC_BITS) + (((double) (x) < 0) ? -0.5 : 0.5)))
+#define FROM_DTYPE(x) ((double) (x) / (1 << FRAC_BITS))
+#else
+#define TO_DTYPE(x) ((DTYPE) (x))
+#define FROM_DTYPE(x) ((double) (x))
+#endif
+
+// Product of two elements, accumulated into dot products
+#define PRODUCT(a, b) ((ACCTYPE) (a) * (b))
+
+// Longest query that kernel 2 keeps in WRAM (elements)
+#define QUERY_WRAM_MAX 4096
+
+// Queries per batch (kernels 1 and 2): the time series stays in MRAM and each launch processes a batch of queries
+#define QUERY_BATCH_MAX 64
+
+#define NR_LOCKS 8 // Mutexes protecting the entries of the self-join profile (striped)
+
+// MRAM left for the self-join, which keeps the whole series, its statistics and the profile in each DPU
+// (1 MB kept for the program and the MRAM globals)
+#define SJ_MRAM (63 << 20)
 
 typedef struct  {
 	uint32_t ts_length;
     uint32_t query_length;
-    DTYPE query_mean;
-    DTYPE query_std;
+    uint32_t nr_queries;
     uint32_t slice_per_dpu;
     int32_t exclusion_zone;
     enum kernels {
 		kernel1 = 0,
-		nr_kernels = 1,
+		kernel2 = 1,
+		kernel3 = 2,
+		nr_kernels = 3,
 	} kernel;
+    // Self-join (kernel 3): this DPU computes diagonals first_diagonal, first_diagonal + diagonal_step, ...
+    uint32_t first_diagonal;
+    uint32_t diagonal_step;
+    // Kernels 1 and 2: number of valid subsequences in the slice of this DPU (streaming input)
+    uint32_t slice_valid;
 }dpu_arguments_t;
 
+// Mean and standard deviation of a query
+typedef struct  {
+    DTYPE mean;
+    DTYPE std;
+}dpu_query_t;
+
+// Nearest and farthest matches kept per tasklet
+#ifndef TOP_K
+#define TOP_K 8
+#endif
+
+// Match of the query: distance and index of the subsequence
+typedef struct  {
+    DTYPE value;
+    uint32_t index;
+}dpu_match_t;
+
 typedef struct  {
     DTYPE minValue;
     uint32_t minIndex;
     DTYPE maxValue;
     uint32_t maxIndex;
+    uint32_t nr_motifs;
+    uint32_t nr_discords;
+    dpu_match_t motifs[TOP_K];   // Top-k heaps (see topk.h)
+    dpu_match_t discords[TOP_K];
 }dpu_result_t;
 
+// Matrix profile entry: distance to the nearest neighbour and its index
+typedef struct  {
+    DTYPE value;
+    uint32_t index;
+}dpu_profile_t;
+
+// z-normalized (squared) Euclidean distance of two subsequences of length m, from their dot product, means and standard deviations
+static inline DTYPE z_distance(ACCTYPE dotprod, uint32_t m, DTYPE mean_a, DTYPE mean_b, DTYPE sigma_a, DTYPE sigma_b) {
+#if defined(FIXED)
+    // Numerator with 2 * FRAC_BITS fractional bits, divided by a denominator with FRAC_BITS
+    int64_t scale = ((int64_t) sigma_a * sigma_b) >> FRAC_BITS;
+    int64_t ratio = (dotprod - (int64_t) m * mean_a * mean_b) / (scale ? scale : 1);
+    return (DTYPE) (2 * (((int64_t) m << FRAC_BITS) - ratio));
+#else
+    return 2 * ((DTYPE) m - (dotprod - (DTYPE) m * mean_a * mean_b) / (sigma_a * sigma_b));
+#endif
+}
+
 #ifndef ENERGY
 #define ENERGY 0
 #endif
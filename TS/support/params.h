@@ -9,8 +9,28 @@ typedef struct Params {
   unsigned long  input_size_m;
   int  n_warmup;
   int  n_reps;
+  unsigned int kernel;
+  unsigned int exclusion_zone;
+  const char *ts_file;
+  const char *query_file;
+  unsigned long append;
+  unsigned int nr_queries;
+  unsigned int batch;
 }Params;
 
+// Number of DTYPE elements in a binary file
+static unsigned long file_elements(const char *name) {
+  FILE *f = fopen(name, "rb");
+  if(f == NULL) {
+    fprintf(stderr, "\nCannot open %s\n", name);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  unsigned long elements = ftell(f) / sizeof(DTYPE);
+  fclose(f);
+  return elements;
+}
+
 void usage() {
   fprintf(stderr,
     "\nUsage:  ./program [options]"
@@ -22,7 +42,18 @@ void usage() {
     "\n"
     "\nBenchmark-specific options:"
     "\n    -n <n>    n (TS length. Default=64K elements)"
-    "\n    -m <m>    m (Query length. Default=256 elements)"
+    "\n    -m <m>    m (Query length, a multiple of BLOCK_SIZE / sizeof(DTYPE) for kernels 0 and 1. Default=256 elements)"
+    "\n    -k <k>    DPU kernel: 0 = dot products reading the query from MRAM, 1 = query resident in WRAM,"
+    "\n              2 = matrix profile self-join with subsequence length m (default=0). The self-join keeps the whole"
+    "\n              series, its statistics and the profile in each DPU: n is at most SJ_MRAM / (3 * sizeof(DTYPE) + 8),"
+    "\n              about 3.3M points"
+    "\n    -z <z>    exclusion zone of the self-join and of the top-k matches (default=m/4)"
+    "\n    -f <file> read the time series from a binary file of DTYPE values (at most n of them initially)"
+    "\n    -q <file> read the queries from a binary file of DTYPE values (sets m = file elements / u)"
+    "\n    -a <a>    streaming: append a points before each repetition after the first (from the file, or generated),"
+    "\n              and only update the statistics and DPU slices they affect (kernels 0 and 1, default=0)"
+    "\n    -u <u>    number of queries: with u > 1 the time series stays in MRAM across repetitions (kernels 0 and 1, default=1)"
+    "\n    -b <b>    queries per batch (DPU launch), at most QUERY_BATCH_MAX (default=min(u, QUERY_BATCH_MAX))"
     "\n");
   }
 
@@ -33,9 +64,16 @@ void usage() {
 
     p.n_warmup      = 1;
     p.n_reps        = 3;
+    p.kernel        = 0;
+    p.exclusion_zone = 0;
+    p.ts_file       = NULL;
+    p.query_file    = NULL;
+    p.append        = 0;
+    p.nr_queries    = 1;
+    p.batch         = 0;
 
     int opt;
-    while((opt = getopt(argc, argv, "hw:e:n:m:")) >= 0) {
+    while((opt = getopt(argc, argv, "hw:e:n:m:k:z:f:q:a:u:b:")) >= 0) {
       switch(opt) {
         case 'h':
         usage();
@@ -45,13 +83,34 @@ void usage() {
         case 'e': p.n_reps        = atoi(optarg); break;
         case 'n': p.input_size_n  = atol(optarg); break;
         case 'm': p.input_size_m  = atol(optarg); break;
+        case 'k': p.kernel        = atoi(optarg); break;
+        case 'z': p.exclusion_zone = atoi(optarg); break;
+        case 'f': p.ts_file       = optarg; break;
+        case 'q': p.query_file    = optarg; break;
+        case 'a': p.append        = atol(optarg); break;
+        case 'u': p.nr_queries    = atoi(optarg); break;
+        case 'b': p.batch         = atoi(optarg); break;
         default:
         fprintf(stderr, "\nUnrecognized option!\n");
         usage();
         exit(0);
       }
     }
+    assert(p.nr_queries > 0 && "Invalid # of queries!");
+    if(p.query_file) p.input_size_m = file_elements(p.query_file) / p.nr_queries;
+    if(p.batch == 0) p.batch = (p.nr_queries < QUERY_BATCH_MAX) ? p.nr_queries : QUERY_BATCH_MAX;
+    if(p.batch > p.nr_queries) p.batch = p.nr_queries;
+    assert(p.batch <= QUERY_BATCH_MAX && "Batch larger than QUERY_BATCH_MAX!");
     assert(NR_DPUS > 0 && "Invalid # of dpus!");
+    assert(p.input_size_m % 2 == 0 && "Query length must be even!");
+    assert((p.append == 0 || p.kernel != kernel3) && "Streaming is not supported by the self-join!");
+    assert((p.nr_queries == 1 || p.kernel != kernel3) && "The self-join takes no queries!");
+    assert(p.kernel < nr_kernels && "Invalid kernel!");
+    assert((p.kernel != kernel2 || p.input_size_m <= QUERY_WRAM_MAX) && "Query too long for kernel 2!");
+    // The dot products of kernels 1 and 2 read the query in whole blocks (m is known here, also with -q)
+    assert((p.kernel == kernel3 || p.input_size_m % (BLOCK_SIZE / sizeof(DTYPE)) == 0) && "Query length must be a multiple of BLOCK_SIZE / sizeof(DTYPE)!");
+    if(p.exclusion_zone == 0) p.exclusion_zone = p.input_size_m / 4;
+    assert(p.exclusion_zone > 0 && "Invalid exclusion zone!");
 
     return p;
   }
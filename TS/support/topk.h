@@ -0,0 +1,88 @@
+#ifndef _TOPK_H_
+#define _TOPK_H_
+
+#include <stdbool.h>
+#include "common.h"
+
+// Bounded top-k of matches with exclusion-zone suppression
+// The heap keeps its worst match at the root. Two matches closer than the exclusion zone never
+// coexist: a new match replaces the ones it conflicts with only if it is better than all of them
+
+// Nearest (smaller distance) or farthest (larger distance) first; ties go to the smaller index
+static inline bool match_better(dpu_match_t a, dpu_match_t b, bool farthest) {
+    if(a.value != b.value)
+        return farthest ? a.value > b.value : a.value < b.value;
+    return a.index < b.index;
+}
+
+static inline void topk_swap(dpu_match_t *heap, uint32_t a, uint32_t b) {
+    dpu_match_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static inline void topk_sift_up(dpu_match_t *heap, uint32_t i, bool farthest) {
+    while(i > 0 && match_better(heap[(i - 1) / 2], heap[i], farthest)) {
+        topk_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static inline void topk_sift_down(dpu_match_t *heap, uint32_t size, uint32_t i, bool farthest) {
+    for(;;) {
+        uint32_t worst = i;
+        if(2 * i + 1 < size && match_better(heap[worst], heap[2 * i + 1], farthest))
+            worst = 2 * i + 1;
+        if(2 * i + 2 < size && match_better(heap[worst], heap[2 * i + 2], farthest))
+            worst = 2 * i + 2;
+        if(worst == i)
+            return;
+        topk_swap(heap, i, worst);
+        i = worst;
+    }
+}
+
+static inline void topk_remove(dpu_match_t *heap, uint32_t *size, uint32_t i, bool farthest) {
+    heap[i] = heap[--(*size)];
+    if(i < *size) {
+        topk_sift_up(heap, i, farthest);
+        topk_sift_down(heap, *size, i, farthest);
+    }
+}
+
+static inline void topk_insert(dpu_match_t *heap, uint32_t *size, uint32_t k, DTYPE value, uint32_t index,
+        uint32_t exclusion_zone, bool farthest) {
+    dpu_match_t match = {value, index};
+    if(*size == k && !match_better(match, heap[0], farthest))
+        return;
+
+    // Matches within the exclusion zone
+    for(uint32_t i = 0; i < *size; i++) {
+        uint32_t gap = (heap[i].index > index) ? heap[i].index - index : index - heap[i].index;
+        if(gap < exclusion_zone && !match_better(match, heap[i], farthest))
+            return;
+    }
+    for(uint32_t i = *size; i-- > 0;) {
+        uint32_t gap = (heap[i].index > index) ? heap[i].index - index : index - heap[i].index;
+        if(gap < exclusion_zone)
+            topk_remove(heap, size, i, farthest);
+    }
+
+    if(*size == k)
+        topk_remove(heap, size, 0, farthest);
+    heap[(*size)++] = match;
+    topk_sift_up(heap, *size - 1, farthest);
+}
+
+// Sort the matches, best first (destroys the heap order)
+static inline void topk_sort(dpu_match_t *heap, uint32_t size, bool farthest) {
+    for(uint32_t i = 1; i < size; i++) {
+        dpu_match_t m = heap[i];
+        uint32_t j = i;
+        for(; j > 0 && match_better(m, heap[j - 1], farthest); j--)
+            heap[j] = heap[j - 1];
+        heap[j] = m;
+    }
+}
+
+#endif
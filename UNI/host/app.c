@@ -16,6 +16,7 @@
 #include "../support/common.h"
 #include "../support/timer.h"
 #include "../support/params.h"
+#include "../../support/merge.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -198,15 +199,15 @@ int main(int argc, char **argv) {
                 // Sequential scan - offset
                 offset_scan[i] += offset[i];
             }
-            // Sequential scan
-            uint32_t temp = results[i].t_count - offset[i];
-            results_scan[i] = accum;
-            accum += temp;
-#if PRINT
-            printf("i=%d -- %u,  %u, %u -- %u\n", i, results_scan[i], accum, temp, offset_scan[i]);
-#endif
             free(results_retrieve[i]);
         }
+        // Scan of the counts of all DPUs, without the elements repeated across DPUs
+        for(i = 0; i < nr_of_dpus; i++)
+            offset[i] = results[i].t_count - offset[i];
+        accum = scan_partials(results_scan, offset, nr_of_dpus, 1);
+#if PRINT
+        printf("accum -- %u\n", accum);
+#endif
         if(rep >= p.n_warmup)
 		    stop(&timer, 3);
 
@@ -0,0 +1,64 @@
+#ifndef _MERGE_H_
+#define _MERGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <omp.h>
+
+// Type of the per-DPU partial results
+#ifndef MERGE_T
+#define MERGE_T uint32_t
+#endif
+
+#define MERGE_CHUNK 4096 // Max. elements merged by a thread at a time, kept in cache while all DPUs are added
+#define MERGE_MIN 16     // Min. elements added by a thread (one cache line of 4-byte results, no false sharing)
+
+// Merge per-DPU partial results: dst[j] = sum of parts[i * stride + j], for i < nr_parts and j < size
+// dst may be the first partial result (parts). Results with at least MERGE_MIN elements per thread are split
+// across threads by chunks of elements (vectorized sum over DPUs), smaller ones (e.g. one value per DPU) by DPUs,
+// with a tree reduction of the per-thread sums
+static inline void merge_partials(MERGE_T *dst, const MERGE_T *parts, unsigned int nr_parts, size_t size, size_t stride) {
+    size_t nr_threads = omp_get_max_threads();
+    if (size >= nr_threads * MERGE_MIN) {
+        // At least one chunk per thread, in whole cache lines
+        size_t chunk = (size + nr_threads - 1) / nr_threads;
+        chunk = (chunk + MERGE_MIN - 1) / MERGE_MIN * MERGE_MIN;
+        if (chunk > MERGE_CHUNK)
+            chunk = MERGE_CHUNK;
+        #pragma omp parallel for schedule(static)
+        for (size_t c = 0; c < size; c += chunk) {
+            size_t end = (c + chunk < size) ? c + chunk : size;
+            for (size_t j = c; j < end; j++)
+                dst[j] = parts[j];
+            for (unsigned int i = 1; i < nr_parts; i++) {
+                const MERGE_T *part = parts + i * stride;
+                #pragma omp simd
+                for (size_t j = c; j < end; j++)
+                    dst[j] += part[j];
+            }
+        }
+    } else {
+        for (size_t j = 0; j < size; j++)
+            dst[j] = parts[j];
+        #pragma omp parallel for reduction(+:dst[:size]) schedule(static) if(nr_parts * size >= nr_threads * MERGE_MIN)
+        for (unsigned int i = 1; i < nr_parts; i++) {
+            const MERGE_T *part = parts + i * stride;
+            #pragma omp simd
+            for (size_t j = 0; j < size; j++)
+                dst[j] += part[j];
+        }
+    }
+}
+
+// Exclusive scan of per-DPU counts (parts[i * stride]) into dst, returns the total
+// One count per DPU is too little work to split across threads
+static inline uint32_t scan_partials(uint32_t *dst, const uint32_t *parts, unsigned int nr_parts, size_t stride) {
+    uint32_t accum = 0;
+    for (unsigned int i = 0; i < nr_parts; i++) {
+        dst[i] = accum;
+        accum += parts[i * stride];
+    }
+    return accum;
+}
+
+#endif